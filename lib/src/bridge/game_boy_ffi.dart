@@ -45,7 +45,7 @@ class Gameboy {
   late final _gb_get_framebuffer =
       _gb_get_framebufferPtr.asFunction<ffi.Pointer<ffi.Uint32> Function()>();
 
-  void gb_load_rom(
+  bool gb_load_rom(
     ffi.Pointer<ffi.Uint8> data,
     int size,
   ) {
@@ -57,9 +57,9 @@ class Gameboy {
 
   late final _gb_load_romPtr = _lookup<
       ffi.NativeFunction<
-          ffi.Void Function(ffi.Pointer<ffi.Uint8>, ffi.Int)>>('gb_load_rom');
+          ffi.Bool Function(ffi.Pointer<ffi.Uint8>, ffi.Int)>>('gb_load_rom');
   late final _gb_load_rom =
-      _gb_load_romPtr.asFunction<void Function(ffi.Pointer<ffi.Uint8>, int)>();
+      _gb_load_romPtr.asFunction<bool Function(ffi.Pointer<ffi.Uint8>, int)>();
 
   void gb_reset() {
     return _gb_reset();
@@ -3468,7 +3468,7 @@ class Gameboy {
   late final _mmu_write8 =
       _mmu_write8Ptr.asFunction<void Function(ffi.Pointer<MMU>, int, int)>();
 
-  void mmu_load_rom(
+  bool mmu_load_rom(
     ffi.Pointer<MMU> mmu,
     ffi.Pointer<ffi.Uint8> data,
     int size,
@@ -3482,10 +3482,10 @@ class Gameboy {
 
   late final _mmu_load_romPtr = _lookup<
       ffi.NativeFunction<
-          ffi.Void Function(ffi.Pointer<MMU>, ffi.Pointer<ffi.Uint8>,
+          ffi.Bool Function(ffi.Pointer<MMU>, ffi.Pointer<ffi.Uint8>,
               ffi.Size)>>('mmu_load_rom');
   late final _mmu_load_rom = _mmu_load_romPtr.asFunction<
-      void Function(ffi.Pointer<MMU>, ffi.Pointer<ffi.Uint8>, int)>();
+      bool Function(ffi.Pointer<MMU>, ffi.Pointer<ffi.Uint8>, int)>();
 
   void cpu_init(
     ffi.Pointer<CPU> cpu,
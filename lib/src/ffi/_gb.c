@@ -1,52 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "_gb.h"
-#include "cpu.h"
-#include "mmu.h"
-#include "ppu.h"
+#include "gameboy.h"
+#include "host_time.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-CPU cpu;
-MMU mmu;
-PPU ppu;
+#define CYCLES_PER_FRAME 70224 // 70224 ticks (1 frame at 60Hz)
+#define CYCLES_PER_LINE  456
 
+static GameBoy default_gb;
 
-void gb_init() {
-    cpu_init(&cpu);
-    mmu_init(&mmu);
-    ppu_init(&ppu);
 
-    cpu_connect_mmu(&mmu);
+// Instances are cache-line aligned, see struct GameBoy
+static GameBoy* gb_alloc() {
+    void* gb = NULL;
+    if (posix_memalign(&gb, _Alignof(GameBoy), sizeof(GameBoy)) != 0) return NULL;
+    return gb;
 }
 
 
-void gb_reset() {
-    gb_init();
+GameBoy* gb_create() {
+    GameBoy* gb = gb_alloc();
+    if (gb == NULL) return NULL;
+    memset(gb, 0, sizeof(GameBoy));
+    gb_instance_reset(gb);
+    return gb;
 }
 
 
-static void check_serial_output() {
-    uint8_t sc = mmu_read8(&mmu, 0xFF02);
-    if (sc == 0x81) {
-        uint8_t c = mmu_read8(&mmu, 0xFF01);
+void gb_destroy(GameBoy* gb) {
+    if (gb == NULL || gb == &default_gb) return;
+    if (gb->movie) gb_movie_stop(gb->movie);
+    gb_trace_stop(gb->trace);
+    gb_profile_stop(gb->profile);
+    gb_shm_close(gb->shm);
+    gb_recorder_stop(gb->recorder, NULL);
+    serial_unlink(&gb->serial);
+    ppu_pipeline_stop(&gb->ppu);
+    mmu_release(&gb->mmu);
+    free(gb->run_ahead_state);
+    free(gb);
+}
 
-        putchar(c);
-        fflush(stdout);
 
-        static char buf[256];
-        static int idx = 0;
-        if (idx < 255) buf[idx++] = c;
+// Copies machine state only: memory pages are shared copy-on-write and the
+// host-side queues and audio buffers of the child start out empty. Fields
+// added to GameBoy must be handled here too.
+GameBoy* gb_fork(GameBoy* parent) {
+    GameBoy* gb = gb_alloc();
+    if (gb == NULL) return NULL;
+
+    gb->cpu = parent->cpu;
+    gb->mmu = parent->mmu;
+    gb->ppu = parent->ppu;
+    gb->timer = parent->timer;
+    gb->sched = parent->sched;
+    mmu_fork(&gb->mmu, &parent->mmu);
+
+    joypad_init(&gb->joypad);
+    gb->joypad.select = parent->joypad.select;
+    gb->joypad.pressed = parent->joypad.pressed;
+
+    gb->serial.peer = NULL;
+    gb->serial.mirror_stdout = false;
+    serial_init(&gb->serial, &gb->mmu, &gb->sched);
+    gb->serial.sb = parent->serial.sb;
+    gb->serial.sc = parent->serial.sc;
+
+    // Буферы синтеза и кольцо не копируются
+    memcpy(&gb->apu, &parent->apu, offsetof(APU, left));
+    atomic_init(&gb->apu.head, 0);
+    atomic_init(&gb->apu.tail, 0);
+    gb->apu.overruns = 0;
+    gb->apu.tap = NULL;
+    gb->apu.tap_ctx = NULL;
+    apu_restore(&gb->apu);
+
+    cpu_connect_mmu(&gb->cpu, &gb->mmu);
+    mmu_connect(&gb->mmu, gb);
+    gb->timer.mmu = &gb->mmu;
+    gb->timer.sched = &gb->sched;
+    gb->ppu.mmu = &gb->mmu;
+    gb->ppu.sched = &gb->sched;
+    gb->ppu.pipeline = NULL;
+    gb->ppu.framebuffer = gb->framebuffer;
+    memcpy(gb->framebuffer, parent->framebuffer, sizeof(gb->framebuffer));
+    gb->apu.sched = &gb->sched;
+
+    gb->movie = NULL;
+    gb->trace = NULL;
+    gb->profile = NULL;
+    gb->cpu.profile = NULL;
+    gb->shm = NULL;
+    gb->recorder = NULL;
+    memcpy(gb->frame_dirty, parent->frame_dirty, sizeof(gb->frame_dirty));
+    gb->video_off = parent->video_off;
+    gb->timed = parent->timed;
+    gb->instructions = parent->instructions;
+    gb->run_target = parent->run_target;
+    gb->frame_start = parent->frame_start;
+    gb->frame_vblank = parent->frame_vblank;
+    gb->log_stdout = false;
+#ifdef GB_STATS
+    memset(&gb->stats, 0, sizeof(GbStats));
+#endif
+    gb->run_ahead = parent->run_ahead;
+    gb->hidden = false;
+    gb->run_ahead_state = NULL;
+    gb->run_ahead_frames = 0;
+    gb->run_ahead_frame_seconds = 0;
+    gb->run_ahead_extra_seconds = 0;
+
+    // Ввод родителя, ещё не применённый, ребёнку не достаётся
+    scheduler_set(&gb->sched, EVENT_JOYPAD, EVENT_NEVER);
+    return gb;
+}
 
-        if (c == '\n') {
-            buf[idx] = '\0';
-            printf(">>> %s", buf);
-            idx = 0;
-        }
 
-        mmu_write8(&mmu, 0xFF02, 0x00);
+void gb_memory_stats(GameBoy* gb, MemoryStats* stats) {
+    stats->instance_bytes = sizeof(GameBoy);
+    stats->page_size = MMU_PAGE_SIZE;
+    stats->pages = MMU_PAGE_COUNT;
+    stats->private_pages = 0;
+    stats->out_of_memory = gb->mmu.out_of_memory;
+    for (int i = 0; i < MMU_PAGE_COUNT; i++) {
+        stats->private_pages += gb->mmu.owned[i];
     }
 }
 
 
+GameBoy* gb_default() {
+    return &default_gb;
+}
+
+
+void gb_instance_reset(GameBoy* gb) {
+    cpu_init(&gb->cpu);
+    mmu_init(&gb->mmu);
+    scheduler_init(&gb->sched);
+    ppu_init(&gb->ppu, gb->framebuffer, &gb->sched, &gb->mmu);
+    joypad_init(&gb->joypad);
+    serial_init(&gb->serial, &gb->mmu, &gb->sched);
+    timer_init(&gb->timer, &gb->sched, &gb->mmu);
+    apu_init(&gb->apu, &gb->sched);
+    gb->instructions = 0;
+#ifdef GB_STATS
+    memset(&gb->stats, 0, sizeof(GbStats));
+#endif
+
+    cpu_connect_mmu(&gb->cpu, &gb->mmu);
+    mmu_connect(&gb->mmu, gb);
+}
+
+
+void gb_init() {
+    default_gb.serial.mirror_stdout = true;
+    default_gb.log_stdout = true;
+    gb_instance_reset(&default_gb);
+}
+
+
+void gb_reset() {
+    gb_init();
+}
+
+
 static const uint16_t interrupt_vector[5] = {
         0x40, // VBlank
         0x48, // LCD STAT
@@ -56,27 +176,31 @@ static const uint16_t interrupt_vector[5] = {
 };
 
 
-void check_interrupts() {
-    uint8_t ie = mmu_read8(&mmu, 0xFFFF);   // Interrupt Enable
-    uint8_t if_ = mmu_read8(&mmu, 0xFF0F);  // Interrupt Flag
+static void check_interrupts(GameBoy* gb) {
+    CPU* cpu = &gb->cpu;
+    MMU* mmu = &gb->mmu;
+
+    // Напрямую, не через шину: опрос не должен попадать в статистику доступа
+    uint8_t ie = mmu->ie;          // Interrupt Enable
+    uint8_t if_ = mmu->io[0x0F];   // Interrupt Flag
 
     uint8_t fired = ie & if_ & 0x1F;
     if (fired == 0) return;
 
-    if (!cpu.ime) {
-        if (cpu.halted) cpu.halted = 0; // выход из HALT даже если IME = 0
+    if (!cpu->ime) {
+        if (cpu->halted) cpu->halted = 0; // выход из HALT даже если IME = 0
         return;
     }
 
     for (int i = 0; i < 5; i++) {
         if (fired & (1 << i)) {
-            cpu.ime = 0;
-            mmu_write8(&mmu, 0xFF0F, if_ & ~(1 << i));
+            cpu->ime = 0;
+            mmu->io[0x0F] = if_ & ~(1 << i);
 
-            cpu.sp -= 2;
-            mmu_write8(&mmu,cpu.sp, cpu.pc & 0xFF);
-            mmu_write8(&mmu, cpu.sp + 1, cpu.pc >> 8);
-            cpu.pc = interrupt_vector[i];
+            mmu_write8(mmu, --cpu->sp, cpu->pc >> 8);
+            mmu_write8(mmu, --cpu->sp, cpu->pc & 0xFF);
+            if (cpu->profile) profile_call(cpu->profile, interrupt_vector[i], cpu->pc);
+            cpu->pc = interrupt_vector[i];
 
             return;
         }
@@ -84,33 +208,396 @@ void check_interrupts() {
 }
 
 
-void gb_step_frame() {
+static uint64_t gb_next_input(GameBoy* gb) {
+    if (gb->hidden) return EVENT_NEVER; // ввод удерживается, очередь не трогаем
+    if (gb->movie && gb->movie->mode == MOVIE_PLAYING) return movie_next_input(gb->movie);
+    return joypad_next_event(&gb->joypad);
+}
+
+
+// Returns true if the joypad interrupt should be raised
+static bool gb_apply_input(GameBoy* gb) {
+    if (gb->movie && gb->movie->mode == MOVIE_PLAYING)
+        return movie_apply_inputs(gb->movie, gb->sched.now);
+
+    bool raise = joypad_apply_events(&gb->joypad, gb->sched.now);
+    if (gb->movie) movie_input_applied(gb->movie, gb->joypad.pressed);
+    return raise;
+}
+
+
+static void gb_dispatch_events(GameBoy* gb) {
+    uint64_t when;
+    int type;
+
+    while ((type = scheduler_pop(&gb->sched, &when)) >= 0) {
+        switch (type) {
+            case EVENT_JOYPAD:
+                if (gb_apply_input(gb))
+                    mmu_request_interrupt(&gb->mmu, INT_JOYPAD);
+                scheduler_set(&gb->sched, EVENT_JOYPAD, gb_next_input(gb));
+                break;
+            case EVENT_SERIAL:
+                serial_complete(&gb->serial);
+                break;
+            case EVENT_TIMER:
+                timer_event(&gb->timer, when);
+                break;
+            case EVENT_PPU:
+                if (ppu_event(&gb->ppu, when)) {
+                    gb->frame_vblank = true;
+                    gb->run_target = gb->sched.now;
+                }
+                break;
+        }
+    }
+}
+
+
+static inline void gb_advance(GameBoy* gb, int cycles) {
+    gb->sched.now += cycles;
+
+    if (gb->sched.now >= gb->sched.next)
+        gb_dispatch_events(gb);
+}
+
+
+void gb_tick(GameBoy* gb, int cycles) {
+    gb_advance(gb, cycles);
+}
+
 
-    int cycles = 0;
+// Specialized per CPU mode by gb_run_until, so the choice costs nothing
+// per instruction
+static inline void gb_run_loop(GameBoy* gb, bool timed) {
+    Scheduler* sched = &gb->sched;
 
-    while (cycles < 70224 ) {  // 70224 ticks (1 frame at 60Hz)
-        int step = cpu_step(&cpu);
-        cycles += step;
-        ppu_step(&ppu, &mmu, step);
-        check_serial_output();
+    while (sched->now < gb->run_target) {
+        if (gb->trace && !gb->hidden) trace_record(gb->trace, gb);
 
-        if (cpu.ime_pending) {
-            cpu.ime = 1;
-            cpu.ime_pending = 0;
+        // После загрузки состояния now может оказаться меньше last
+        Profiler* profile = gb->cpu.profile;
+        if (profile && sched->now - profile->last >= profile->interval)
+            profile_sample(profile, gb->cpu.pc, sched->now);
+
+        gb_advance(gb, timed ? cpu_step_timed(&gb->cpu) : cpu_step(&gb->cpu));
+        gb->instructions++;
+
+        if (gb->cpu.ime_pending) {
+            gb->cpu.ime = 1;
+            gb->cpu.ime_pending = 0;
         }
 
-        check_interrupts();
+        check_interrupts(gb);
+    }
+}
+
+
+// Returns at `target`, or earlier once the PPU enters VBlank
+static void gb_run_until(GameBoy* gb, uint64_t target) {
+    // Другой поток мог добавить нажатия с прошлого вызова
+    scheduler_set(&gb->sched, EVENT_JOYPAD, gb_next_input(gb));
+
+    gb->run_target = target;
+    if (gb->timed)
+        gb_run_loop(gb, true);
+    else
+        gb_run_loop(gb, false);
+}
+
+
+// A host frame is one PPU frame and ends as the PPU enters VBlank, so it is
+// never the bottom of one picture over the top of the next. With the LCD off
+// it lasts CYCLES_PER_FRAME; an LCD turned on during that time carries the
+// frame on to its first VBlank, at most one more frame later.
+static void gb_begin_frame(GameBoy* gb, bool render) {
+    gb->ppu.render = render && !gb->video_off;
+    gb->frame_start = gb->sched.now;
+    gb->frame_vblank = false;
+}
+
+
+// Where to run to next in the current frame, 0 once it is over
+static uint64_t gb_frame_limit(GameBoy* gb) {
+    uint64_t lcd_off_end = gb->frame_start + CYCLES_PER_FRAME;
+    if (gb->frame_vblank) return 0;
+    if (gb->sched.now < lcd_off_end) return lcd_off_end;
+    if (!ppu_lcd_on(&gb->ppu) || gb->sched.now >= lcd_off_end + CYCLES_PER_FRAME) return 0;
+    return lcd_off_end + CYCLES_PER_FRAME;
+}
+
+
+static void gb_end_frame(GameBoy* gb) {
+    ppu_finish_frame(&gb->ppu);
+    apu_end_frame(&gb->apu);
+    serial_flush_mirror(&gb->serial);
+    if (gb->movie && !gb->hidden) movie_end_frame(gb->movie);
+}
+
+
+// Lines are drawn as the PPU reaches them, so whether a frame is shown has
+// to be known before it is emulated
+static void gb_run_frame(GameBoy* gb, bool render) {
+    gb_begin_frame(gb, render);
+    uint64_t limit;
+    while ((limit = gb_frame_limit(gb)) != 0) {
+        gb_run_until(gb, limit);
+    }
+    gb_end_frame(gb);
+}
+
+
+static void gb_set_hidden(GameBoy* gb, bool hidden) {
+    gb->hidden = hidden;
+    gb->serial.muted = hidden;
+    gb->cpu.profile = hidden ? NULL : gb->profile;
+    if (hidden)
+        apu_suspend_output(&gb->apu);
+    else
+        apu_resume_output(&gb->apu);
+}
+
+
+static void gb_run_ahead_frame(GameBoy* gb) {
+    size_t size = gb_state_size(gb);
+    if (gb->run_ahead_state == NULL) gb->run_ahead_state = malloc(size);
+    if (gb->run_ahead_state == NULL) {
+        // Без памяти под состояние — обычный кадр
+        gb_run_frame(gb, true);
+        return;
+    }
+
+    double start = host_seconds();
+    gb_run_frame(gb, false);
+    double real = host_seconds();
+
+    gb_save_state(gb, gb->run_ahead_state, size);
+    gb_set_hidden(gb, true);
+    for (int i = 0; i < gb->run_ahead; i++) {
+        gb_run_frame(gb, i == gb->run_ahead - 1);
+    }
+    gb_load_state(gb, gb->run_ahead_state, size);
+    gb_set_hidden(gb, false);
+
+    gb->run_ahead_frames++;
+    gb->run_ahead_frame_seconds += real - start;
+    gb->run_ahead_extra_seconds += host_seconds() - real;
+}
+
+
+// The frame the host gets to see, after any run-ahead
+static void gb_present(GameBoy* gb) {
+    ppu_take_dirty(&gb->ppu, gb->frame_dirty);
+    if (gb->shm) shm_publish(gb->shm, gb_instance_framebuffer(gb), gb->sched.now);
+    if (gb->recorder) recorder_push(gb->recorder, gb_instance_framebuffer(gb));
+}
+
+
+void gb_instance_step_frame(GameBoy* gb) {
+    if (gb->run_ahead > 0 && gb->movie == NULL && gb->serial.peer == NULL)
+        gb_run_ahead_frame(gb);
+    else
+        gb_run_frame(gb, true);
+    gb_present(gb);
+}
+
+
+void gb_step_frame() {
+    gb_instance_step_frame(&default_gb);
+}
+
+
+uint32_t* gb_instance_framebuffer(GameBoy* gb) {
+    return &gb->framebuffer[0][0];
+}
+
+
+bool gb_frame_dirty_mask(GameBoy* gb, uint32_t* mask) {
+    bool any = false;
+    for (int i = 0; i < PPU_DIRTY_WORDS; i++) {
+        if (mask) mask[i] = gb->frame_dirty[i];
+        any |= gb->frame_dirty[i] != 0;
     }
+    return any;
+}
+
 
-    ppu_render_frame(&ppu, &mmu);
+static bool row_dirty(const GameBoy* gb, int y) {
+    return gb->frame_dirty[y / 32] >> (y % 32) & 1;
+}
+
+
+int gb_frame_dirty_ranges(GameBoy* gb, DirtyRange* ranges, int max) {
+    int count = 0;
+    for (int y = 0; y < SCREEN_HEIGHT && max > 0; y++) {
+        if (!row_dirty(gb, y)) continue;
+
+        int first = y;
+        while (y + 1 < SCREEN_HEIGHT && row_dirty(gb, y + 1)) y++;
+        if (count == max) {
+            // Out of room: the last range grows to cover the rest
+            ranges[count - 1].count = y + 1 - ranges[count - 1].first;
+        } else {
+            ranges[count].first = first;
+            ranges[count].count = y + 1 - first;
+            count++;
+        }
+    }
+    return count;
 }
 
 
 uint32_t* gb_get_framebuffer() {
-    return &ppu.framebuffer[0][0];
+    return gb_instance_framebuffer(&default_gb);
+}
+
+
+bool gb_instance_load_rom(GameBoy* gb, const uint8_t* data, int size) {
+    return mmu_load_rom(&gb->mmu, data, size);
+}
+
+
+bool gb_load_rom(const uint8_t* data, int size) {
+    return gb_instance_load_rom(&default_gb, data, size);
+}
+
+
+uint64_t gb_get_cycles(GameBoy* gb) {
+    return gb->sched.now;
+}
+
+
+uint64_t gb_get_instructions(GameBoy* gb) {
+    return gb->instructions;
+}
+
+
+void gb_set_video_enabled(GameBoy* gb, bool enabled) {
+    gb->video_off = !enabled;
+}
+
+
+bool gb_set_render_thread(GameBoy* gb, bool enabled) {
+    if (!enabled) {
+        ppu_pipeline_stop(&gb->ppu);
+        return true;
+    }
+    return ppu_pipeline_start(&gb->ppu);
+}
+
+
+void gb_set_cycle_accurate(GameBoy* gb, bool enabled) {
+    gb->timed = enabled;
+}
+
+
+bool gb_joypad_event(GameBoy* gb, JoypadButton button, bool pressed, uint64_t cycle) {
+    return joypad_push(&gb->joypad, button, pressed, cycle);
+}
+
+
+bool gb_set_button(GameBoy* gb, JoypadButton button, bool pressed) {
+    return joypad_push(&gb->joypad, button, pressed, 0);
+}
+
+
+size_t gb_serial_read(GameBoy* gb, uint8_t* out, size_t max) {
+    return serial_drain(&gb->serial, out, max);
+}
+
+
+void gb_set_log(GameBoy* gb, bool enabled) {
+    gb->log_stdout = enabled;
+}
+
+
+void gb_serial_set_mirror(GameBoy* gb, bool enabled) {
+    if (!enabled) serial_flush_mirror(&gb->serial);
+    gb->serial.mirror_stdout = enabled;
+}
+
+
+size_t gb_audio_read(GameBoy* gb, int16_t* out, size_t frames) {
+    return apu_drain(&gb->apu, out, frames);
+}
+
+
+void gb_audio_set_sample_rate(GameBoy* gb, int rate) {
+    apu_set_sample_rate(&gb->apu, rate);
+}
+
+
+void gb_audio_set_enabled(GameBoy* gb, bool enabled) {
+    apu_set_synth(&gb->apu, enabled);
+}
+
+
+void gb_set_run_ahead(GameBoy* gb, int frames) {
+    gb->run_ahead = frames > 0 ? frames : 0;
+    gb->run_ahead_frames = 0;
+    gb->run_ahead_frame_seconds = 0;
+    gb->run_ahead_extra_seconds = 0;
+}
+
+
+void gb_run_ahead_stats(GameBoy* gb, RunAheadStats* stats) {
+    uint32_t n = gb->run_ahead_frames;
+    stats->frames = n;
+    stats->ahead = gb->run_ahead;
+    stats->frame_us = n ? gb->run_ahead_frame_seconds * 1e6 / n : 0;
+    stats->extra_us = n ? gb->run_ahead_extra_seconds * 1e6 / n : 0;
+    stats->latency_saved_ms = gb->run_ahead * CYCLES_PER_FRAME * 1000.0 / 4194304;
+}
+
+
+#ifdef GB_STATS
+const GbStats* gb_get_stats(GameBoy* gb) {
+    return &gb->stats;
+}
+
+
+void gb_stats_reset(GameBoy* gb) {
+    memset(&gb->stats, 0, sizeof(GbStats));
+}
+
+
+void gb_stats_report(GameBoy* gb, FILE* out, int top) {
+    stats_report(&gb->stats, out, top);
 }
+#endif
 
 
-void gb_load_rom(const uint8_t* data, int size) {
-    mmu_load_rom(&mmu, data, size);
-}
\ No newline at end of file
+void gb_link_connect(GameBoy* a, GameBoy* b) {
+    serial_link(&a->serial, &b->serial);
+}
+
+
+void gb_link_disconnect(GameBoy* gb) {
+    serial_unlink(&gb->serial);
+}
+
+
+// Both machines advance one scanline at a time, so a transfer started by one
+// side is seen by the other at most one line of emulated time later. The
+// frame ends at `a`'s VBlank and `b` runs exactly as long: two consoles whose
+// LCDs were turned on at different moments are not in phase, so `b`'s frame
+// is only whole while they are.
+void gb_link_step_frame(GameBoy* a, GameBoy* b) {
+    gb_begin_frame(a, true);
+    gb_begin_frame(b, true);
+
+    uint64_t a_limit;
+    while ((a_limit = gb_frame_limit(a)) != 0 || b->sched.now - b->frame_start < a->sched.now - a->frame_start) {
+        if (a_limit) {
+            uint64_t a_next = a->sched.now + CYCLES_PER_LINE;
+            gb_run_until(a, a_next < a_limit ? a_next : a_limit);
+        }
+        // Its own VBlank only ends a run_until early
+        gb_run_until(b, b->frame_start + (a->sched.now - a->frame_start));
+    }
+
+    gb_end_frame(a);
+    gb_end_frame(b);
+    gb_present(a);
+    gb_present(b);
+}
@@ -2,11 +2,375 @@
 #define GB_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "joypad.h"
 
+typedef struct GameBoy GameBoy;
+
+// Legacy single-instance API, operates on gb_default()
 void gb_init();
 void gb_step_frame();
 uint32_t* gb_get_framebuffer();
-void gb_load_rom(const uint8_t* data, int size);
+bool gb_load_rom(const uint8_t* data, int size);
 void gb_reset();
 
-#endif
\ No newline at end of file
+// Instances
+GameBoy* gb_create();
+void gb_destroy(GameBoy* gb);
+GameBoy* gb_default();
+void gb_instance_reset(GameBoy* gb);
+// False if the ROM could not be mapped; the previous one stays loaded
+bool gb_instance_load_rom(GameBoy* gb, const uint8_t* data, int size);
+// Print the ROM header on load and bus warnings to stdout (on by default for
+// gb_default() only)
+void gb_set_log(GameBoy* gb, bool enabled);
+void gb_instance_step_frame(GameBoy* gb);
+uint32_t* gb_instance_framebuffer(GameBoy* gb);
+
+// Framebuffer rows whose pixels changed during the last
+// gb_instance_step_frame, so that uploads can be skipped or shrunk. Rows
+// changed and changed back by hidden run-ahead frames may be included too.
+// The mask has one bit per row, row y at bit y % 32 of word y / 32, 5 words;
+// it may be NULL. False: the frame is identical to the previous one.
+bool gb_frame_dirty_mask(GameBoy* gb, uint32_t* mask);
+
+typedef struct {
+    int first;
+    int count;
+} DirtyRange;
+
+// Runs of changed rows, top to bottom; 0 if nothing changed. With more than
+// `max` runs the last one is extended to the bottom-most changed row.
+int gb_frame_dirty_ranges(GameBoy* gb, DirtyRange* ranges, int max);
+
+uint64_t gb_get_cycles(GameBoy* gb);
+uint64_t gb_get_instructions(GameBoy* gb);
+
+// Headless: frames end without drawing, the framebuffer keeps its contents
+void gb_set_video_enabled(GameBoy* gb, bool enabled);
+
+// Display output stages: read a `width` x `height` RGBA image (e.g.
+// gb_instance_framebuffer, 160x144) and write the result into `dst`, which
+// must hold width * height * factor^2 pixels. Vectorized; widths up to 1024,
+// factors up to 6. False on bad arguments.
+bool gb_scale_nearest(const uint32_t* src, int width, int height, int factor, uint32_t* dst);
+// Scale2x / Scale3x (AdvMAME) edge-preserving pixel art scalers
+bool gb_scale2x(const uint32_t* src, int width, int height, uint32_t* dst);
+bool gb_scale3x(const uint32_t* src, int width, int height, uint32_t* dst);
+// LCD look: blends `src` into `history` (the panel's previous output, start
+// it with a copy of the first frame) keeping `ghosting`/256 of the old image,
+// then scales by `factor` with the last row and column of every cell darkened
+// by `grid`/256.
+bool gb_lcd_filter(const uint32_t* src, uint32_t* history, int width, int height,
+                   int factor, int ghosting, int grid, uint32_t* dst);
+
+// Shared-memory export: every presented frame and all synthesized audio are
+// published to the POSIX shared-memory object `name` (e.g. "/gameboy", i.e.
+// /dev/shm/gameboy on Linux) for readers in other processes; the layout and
+// the reading protocol are in shm_export.h, tools/shm_reader.c is an example.
+// Does not consume gb_audio_read's stream. NULL where POSIX shm is missing.
+typedef struct ShmExport ShmExport;
+
+ShmExport* gb_shm_export(GameBoy* gb, const char* name);
+// Marks the segment closed, wakes readers and unlinks it
+void gb_shm_close(ShmExport* ex);
+
+// Lossless recording of every presented frame to `path`. The emulation thread
+// only copies the framebuffer into a queue; a worker thread palette-indexes
+// it, XORs it against the previous frame and RLE-compresses it, with a
+// keyframe every `keyframe_interval` frames (600 if <= 0). If the worker falls
+// behind, the emulation thread waits for it (counted in `stalls`) instead of
+// dropping frames. tools/rec2png.c converts recordings to PNG sequences.
+typedef struct Recorder Recorder;
+
+typedef struct {
+    uint64_t frames;         // encoded and written
+    uint64_t bytes;          // file size so far
+    double bytes_per_minute; // at 60 fps
+    double encode_us_per_frame;
+    uint32_t pending;        // queued, not yet encoded
+    uint32_t stalls;
+} RecorderStats;
+
+Recorder* gb_recorder_start(GameBoy* gb, const char* path, int keyframe_interval);
+// Encodes what is still queued, then closes the file; fills `stats` if not
+// NULL. False if anything failed to write.
+bool gb_recorder_stop(Recorder* rec, RecorderStats* stats);
+void gb_recorder_stats(Recorder* rec, RecorderStats* stats);
+
+// Draw scanlines on a second thread, one or more lines behind the emulated
+// PPU, from logged registers and VRAM writes. Frames are identical to drawing
+// in place; gb_instance_step_frame returns once the frame is complete. False
+// if the thread could not be started. Switch between frames only.
+bool gb_set_render_thread(GameBoy* gb, bool enabled);
+
+// M-cycle accurate CPU: every memory access of an instruction happens at its
+// own M-cycle, with timers, PPU and scheduled events advanced up to it first,
+// instead of all at once before the instruction's cycles are counted. Slower;
+// off by default. Can be switched between frames. The mode is saved in save
+// states, so loading one (rewind, movie playback) also restores it.
+void gb_set_cycle_accurate(GameBoy* gb, bool enabled);
+
+// Copy of `gb` that shares its memory pages copy-on-write: a page is only
+// duplicated when one side writes to it. Pending joypad events, captured
+// serial bytes and unread audio are not inherited; neither are movies, run-ahead
+// buffers or link cables. Free with gb_destroy, in any order. NULL if out of
+// memory; a page copy that later fails drops the write and sets
+// MemoryStats.out_of_memory.
+GameBoy* gb_fork(GameBoy* gb);
+
+typedef struct {
+    size_t instance_bytes;   // the GameBoy struct itself
+    size_t page_size;
+    uint32_t pages;          // 0000-DFFF
+    uint32_t private_pages;  // written since the last fork, not shared
+    bool out_of_memory;      // a page could not be copied; writes to it were lost
+} MemoryStats;
+
+void gb_memory_stats(GameBoy* gb, MemoryStats* stats);
+
+// ROM images are shared: instances that load identical data map the same
+// read-only pages, kept in a process-wide registry keyed by content hash
+// until the last instance using them is reset or destroyed.
+typedef struct {
+    uint32_t images;         // distinct ROMs loaded
+    uint32_t users;          // instances mapping them, forks included
+    size_t bytes;            // pages held, all-zero ones are not stored
+} RomCacheStats;
+
+void gb_rom_cache_stats(RomCacheStats* stats);
+
+// Cartridge header fields (0100-014F)
+typedef struct {
+    char title[17];          // printable ASCII, trailing spaces removed
+    uint8_t cgb_flag;        // 0143: 0x80 CGB enhanced, 0xC0 CGB only
+    uint8_t sgb_flag;        // 0146: 0x03 SGB functions
+    uint8_t cart_type;       // 0147: MBC and extras
+    uint8_t rom_size;        // 0148: 32 KB << n
+    uint8_t ram_size;        // 0149: code, 0 none ... 5 64 KB
+    uint8_t version;         // 014C
+    uint8_t header_checksum; // 014D
+    bool header_ok;          // 014D matches 0134-014C
+    uint16_t global_checksum; // 014E-014F, big endian in the file
+} RomHeader;
+
+// ROM library: recursive scans of directories for .gb/.gbc/.sgb files, kept
+// in an on-disk index. Opening a library is a single read of the index;
+// gb_library_scan only maps and parses files that are new or whose size or
+// mtime changed, on `threads` threads (0: one per online CPU), then rewrites
+// the index. Entries outside the scanned directory are kept as they are.
+typedef struct RomLibrary RomLibrary;
+
+typedef struct {
+    const char* path;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;           // FNV-1a 64 of the file, as the ROM registry uses
+    bool global_ok;          // 014E-014F matches the sum of the other bytes
+    RomHeader header;
+} RomInfo;
+
+typedef struct {
+    uint32_t files;          // ROMs under the directory
+    uint32_t scanned;        // parsed and hashed this time
+    uint32_t reused;         // unchanged since the index was written
+    uint32_t removed;        // gone from the directory
+    uint32_t failed;         // unreadable or too short for a header
+    uint32_t skipped_dirs;   // subdirectories that could not be opened
+    uint64_t bytes_hashed;
+    double seconds;
+} LibraryScanStats;
+
+// Missing or unreadable index: an empty library that saves to `index_path`
+RomLibrary* gb_library_open(const char* index_path);
+bool gb_library_scan(RomLibrary* lib, const char* dir, int threads, LibraryScanStats* stats);
+size_t gb_library_count(RomLibrary* lib);
+// Sorted by path; valid until the next scan
+const RomInfo* gb_library_get(RomLibrary* lib, size_t index);
+void gb_library_close(RomLibrary* lib);
+
+// Vectorized environments for reinforcement learning: `count` instances of one
+// ROM, forked from a template booted for `warmup_frames`, stepped in lockstep
+// on a thread pool. Actions are one joypad mask per instance (bit n is
+// JoypadButton n). Outputs are structure-of-arrays, instance after instance:
+//   out_obs   count * width * height shades 0 (white) - 3 (black), every
+//             `obs_scale`-th pixel each way
+//   out_ram   count * ram_count bytes read from `ram_addrs`
+//   out_done  count flags
+// Each may be NULL. An episode ends after `max_steps` steps or when the byte
+// at `done_addr` matches; the instance is then reset to the start state and
+// reports done along with the first observation of the new episode.
+typedef struct VecEnv VecEnv;
+
+typedef struct {
+    int count;
+    int threads;             // including the caller; 0: one per online CPU
+    int frame_skip;          // frames per step, 1 if <= 0; only the last is drawn
+    int obs_scale;           // 1 if <= 0
+    const uint16_t* ram_addrs;
+    int ram_count;
+    int warmup_frames;
+    uint32_t max_steps;      // 0: no limit
+    uint16_t done_addr;      // done when (byte & done_mask) == done_value
+    uint8_t done_mask;       // 0: no RAM condition
+    uint8_t done_value;
+} VecEnvConfig;
+
+VecEnv* gb_vec_create(const uint8_t* rom, int size, const VecEnvConfig* config);
+void gb_vec_destroy(VecEnv* env);
+void gb_vec_shape(VecEnv* env, int* width, int* height);
+// Resets every instance and writes its observations
+void gb_vec_reset(VecEnv* env, uint8_t* out_obs, uint8_t* out_ram);
+void gb_vec_step(VecEnv* env, const uint8_t* actions, uint8_t* out_obs, uint8_t* out_ram, uint8_t* out_done);
+// The instance, e.g. for save states; not while gb_vec_step runs
+GameBoy* gb_vec_instance(VecEnv* env, int index);
+
+// Queues a button change to take effect at emulated cycle `cycle`
+// (see gb_get_cycles). Safe to call from a thread other than the emulator's.
+bool gb_joypad_event(GameBoy* gb, JoypadButton button, bool pressed, uint64_t cycle);
+// Same, taking effect at the start of the next frame.
+bool gb_set_button(GameBoy* gb, JoypadButton button, bool pressed);
+
+// Serial: bytes sent by the game, in order. Safe to call from another thread.
+size_t gb_serial_read(GameBoy* gb, uint8_t* out, size_t max);
+// Echo sent bytes to stdout, flushed once per frame (on by default for gb_default())
+void gb_serial_set_mirror(GameBoy* gb, bool enabled);
+
+// Audio: interleaved int16 stereo at the host rate (48 kHz by default),
+// produced at frame end. Safe to call from an audio thread.
+size_t gb_audio_read(GameBoy* gb, int16_t* out, size_t frames);
+void gb_audio_set_sample_rate(GameBoy* gb, int rate);
+// Disabling skips synthesis; sound registers keep working
+void gb_audio_set_enabled(GameBoy* gb, bool enabled);
+
+// Save states: a versioned binary snapshot of the whole machine (not the ROM,
+// not host-side queues). gb_save_state returns the bytes written, 0 if `cap`
+// is smaller than gb_state_size. Loading rejects blobs from another ROM or
+// another layout version, and returns false if memory ran out part way
+// through (the machine is then only partly restored).
+size_t gb_state_size(GameBoy* gb);
+size_t gb_save_state(GameBoy* gb, uint8_t* buf, size_t cap);
+bool gb_load_state(GameBoy* gb, const uint8_t* buf, size_t size);
+
+// Rewind: call gb_rewind_push once per frame; compression runs on a worker
+// thread. Keeps as many frames as fit in `budget` bytes, a keyframe every
+// `keyframe_interval` frames. gb_rewind_step goes back `frames` frames from
+// the last pushed one (at most what is stored) and returns how many it went
+// back, 0 if none.
+typedef struct Rewind Rewind;
+
+typedef struct {
+    uint32_t frames;
+    uint64_t bytes;
+    double seconds;
+    double bytes_per_minute;
+    double compress_us_per_frame;
+    uint32_t dropped;        // pushes skipped because the worker fell behind
+} RewindStats;
+
+Rewind* gb_rewind_create(GameBoy* gb, size_t budget, int keyframe_interval);
+void gb_rewind_destroy(Rewind* rw);
+bool gb_rewind_push(Rewind* rw);
+int gb_rewind_step(Rewind* rw, int frames);
+void gb_rewind_stats(Rewind* rw, RewindStats* stats);
+
+// Input movies: the starting state plus every joypad change at the exact cycle
+// it took effect, with a compressed save state every `keyframe_interval`
+// frames (600 if <= 0). Recording and playback hook into the attached
+// instance's frame loop; while playing, input from gb_joypad_event is ignored.
+// All calls belong on the emulation thread.
+typedef struct Movie Movie;
+
+Movie* gb_movie_record(GameBoy* gb, int keyframe_interval);
+// Ends recording (stores the framebuffer hash) or playback
+void gb_movie_stop(Movie* movie);
+void gb_movie_destroy(Movie* movie);
+
+// Serialized movie; only once recording is stopped
+size_t gb_movie_size(Movie* movie);
+size_t gb_movie_write(Movie* movie, uint8_t* buf, size_t cap);
+Movie* gb_movie_open(const uint8_t* buf, size_t size);
+
+// Fails if `gb` has another ROM loaded. Starts at frame 0.
+bool gb_movie_play(Movie* movie, GameBoy* gb);
+// Loads the nearest keyframe at or before `frame` and emulates the rest
+bool gb_movie_seek(Movie* movie, uint32_t frame);
+uint32_t gb_movie_frame(Movie* movie);
+uint32_t gb_movie_length(Movie* movie);
+// At the last frame: the framebuffer matches the one recorded
+bool gb_movie_verify(Movie* movie);
+
+// Run-ahead: each frame emulates the real frame without drawing it, saves
+// state, emulates `frames` more with the input held (only the last one is
+// drawn), presents that and restores the state. Hides up to `frames` frames of
+// the game's own input lag at roughly (frames + 1)x the CPU cost. Audio and
+// serial output come from the real frames only. Ignored while a movie or a
+// link cable is attached. 0 turns it off.
+typedef struct {
+    uint32_t frames;
+    int ahead;
+    double frame_us;         // real frame
+    double extra_us;         // save, hidden frames and restore
+    double latency_saved_ms;
+} RunAheadStats;
+
+void gb_set_run_ahead(GameBoy* gb, int frames);
+void gb_run_ahead_stats(GameBoy* gb, RunAheadStats* stats);
+
+// Execution trace: one record per instruction, taken before it executes.
+// With `path` NULL the newest `records` are kept in memory for gb_trace_read;
+// otherwise every record is streamed to `path` by a writer thread, and the
+// emulator waits whenever that thread falls behind. tools/trace_log (make
+// trace_decode) turns a file into Gameboy Doctor logs. Speculative run-ahead
+// frames are not traced. One trace per instance; start and stop on the
+// emulation thread.
+typedef struct Trace Trace;
+
+typedef struct {
+    uint64_t cycle;
+    uint16_t af, bc, de, hl, sp, pc;
+    uint8_t mem[4];          // bytes at pc
+} TraceRecord;
+
+Trace* gb_trace_start(GameBoy* gb, const char* path, uint32_t records);
+// Detaches and frees the trace; false if writing the file failed
+bool gb_trace_stop(Trace* trace);
+uint64_t gb_trace_count(Trace* trace);
+// Ring mode: the newest `max` records kept, oldest first
+size_t gb_trace_read(Trace* trace, TraceRecord* out, size_t max);
+
+// Guest profiler: samples PC (and ROM bank) every `interval` emulated cycles
+// (1024 if 0) along with a shadow call stack kept on CALL, RET and interrupt
+// entry. Symbols come from RGBDS or WLA DX .sym files; unknown addresses print
+// as BB:AAAA. Speculative run-ahead frames are not sampled. One profiler per
+// instance, on the emulation thread.
+typedef struct Profiler Profiler;
+
+Profiler* gb_profile_start(GameBoy* gb, uint32_t interval);
+// Detaches and frees the profiler
+void gb_profile_stop(Profiler* profiler);
+bool gb_profile_load_symbols(Profiler* profiler, const char* path);
+uint64_t gb_profile_samples(Profiler* profiler);
+// Symbols by share of samples, self and including callees
+void gb_profile_report(Profiler* profiler, FILE* out, int top);
+// Folded stacks for flamegraph.pl / speedscope
+void gb_profile_write_folded(Profiler* profiler, FILE* out);
+
+#ifdef GB_STATS
+// Instrumentation build only (see stats.h)
+#include "stats.h"
+
+const GbStats* gb_get_stats(GameBoy* gb);
+void gb_stats_reset(GameBoy* gb);
+void gb_stats_report(GameBoy* gb, FILE* out, int top);
+#endif
+
+// Link cable between two instances of this process. Linked instances must be
+// stepped together with gb_link_step_frame.
+void gb_link_connect(GameBoy* a, GameBoy* b);
+void gb_link_disconnect(GameBoy* gb);
+void gb_link_step_frame(GameBoy* a, GameBoy* b);
+
+#endif
@@ -0,0 +1,695 @@
+#include "apu.h"
+#include <string.h>
+
+#define REG(addr) apu->regs[(addr) - 0xFF10]
+
+#define NR10 0xFF10
+#define NR11 0xFF11
+#define NR12 0xFF12
+#define NR13 0xFF13
+#define NR14 0xFF14
+#define NR21 0xFF16
+#define NR22 0xFF17
+#define NR23 0xFF18
+#define NR24 0xFF19
+#define NR30 0xFF1A
+#define NR31 0xFF1B
+#define NR32 0xFF1C
+#define NR33 0xFF1D
+#define NR34 0xFF1E
+#define NR41 0xFF20
+#define NR42 0xFF21
+#define NR43 0xFF22
+#define NR44 0xFF23
+#define NR50 0xFF24
+#define NR51 0xFF25
+#define NR52 0xFF26
+
+#define FS_PERIOD    8192   // 512 Hz
+#define MAX_SPAN     65536  // cycles kept in the blip buffers before a flush
+#define AMP_SCALE    64     // 4 ch * 15 * 8 (NR50) * 64 = 30720
+
+// Windowed-sinc (Blackman, cutoff 0.9 Nyquist) impulse for each sub-sample
+// phase, every row summing to 1024 so a step settles to exactly delta * 1024.
+static const int16_t blip_kernel[BLIP_PHASES][BLIP_TAPS] = {
+        {    1,   -3,   11,  -26,   49,  -74,   95,  918,   95,  -74,   49,  -26,   11,   -3,    1,    0 },
+        {    1,   -3,   11,  -25,   44,  -63,   66,  919,  124,  -85,   53,  -28,   12,   -3,    1,    0 },
+        {    1,   -3,   10,  -23,   40,  -52,   39,  914,  155,  -95,   57,  -29,   12,   -3,    1,    0 },
+        {    1,   -3,   10,  -21,   35,  -42,   14,  909,  187, -106,   60,  -30,   12,   -3,    1,    0 },
+        {    0,   -3,    9,  -20,   31,  -31,  -10,  901,  220, -115,   64,  -31,   12,   -3,    0,    0 },
+        {    0,   -3,    9,  -18,   26,  -21,  -33,  892,  253, -125,   66,  -31,   12,   -3,    0,    0 },
+        {    0,   -3,    8,  -16,   21,  -11,  -54,  879,  288, -134,   69,  -32,   12,   -3,    0,    0 },
+        {    0,   -3,    7,  -14,   16,   -1,  -73,  865,  322, -142,   71,  -32,   11,   -3,    0,    0 },
+        {    0,   -2,    7,  -12,   12,    8,  -90,  843,  358, -149,   72,  -31,   11,   -3,    0,    0 },
+        {    0,   -2,    6,  -10,    7,   17, -106,  824,  393, -155,   73,  -31,   10,   -2,    0,    0 },
+        {    0,   -2,    5,   -8,    3,   25, -120,  802,  429, -161,   73,  -30,   10,   -2,    0,    0 },
+        {    0,   -2,    4,   -6,   -1,   33, -132,  778,  464, -165,   73,  -29,    9,   -2,    0,    0 },
+        {    0,   -2,    4,   -4,   -5,   40, -143,  752,  499, -168,   72,  -28,    8,   -1,    0,    0 },
+        {    0,   -1,    3,   -2,   -9,   46, -151,  724,  534, -170,   70,  -26,    7,   -1,    0,    0 },
+        {    0,   -1,    2,    0,  -13,   52, -159,  696,  568, -171,   68,  -24,    6,    0,    0,    0 },
+        {    0,   -1,    2,    1,  -16,   57, -164,  667,  601, -170,   65,  -21,    4,    0,   -1,    0 },
+        {    0,   -1,    1,    3,  -19,   62, -168,  634,  634, -168,   62,  -19,    3,    1,   -1,    0 },
+        {    0,   -1,    0,    4,  -21,   65, -170,  601,  667, -164,   57,  -16,    1,    2,   -1,    0 },
+        {    0,    0,    0,    6,  -24,   68, -171,  568,  696, -159,   52,  -13,    0,    2,   -1,    0 },
+        {    0,    0,   -1,    7,  -26,   70, -170,  534,  724, -151,   46,   -9,   -2,    3,   -1,    0 },
+        {    0,    0,   -1,    8,  -28,   72, -168,  499,  752, -143,   40,   -5,   -4,    4,   -2,    0 },
+        {    0,    0,   -2,    9,  -29,   73, -165,  464,  778, -132,   33,   -1,   -6,    4,   -2,    0 },
+        {    0,    0,   -2,   10,  -30,   73, -161,  429,  802, -120,   25,    3,   -8,    5,   -2,    0 },
+        {    0,    0,   -2,   10,  -31,   73, -155,  393,  824, -106,   17,    7,  -10,    6,   -2,    0 },
+        {    0,    0,   -3,   11,  -31,   72, -149,  358,  843,  -90,    8,   12,  -12,    7,   -2,    0 },
+        {    0,    0,   -3,   11,  -32,   71, -142,  322,  865,  -73,   -1,   16,  -14,    7,   -3,    0 },
+        {    0,    0,   -3,   12,  -32,   69, -134,  288,  879,  -54,  -11,   21,  -16,    8,   -3,    0 },
+        {    0,    0,   -3,   12,  -31,   66, -125,  253,  892,  -33,  -21,   26,  -18,    9,   -3,    0 },
+        {    0,    0,   -3,   12,  -31,   64, -115,  220,  901,  -10,  -31,   31,  -20,    9,   -3,    0 },
+        {    0,    1,   -3,   12,  -30,   60, -106,  187,  909,   14,  -42,   35,  -21,   10,   -3,    1 },
+        {    0,    1,   -3,   12,  -29,   57,  -95,  155,  914,   39,  -52,   40,  -23,   10,   -3,    1 },
+        {    0,    1,   -3,   12,  -28,   53,  -85,  124,  919,   66,  -63,   44,  -25,   11,   -3,    1 },
+};
+
+// Bits OR'ed into reads: write-only and unused bits read back as 1
+static const uint8_t read_mask[0x17] = {
+        0x80, 0x3F, 0x00, 0xFF, 0xBF, // NR10-NR14
+        0xFF, 0x3F, 0x00, 0xFF, 0xBF, // -, NR21-NR24
+        0x7F, 0xFF, 0x9F, 0xFF, 0xBF, // NR30-NR34
+        0xFF, 0xFF, 0x00, 0x00, 0xBF, // -, NR41-NR44
+        0x00, 0x00, 0x70              // NR50-NR52
+};
+
+static const uint8_t duty_table[4] = { 0x01, 0x81, 0x87, 0x7E };
+static const uint8_t noise_divisors[8] = { 8, 16, 32, 48, 64, 80, 96, 112 };
+
+
+// ---------------------------------------------------------------- blip
+
+static void blip_add(APU* apu, BlipBuffer* blip, uint64_t t, int delta) {
+    uint64_t fixed = (t - apu->blip_origin) * apu->ratio + apu->blip_frac;
+    uint32_t index = (uint32_t) (fixed >> 32);
+    const int16_t* kernel = blip_kernel[(fixed >> 27) & (BLIP_PHASES - 1)];
+    int32_t* out = &blip->buf[index];
+
+    for (int i = 0; i < BLIP_TAPS; i++) {
+        out[i] += kernel[i] * delta;
+    }
+}
+
+
+static void apu_set_amp(APU* apu, int ch, uint64_t t, int amp) {
+    int delta = amp - apu->ch[ch].amp;
+    if (delta == 0) return;
+    apu->ch[ch].amp = amp;
+
+    if (!apu->synth) return;
+    if (apu->weight_l[ch]) blip_add(apu, &apu->left, t, delta * apu->weight_l[ch]);
+    if (apu->weight_r[ch]) blip_add(apu, &apu->right, t, delta * apu->weight_r[ch]);
+}
+
+
+// Reads `count` finished samples out of a blip buffer into every other int16
+static void blip_read(BlipBuffer* blip, int16_t* out, uint32_t count) {
+    int32_t sum = blip->integrator;
+
+    for (uint32_t i = 0; i < count; i++) {
+        sum += blip->buf[i];
+        int32_t s = sum >> 10;
+        if (s > 32767) s = 32767;
+        if (s < -32768) s = -32768;
+        out[i * 2] = (int16_t) s;
+        sum -= sum >> 9; // убираем постоянную составляющую
+    }
+
+    blip->integrator = sum;
+    memmove(blip->buf, blip->buf + count, sizeof(int32_t) * (BLIP_SIZE + BLIP_TAPS - count));
+    memset(blip->buf + BLIP_SIZE + BLIP_TAPS - count, 0, sizeof(int32_t) * count);
+}
+
+
+// Everything before `t` is final: move it into the ring
+static void apu_flush(APU* apu, uint64_t t) {
+    uint64_t fixed = (t - apu->blip_origin) * apu->ratio + apu->blip_frac;
+    uint32_t count = (uint32_t) (fixed >> 32);
+
+    apu->blip_origin = t;
+    apu->blip_frac = (uint32_t) fixed;
+
+    if (count == 0) return;
+
+    int16_t frames[2 * 2048];
+    while (count > 0) {
+        uint32_t n = count > 2048 ? 2048 : count;
+        blip_read(&apu->left, frames, n);
+        blip_read(&apu->right, frames + 1, n);
+        count -= n;
+        if (apu->tap) apu->tap(apu->tap_ctx, frames, n);
+
+        uint32_t head = atomic_load_explicit(&apu->head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(&apu->tail, memory_order_acquire);
+        uint32_t space = APU_RING_FRAMES - (head - tail);
+        if (n > space) {
+            apu->overruns += n - space;
+            n = space;
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t slot = (head + i) & (APU_RING_FRAMES - 1);
+            apu->ring[slot * 2] = frames[i * 2];
+            apu->ring[slot * 2 + 1] = frames[i * 2 + 1];
+        }
+        atomic_store_explicit(&apu->head, head + n, memory_order_release);
+    }
+}
+
+
+// Re-weights every channel's current output after NR50/NR51 change
+static void apu_update_weights(APU* apu, uint64_t t) {
+    uint8_t nr50 = REG(NR50);
+    uint8_t nr51 = REG(NR51);
+    int vol_r = ((nr50 & 0x07) + 1) * AMP_SCALE;
+    int vol_l = (((nr50 >> 4) & 0x07) + 1) * AMP_SCALE;
+
+    for (int i = 0; i < 4; i++) {
+        int wl = (nr51 & (0x10 << i)) ? vol_l : 0;
+        int wr = (nr51 & (0x01 << i)) ? vol_r : 0;
+        int amp = apu->ch[i].amp;
+
+        if (apu->synth && amp) {
+            if (wl != apu->weight_l[i]) blip_add(apu, &apu->left, t, amp * (wl - apu->weight_l[i]));
+            if (wr != apu->weight_r[i]) blip_add(apu, &apu->right, t, amp * (wr - apu->weight_r[i]));
+        }
+        apu->weight_l[i] = wl;
+        apu->weight_r[i] = wr;
+    }
+}
+
+
+// ---------------------------------------------------------------- channels
+
+static int channel_output(APU* apu, int i) {
+    ApuChannel* ch = &apu->ch[i];
+    if (!ch->enabled || !ch->dac) return 0;
+
+    switch (i) {
+        case 0:
+        case 1: {
+            uint8_t duty = duty_table[apu->regs[i == 0 ? 0x01 : 0x06] >> 6];
+            return ((duty >> ch->pos) & 1) ? ch->volume : 0;
+        }
+        case 2: {
+            static const uint8_t shifts[4] = { 4, 0, 1, 2 };
+            uint8_t byte = apu->wave_ram[ch->pos >> 1];
+            uint8_t sample = (ch->pos & 1) ? (byte & 0x0F) : (byte >> 4);
+            return sample >> shifts[(REG(NR32) >> 5) & 0x03];
+        }
+        default:
+            return (apu->lfsr & 1) ? 0 : ch->volume;
+    }
+}
+
+
+static void channel_update(APU* apu, int i, uint64_t t) {
+    apu_set_amp(apu, i, t, channel_output(apu, i));
+}
+
+
+static uint32_t channel_period(APU* apu, int i) {
+    switch (i) {
+        case 0:
+        case 1: return (2048 - apu->ch[i].freq) * 4;
+        case 2: return (2048 - apu->ch[i].freq) * 2;
+        default: {
+            uint8_t nr43 = REG(NR43);
+            uint8_t shift = nr43 >> 4;
+            // shift 14/15: LFSR is not clocked
+            if (shift >= 14) return 0;
+            return (uint32_t) noise_divisors[nr43 & 0x07] << shift;
+        }
+    }
+}
+
+
+static void channel_advance(APU* apu, int i) {
+    ApuChannel* ch = &apu->ch[i];
+    if (i < 2) {
+        ch->pos = (ch->pos + 1) & 7;
+    } else if (i == 2) {
+        ch->pos = (ch->pos + 1) & 31;
+    } else {
+        uint16_t x = (apu->lfsr ^ (apu->lfsr >> 1)) & 1;
+        apu->lfsr = (apu->lfsr >> 1) | (x << 14);
+        if (REG(NR43) & 0x08) apu->lfsr = (apu->lfsr & ~0x40) | (x << 6);
+    }
+}
+
+
+// Runs the channel's frequency timer over [.., end)
+static void channel_run(APU* apu, int i, uint64_t end) {
+    ApuChannel* ch = &apu->ch[i];
+    if (ch->period == 0 || ch->next_step >= end) return;
+
+    if (!ch->enabled || !ch->dac) {
+        // Тишина: только сохраняем фазу таймера
+        uint64_t steps = (end - ch->next_step + ch->period - 1) / ch->period;
+        ch->next_step += steps * ch->period;
+        return;
+    }
+
+    while (ch->next_step < end) {
+        uint64_t t = ch->next_step;
+        channel_advance(apu, i);
+        channel_update(apu, i, t);
+        ch->period = channel_period(apu, i);
+        if (ch->period == 0) return;
+        ch->next_step = t + ch->period;
+    }
+}
+
+
+static void channel_disable(APU* apu, int i, uint64_t t) {
+    apu->ch[i].enabled = false;
+    channel_update(apu, i, t);
+}
+
+
+// ---------------------------------------------------------------- frame sequencer
+
+static uint16_t sweep_calc(APU* apu, uint64_t t) {
+    uint8_t nr10 = REG(NR10);
+    uint16_t delta = apu->sweep_shadow >> (nr10 & 0x07);
+    uint16_t freq;
+
+    if (nr10 & 0x08) {
+        freq = apu->sweep_shadow - delta;
+        apu->sweep_negated = true;
+    } else {
+        freq = apu->sweep_shadow + delta;
+    }
+
+    if (freq > 2047) channel_disable(apu, 0, t);
+    return freq;
+}
+
+
+static void clock_sweep(APU* apu, uint64_t t) {
+    uint8_t nr10 = REG(NR10);
+    uint8_t period = (nr10 >> 4) & 0x07;
+
+    if (--apu->sweep_timer > 0) return;
+    apu->sweep_timer = period ? period : 8;
+
+    if (!apu->sweep_enabled || period == 0) return;
+
+    uint16_t freq = sweep_calc(apu, t);
+    if (freq <= 2047 && (nr10 & 0x07)) {
+        apu->sweep_shadow = freq;
+        apu->ch[0].freq = freq;
+        REG(NR13) = freq & 0xFF;
+        REG(NR14) = (REG(NR14) & ~0x07) | (freq >> 8);
+        sweep_calc(apu, t);
+    }
+}
+
+
+static void clock_length(APU* apu, uint64_t t) {
+    for (int i = 0; i < 4; i++) {
+        ApuChannel* ch = &apu->ch[i];
+        if (ch->length_enable && ch->length > 0) {
+            if (--ch->length == 0) channel_disable(apu, i, t);
+        }
+    }
+}
+
+
+static void clock_envelope(APU* apu, uint64_t t) {
+    static const int env_channels[3] = { 0, 1, 3 };
+
+    for (int k = 0; k < 3; k++) {
+        int i = env_channels[k];
+        ApuChannel* ch = &apu->ch[i];
+        if (ch->env_period == 0) continue;
+
+        if (--ch->env_timer > 0) continue;
+        ch->env_timer = ch->env_period;
+
+        if (ch->env_up && ch->volume < 15) ch->volume++;
+        else if (!ch->env_up && ch->volume > 0) ch->volume--;
+        channel_update(apu, i, t);
+    }
+}
+
+
+static void frame_sequencer_step(APU* apu, uint64_t t) {
+    uint8_t step = apu->fs_step;
+
+    if ((step & 1) == 0) clock_length(apu, t);
+    if (step == 2 || step == 6) clock_sweep(apu, t);
+    if (step == 7) clock_envelope(apu, t);
+
+    apu->fs_step = (step + 1) & 7;
+}
+
+
+// Catches every channel and the frame sequencer up to `to`
+static void apu_sync(APU* apu, uint64_t to) {
+    while (apu->time < to) {
+        uint64_t end = to;
+        if (end - apu->time > FS_PERIOD) end = apu->time + FS_PERIOD;
+        if (apu->power && apu->fs_next < end) end = apu->fs_next;
+
+        if (apu->synth && end - apu->blip_origin > MAX_SPAN)
+            apu_flush(apu, apu->time);
+
+        for (int i = 0; i < 4; i++) {
+            channel_run(apu, i, end);
+        }
+        apu->time = end;
+
+        if (apu->power && end == apu->fs_next) {
+            frame_sequencer_step(apu, end);
+            apu->fs_next += FS_PERIOD;
+        }
+    }
+}
+
+
+// ---------------------------------------------------------------- registers
+
+static void channel_trigger(APU* apu, int i, uint64_t now, uint16_t max_length) {
+    ApuChannel* ch = &apu->ch[i];
+    bool length_skips = (apu->fs_step & 1) != 0; // следующий шаг не тактирует длину
+
+    ch->enabled = ch->dac;
+    if (ch->length == 0) {
+        ch->length = max_length;
+        if (ch->length_enable && length_skips) ch->length--;
+    }
+
+    if (i != 2) {
+        uint8_t nrx2 = apu->regs[i * 5 + 2];
+        ch->volume = nrx2 >> 4;
+        ch->env_up = (nrx2 & 0x08) != 0;
+        ch->env_period = nrx2 & 0x07;
+        ch->env_timer = ch->env_period ? ch->env_period : 8;
+    }
+
+    if (i == 2) ch->pos = 0;
+    if (i == 3) apu->lfsr = 0x7FFF;
+
+    ch->period = channel_period(apu, i);
+    ch->next_step = now + ch->period;
+
+    if (i == 0) {
+        uint8_t nr10 = REG(NR10);
+        uint8_t period = (nr10 >> 4) & 0x07;
+        apu->sweep_shadow = ch->freq;
+        apu->sweep_timer = period ? period : 8;
+        apu->sweep_enabled = period != 0 || (nr10 & 0x07) != 0;
+        apu->sweep_negated = false;
+        if (nr10 & 0x07) sweep_calc(apu, now);
+    }
+
+    channel_update(apu, i, now);
+}
+
+
+// NRx4: length enable (with the extra-clock quirk) and trigger
+static void channel_write_control(APU* apu, int i, uint8_t val, uint64_t now, uint16_t max_length) {
+    ApuChannel* ch = &apu->ch[i];
+    bool was_enabled = ch->length_enable;
+    bool length_skips = (apu->fs_step & 1) != 0;
+
+    ch->length_enable = (val & 0x40) != 0;
+    if (i != 3) ch->freq = (ch->freq & 0xFF) | ((val & 0x07) << 8);
+
+    if (!was_enabled && ch->length_enable && length_skips && ch->length > 0) {
+        if (--ch->length == 0 && !(val & 0x80)) channel_disable(apu, i, now);
+    }
+
+    if (val & 0x80) channel_trigger(apu, i, now, max_length);
+}
+
+
+static void channel_write_envelope(APU* apu, int i, uint8_t val, uint64_t now) {
+    apu->ch[i].dac = (val & 0xF8) != 0;
+    if (!apu->ch[i].dac) apu->ch[i].enabled = false;
+    channel_update(apu, i, now);
+}
+
+
+static void apu_power_off(APU* apu, uint64_t now) {
+    // Длины на DMG не сбрасываются
+    uint16_t lengths[4];
+    for (int i = 0; i < 4; i++) {
+        lengths[i] = apu->ch[i].length;
+        apu_set_amp(apu, i, now, 0);
+    }
+
+    memset(apu->regs, 0, sizeof(apu->regs));
+    memset(apu->ch, 0, sizeof(apu->ch));
+    for (int i = 0; i < 4; i++) {
+        apu->ch[i].length = lengths[i];
+    }
+    apu_update_weights(apu, now);
+    apu->power = false;
+}
+
+
+void apu_write(APU* apu, uint16_t addr, uint8_t val) {
+    uint64_t now = apu->sched->now;
+    apu_sync(apu, now);
+
+    if (addr >= 0xFF30 && addr <= 0xFF3F) {
+        // While playing, the access goes to the byte being played
+        uint8_t index = apu->ch[2].enabled ? (apu->ch[2].pos >> 1) : (addr - 0xFF30);
+        apu->wave_ram[index] = val;
+        channel_update(apu, 2, now);
+        return;
+    }
+
+    if (addr > NR52) return;
+
+    if (addr == NR52) {
+        bool on = (val & 0x80) != 0;
+        if (!on && apu->power) {
+            apu_power_off(apu, now);
+        } else if (on && !apu->power) {
+            apu->power = true;
+            apu->fs_step = 0;
+            apu->fs_next = now + FS_PERIOD;
+        }
+        return;
+    }
+
+    if (!apu->power) {
+        // Выключенный APU на DMG принимает только счётчики длины
+        if (addr == NR11 || addr == 0xFF16 || addr == NR41) apu->ch[(addr - NR11) / 5].length = 64 - (val & 0x3F);
+        else if (addr == NR31) apu->ch[2].length = 256 - val;
+        return;
+    }
+
+    REG(addr) = val;
+
+    switch (addr) {
+        case NR10:
+            // Clearing negate after a negated calculation disables the channel
+            if (apu->sweep_negated && !(val & 0x08)) channel_disable(apu, 0, now);
+            break;
+
+        case NR11: apu->ch[0].length = 64 - (val & 0x3F); channel_update(apu, 0, now); break;
+        case NR21: apu->ch[1].length = 64 - (val & 0x3F); channel_update(apu, 1, now); break;
+        case NR31: apu->ch[2].length = 256 - val; break;
+        case NR41: apu->ch[3].length = 64 - (val & 0x3F); break;
+
+        case NR12: channel_write_envelope(apu, 0, val, now); break;
+        case NR22: channel_write_envelope(apu, 1, val, now); break;
+        case NR42: channel_write_envelope(apu, 3, val, now); break;
+
+        case NR30:
+            apu->ch[2].dac = (val & 0x80) != 0;
+            if (!apu->ch[2].dac) apu->ch[2].enabled = false;
+            channel_update(apu, 2, now);
+            break;
+        case NR32: channel_update(apu, 2, now); break;
+
+        case NR43:
+            // A stopped LFSR clock restarts here rather than at the next reload
+            if (apu->ch[3].period == 0) {
+                apu->ch[3].period = channel_period(apu, 3);
+                apu->ch[3].next_step = now + apu->ch[3].period;
+            }
+            break;
+
+        case NR13: apu->ch[0].freq = (apu->ch[0].freq & 0x700) | val; break;
+        case NR23: apu->ch[1].freq = (apu->ch[1].freq & 0x700) | val; break;
+        case NR33: apu->ch[2].freq = (apu->ch[2].freq & 0x700) | val; break;
+
+        case NR14: channel_write_control(apu, 0, val, now, 64); break;
+        case NR24: channel_write_control(apu, 1, val, now, 64); break;
+        case NR34: channel_write_control(apu, 2, val, now, 256); break;
+        case NR44: channel_write_control(apu, 3, val, now, 64); break;
+
+        case NR50:
+        case NR51:
+            apu_update_weights(apu, now);
+            break;
+    }
+}
+
+
+uint8_t apu_read(APU* apu, uint16_t addr) {
+    apu_sync(apu, apu->sched->now);
+
+    if (addr >= 0xFF30 && addr <= 0xFF3F) {
+        if (apu->ch[2].enabled) return apu->wave_ram[apu->ch[2].pos >> 1];
+        return apu->wave_ram[addr - 0xFF30];
+    }
+
+    if (addr == NR52) {
+        uint8_t status = apu->power ? 0xF0 : 0x70;
+        for (int i = 0; i < 4; i++) {
+            if (apu->ch[i].enabled) status |= (1 << i);
+        }
+        return status;
+    }
+
+    if (addr > NR52) return 0xFF;
+    return REG(addr) | read_mask[addr - NR10];
+}
+
+
+// ---------------------------------------------------------------- lifecycle
+
+void apu_set_tap(APU* apu, ApuTap tap, void* ctx) {
+    apu->tap = tap;
+    apu->tap_ctx = ctx;
+}
+
+
+void apu_set_sample_rate(APU* apu, int rate) {
+    if (rate <= 0) rate = APU_DEFAULT_RATE;
+    if (rate > APU_MAX_RATE) rate = APU_MAX_RATE;
+
+    apu_set_synth(apu, apu->synth);
+    apu->sample_rate = rate;
+    apu->ratio = ((uint64_t) rate << 32) / APU_CLOCK_RATE;
+    apu->blip_frac = 0;
+}
+
+
+// Restarts the blip buffers from silence at the current time and re-adds
+// every channel's present output
+static void apu_restart_output(APU* apu) {
+    memset(&apu->left, 0, sizeof(BlipBuffer));
+    memset(&apu->right, 0, sizeof(BlipBuffer));
+    apu->blip_origin = apu->time;
+    apu->blip_frac = 0;
+    for (int i = 0; i < 4; i++) {
+        apu->ch[i].amp = 0;
+        channel_update(apu, i, apu->time);
+    }
+}
+
+
+void apu_set_synth(APU* apu, bool enabled) {
+    if (apu->synth) apu_flush(apu, apu->time);
+
+    if (enabled && !apu->synth) {
+        // The buffers went stale while muted
+        apu->synth = true;
+        apu_restart_output(apu);
+    }
+
+    apu->synth = enabled;
+}
+
+
+void apu_restore(APU* apu) {
+    int amps[4];
+    for (int i = 0; i < 4; i++) {
+        amps[i] = apu->ch[i].amp;
+        apu->ch[i].amp = 0;
+    }
+    apu_update_weights(apu, apu->time);
+    for (int i = 0; i < 4; i++) {
+        apu->ch[i].amp = amps[i];
+    }
+
+    if (apu->synth) apu_restart_output(apu);
+}
+
+
+void apu_suspend_output(APU* apu) {
+    apu->suspended_synth = apu->synth;
+    apu->synth = false;
+}
+
+
+void apu_resume_output(APU* apu) {
+    apu->synth = apu->suspended_synth;
+}
+
+
+void apu_init(APU* apu, Scheduler* sched) {
+    bool synth = apu->sample_rate == 0 || apu->synth; // настройки переживают сброс
+    int rate = apu->sample_rate ? apu->sample_rate : APU_DEFAULT_RATE;
+    ApuTap tap = apu->tap;
+    void* tap_ctx = apu->tap_ctx;
+
+    memset(apu, 0, sizeof(APU));
+    apu->tap = tap;
+    apu->tap_ctx = tap_ctx;
+    apu->sched = sched;
+    apu->time = sched->now;
+    apu->blip_origin = sched->now;
+    apu->synth = synth;
+    apu->sample_rate = rate;
+    apu->ratio = ((uint64_t) rate << 32) / APU_CLOCK_RATE;
+
+    // Состояние после boot ROM
+    static const uint8_t post_boot[0x17] = {
+            0x80, 0xBF, 0xF3, 0xFF, 0xBF,
+            0xFF, 0x3F, 0x00, 0xFF, 0xBF,
+            0x7F, 0xFF, 0x9F, 0xFF, 0xBF,
+            0xFF, 0xFF, 0x00, 0x00, 0xBF,
+            0x77, 0xF3, 0xF1
+    };
+    memcpy(apu->regs, post_boot, sizeof(post_boot));
+
+    apu->power = true;
+    apu->fs_next = sched->now + FS_PERIOD;
+    apu->lfsr = 0x7FFF;
+
+    // Boot beep has finished: channel 1 is still on, its envelope at 0
+    apu->ch[0].enabled = true;
+    apu->ch[0].dac = true;
+    apu->ch[0].freq = 0x7C1;
+    apu->ch[0].period = channel_period(apu, 0);
+    apu->ch[0].next_step = sched->now + apu->ch[0].period;
+    apu->ch[1].period = channel_period(apu, 1);
+    apu->ch[2].period = channel_period(apu, 2);
+    apu->ch[3].period = channel_period(apu, 3);
+
+    apu_update_weights(apu, sched->now);
+}
+
+
+void apu_end_frame(APU* apu) {
+    apu_sync(apu, apu->sched->now);
+    if (apu->synth) apu_flush(apu, apu->time);
+}
+
+
+size_t apu_drain(APU* apu, int16_t* out, size_t frames) {
+    uint32_t tail = atomic_load_explicit(&apu->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&apu->head, memory_order_acquire);
+
+    size_t n = 0;
+    while (tail != head && n < frames) {
+        uint32_t slot = tail & (APU_RING_FRAMES - 1);
+        out[n * 2] = apu->ring[slot * 2];
+        out[n * 2 + 1] = apu->ring[slot * 2 + 1];
+        tail++;
+        n++;
+    }
+
+    atomic_store_explicit(&apu->tail, tail, memory_order_release);
+    return n;
+}
@@ -0,0 +1,111 @@
+#ifndef APU_H
+#define APU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "scheduler.h"
+
+#define APU_CLOCK_RATE      4194304
+#define APU_DEFAULT_RATE    48000
+#define APU_MAX_RATE        96000
+#define APU_RING_FRAMES     8192  // стерео-кадров, степень двойки
+
+// Band-limited step synthesis (blip buffer): amplitude changes are stored as
+// windowed-sinc impulses at their exact sub-sample position and integrated
+// when samples are read out, so nothing is evaluated per emulated cycle.
+#define BLIP_PHASES   32
+#define BLIP_TAPS     16
+#define BLIP_SIZE     4096
+
+typedef struct {
+    int32_t buf[BLIP_SIZE + BLIP_TAPS];
+    int32_t integrator;
+} BlipBuffer;
+
+// `n` interleaved stereo frames
+typedef void (*ApuTap)(void* ctx, const int16_t* frames, uint32_t n);
+
+typedef struct {
+    bool enabled;        // NR52 status bit
+    bool dac;
+    bool length_enable;
+    uint16_t length;     // counts down to 0 at 256 Hz
+    uint16_t freq;       // 11-bit frequency (squares, wave)
+    uint32_t period;     // cycles per waveform step
+    uint64_t next_step;  // cycle of the next waveform step
+    uint8_t pos;         // duty / wave position
+
+    uint8_t volume;      // envelope (squares, noise)
+    uint8_t env_period;
+    uint8_t env_timer;
+    bool env_up;
+
+    int amp;             // output currently in the blip buffers, 0..15
+} ApuChannel;
+
+typedef struct {
+    uint8_t regs[0x17];  // 0xFF10-0xFF26 as written
+    uint8_t wave_ram[16];
+    bool power;
+
+    ApuChannel ch[4];
+
+    // Channel 1 sweep
+    uint16_t sweep_shadow;
+    uint8_t sweep_timer;
+    bool sweep_enabled;
+    bool sweep_negated;
+
+    uint16_t lfsr;       // channel 4
+
+    uint8_t fs_step;     // next frame sequencer step, 0-7
+    uint64_t fs_next;    // cycle of that step (512 Hz)
+
+    uint64_t time;       // everything above is up to date as of this cycle
+    Scheduler* sched;
+
+    // Synthesis; `synth` false keeps register behaviour but skips output
+    bool synth;
+    bool suspended_synth;  // `synth` while output is suspended for run-ahead
+    int sample_rate;
+    uint64_t ratio;      // samples per cycle, 32.32 fixed point
+    uint64_t blip_origin;  // cycle of the first unread sample
+    uint32_t blip_frac;
+    int weight_l[4];
+    int weight_r[4];
+    BlipBuffer left;
+    BlipBuffer right;
+
+    // int16 interleaved stereo. SPSC: the emulator pushes, gb_audio_read pops.
+    int16_t ring[APU_RING_FRAMES * 2];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint32_t overruns;
+
+    // Also sees every synthesized frame, before the ring (shared-memory export)
+    ApuTap tap;
+    void* tap_ctx;
+} APU;
+
+void apu_init(APU* apu, Scheduler* sched);
+void apu_set_tap(APU* apu, ApuTap tap, void* ctx);
+void apu_set_sample_rate(APU* apu, int rate);
+void apu_set_synth(APU* apu, bool enabled);
+// Rebuilds derived synthesis state once registers and channels were restored
+void apu_restore(APU* apu);
+// Run-ahead: frames emulated between these two calls produce no output and
+// leave the blip buffers alone. The state saved at suspend time must be
+// loaded back before resuming; output then continues without a seam.
+void apu_suspend_output(APU* apu);
+void apu_resume_output(APU* apu);
+uint8_t apu_read(APU* apu, uint16_t addr);
+void apu_write(APU* apu, uint16_t addr, uint8_t val);
+
+// Catches up to the scheduler clock and moves finished samples to the ring
+void apu_end_frame(APU* apu);
+
+size_t apu_drain(APU* apu, int16_t* out, size_t frames);
+
+#endif
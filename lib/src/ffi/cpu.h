@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include "mmu.h"
 
 typedef struct {
@@ -41,11 +42,21 @@ typedef struct {
     int halted;
     int ime;
     int ime_pending;
+
+    MMU* mmu;
+    int ticked;      // timed mode: cycles of this instruction already advanced
+    struct Profiler* profile; // shadow call stack, NULL unless profiling
+#ifdef GB_STATS
+    int stats_op;    // opcode being executed, CB ones as 0x100 + n
+#endif
 } CPU;
 
 void cpu_init(CPU* cpu);
 int cpu_step(CPU* cpu);
+// M-cycle accurate: each memory access advances the machine (gb_tick) at the
+// point it happens. Returns the cycles left over, internal ones.
+int cpu_step_timed(CPU* cpu);
 int cpu_step_cb(CPU* cpu, uint8_t cbop);
-void cpu_connect_mmu(MMU* mmu);
+void cpu_connect_mmu(CPU* cpu, MMU* mmu);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef GAMEBOY_H
+#define GAMEBOY_H
+
+#include <stdint.h>
+#include "_gb.h"
+#include "cpu.h"
+#include "mmu.h"
+#include "ppu.h"
+#include "joypad.h"
+#include "serial.h"
+#include "timer.h"
+#include "apu.h"
+#include "scheduler.h"
+#include "movie.h"
+#include "stats.h"
+#include "trace.h"
+#include "profiler.h"
+#include "shm_export.h"
+#include "recorder.h"
+
+// Full state of one emulated machine. Instances are independent of each
+// other; the legacy gb_* calls in _gb.h operate on a built-in default one.
+//
+// Laid out for the cache: what the run loop touches on every instruction
+// (registers, clock, flags, then IF/IE, HRAM and the page table at the start
+// of MMU) fills the first cache lines of the 64-byte aligned instance; device
+// state follows, host-side hooks after it, and the framebuffer comes last.
+// Buffers that belong to a device stay inside it, so the joypad queue, serial
+// capture and APU sample buffers sit before the hooks. tools/cache_bench.c
+// prints where the hot fields ended up.
+struct GameBoy {
+    _Alignas(64) CPU cpu;
+    Scheduler sched; // master clock and device deadlines
+    uint64_t instructions;
+    uint64_t run_target; // gb_run_until stops here; entering VBlank pulls it in
+    uint64_t frame_start; // cycle the current host frame began
+    Trace* trace;    // gb_trace_start, NULL otherwise
+    bool hidden;     // speculative run-ahead frame: input held, no output
+    bool timed;      // M-cycle accurate CPU (gb_set_cycle_accurate)
+    bool video_off;  // frames end without drawing (gb_set_video_enabled)
+    bool frame_vblank; // the PPU entered VBlank since frame_start
+    bool log_stdout; // ROM header and bus warnings (gb_set_log)
+
+    MMU mmu;
+    PPU ppu;
+    Timer timer;
+    Joypad joypad;
+    Serial serial;
+    APU apu;
+
+    Movie* movie;    // recording or playing, NULL otherwise
+    Profiler* profile; // gb_profile_start; cpu.profile is cleared while hidden
+    ShmExport* shm;  // gb_shm_export, NULL otherwise
+    Recorder* recorder; // gb_recorder_start, NULL otherwise
+    uint32_t frame_dirty[PPU_DIRTY_WORDS]; // rows changed by the last presented frame
+#ifdef GB_STATS
+    GbStats stats;
+#endif
+
+    // Run-ahead (see gb_set_run_ahead)
+    int run_ahead;
+    uint8_t* run_ahead_state;
+    uint32_t run_ahead_frames;
+    double run_ahead_frame_seconds;
+    double run_ahead_extra_seconds;
+
+    _Alignas(64) uint32_t framebuffer[SCREEN_HEIGHT][SCREEN_WIDTH]; // RGBA, drawn by the PPU
+};
+
+// Timed CPU mode: advances every device by `cycles` in the middle of an
+// instruction, before the memory access that needs it
+void gb_tick(GameBoy* gb, int cycles);
+
+#endif
@@ -0,0 +1,11 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "host_time.h"
+#include <time.h>
+
+
+double host_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,8 @@
+#ifndef HOST_TIME_H
+#define HOST_TIME_H
+
+// Monotonic host time in seconds, for measuring intervals: unlike the wall
+// clock it never jumps
+double host_seconds(void);
+
+#endif
@@ -0,0 +1,90 @@
+#include "joypad.h"
+#include <string.h>
+
+
+void joypad_init(Joypad* joypad) {
+    memset(joypad, 0, sizeof(Joypad));
+    joypad->select = 0x30;
+}
+
+
+// Low nibble of P1 as seen by the game (0 = pressed)
+static uint8_t joypad_lines(const Joypad* joypad) {
+    uint8_t lines = 0x0F;
+    if (!(joypad->select & 0x10)) lines &= ~(joypad->pressed & 0x0F);
+    if (!(joypad->select & 0x20)) lines &= ~(joypad->pressed >> 4);
+    return lines;
+}
+
+
+bool joypad_push(Joypad* joypad, JoypadButton button, bool pressed, uint64_t cycle) {
+    uint32_t head = atomic_load_explicit(&joypad->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&joypad->tail, memory_order_acquire);
+
+    if (head - tail >= JOYPAD_QUEUE_SIZE) return false;
+
+    JoypadEvent* ev = &joypad->queue[head & (JOYPAD_QUEUE_SIZE - 1)];
+    ev->cycle = cycle;
+    ev->button = (uint8_t) button;
+    ev->pressed = pressed ? 1 : 0;
+
+    atomic_store_explicit(&joypad->head, head + 1, memory_order_release);
+    return true;
+}
+
+
+uint64_t joypad_next_event(Joypad* joypad) {
+    uint32_t tail = atomic_load_explicit(&joypad->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&joypad->head, memory_order_acquire);
+
+    if (head == tail) return UINT64_MAX;
+    return joypad->queue[tail & (JOYPAD_QUEUE_SIZE - 1)].cycle;
+}
+
+
+bool joypad_apply_events(Joypad* joypad, uint64_t now) {
+    uint32_t tail = atomic_load_explicit(&joypad->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&joypad->head, memory_order_acquire);
+
+    uint8_t pressed = joypad->pressed;
+
+    while (tail != head) {
+        const JoypadEvent* ev = &joypad->queue[tail & (JOYPAD_QUEUE_SIZE - 1)];
+        if (ev->cycle > now) break;
+
+        if (ev->pressed)
+            pressed |= (1 << ev->button);
+        else
+            pressed &= ~(1 << ev->button);
+        tail++;
+    }
+
+    atomic_store_explicit(&joypad->tail, tail, memory_order_release);
+
+    return joypad_set(joypad, pressed);
+}
+
+
+bool joypad_set(Joypad* joypad, uint8_t pressed) {
+    uint8_t before = joypad_lines(joypad);
+    joypad->pressed = pressed;
+    return (before & ~joypad_lines(joypad)) != 0;
+}
+
+
+void joypad_clear(Joypad* joypad) {
+    uint32_t head = atomic_load_explicit(&joypad->head, memory_order_acquire);
+    atomic_store_explicit(&joypad->tail, head, memory_order_release);
+}
+
+
+uint8_t joypad_read(Joypad* joypad) {
+    return 0xC0 | joypad->select | joypad_lines(joypad);
+}
+
+
+bool joypad_write(Joypad* joypad, uint8_t val) {
+    uint8_t before = joypad_lines(joypad);
+    joypad->select = val & 0x30;
+    return (before & ~joypad_lines(joypad)) != 0;
+}
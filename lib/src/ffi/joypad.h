@@ -0,0 +1,56 @@
+#ifndef JOYPAD_H
+#define JOYPAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define JOYPAD_QUEUE_SIZE 256 // степень двойки
+
+typedef enum {
+    JOYPAD_RIGHT  = 0,
+    JOYPAD_LEFT   = 1,
+    JOYPAD_UP     = 2,
+    JOYPAD_DOWN   = 3,
+    JOYPAD_A      = 4,
+    JOYPAD_B      = 5,
+    JOYPAD_SELECT = 6,
+    JOYPAD_START  = 7
+} JoypadButton;
+
+typedef struct {
+    uint64_t cycle;  // emulated cycle at which the event takes effect
+    uint8_t button;  // JoypadButton
+    uint8_t pressed;
+} JoypadEvent;
+
+typedef struct {
+    uint8_t select;  // P1 bits 4-5 as written by the game
+    uint8_t pressed; // 1 = pressed; bits 0-3 d-pad, bits 4-7 buttons
+
+    // SPSC queue: the UI thread pushes, the emulation thread pops
+    JoypadEvent queue[JOYPAD_QUEUE_SIZE];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+} Joypad;
+
+void joypad_init(Joypad* joypad);
+
+// Producer side. Returns false when the queue is full.
+bool joypad_push(Joypad* joypad, JoypadButton button, bool pressed, uint64_t cycle);
+
+// Consumer side. Cycle of the oldest queued event, UINT64_MAX if none.
+uint64_t joypad_next_event(Joypad* joypad);
+
+// Applies every queued event due at or before `now`.
+// Returns true if a selected input line went from high to low (joypad interrupt).
+bool joypad_apply_events(Joypad* joypad, uint64_t now);
+// Replaces the whole button state, same return value. Consumer side.
+bool joypad_set(Joypad* joypad, uint8_t pressed);
+// Drops every queued event. Consumer side.
+void joypad_clear(Joypad* joypad);
+
+uint8_t joypad_read(Joypad* joypad);
+bool joypad_write(Joypad* joypad, uint8_t val);
+
+#endif
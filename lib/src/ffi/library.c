@@ -0,0 +1,372 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "library.h"
+#include "rom.h"
+#include "host_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LIBRARY_MAX_THREADS 64
+
+
+static int64_t mtime_ns(const struct stat* st) {
+#ifdef __APPLE__
+    return (int64_t) st->st_mtimespec.tv_sec * 1000000000 + st->st_mtimespec.tv_nsec;
+#else
+    return (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(((const RomInfo*) a)->path, ((const RomInfo*) b)->path);
+}
+
+
+static bool is_rom_name(const char* name) {
+    const char* dot = strrchr(name, '.');
+    return dot && (strcasecmp(dot, ".gb") == 0 || strcasecmp(dot, ".gbc") == 0 || strcasecmp(dot, ".sgb") == 0);
+}
+
+
+static void free_roms(RomInfo* roms, size_t count) {
+    for (size_t i = 0; i < count; i++) free((char*) roms[i].path);
+    free(roms);
+}
+
+
+// ---------------------------------------------------------------- index file
+
+static bool read_index(RomLibrary* lib) {
+    FILE* f = fopen(lib->index_path, "rb");
+    if (f == NULL) return false;
+
+    LibraryHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == LIBRARY_MAGIC
+            && header.version == LIBRARY_VERSION && header.record_size == sizeof(LibraryRecord);
+    RomInfo* roms = ok ? calloc(header.count ? header.count : 1, sizeof(RomInfo)) : NULL;
+
+    size_t count = 0;
+    while (roms && count < header.count) {
+        LibraryRecord rec;
+        if (fread(&rec, sizeof(rec), 1, f) != 1) break;
+
+        char* path = malloc(rec.path_len + 1);
+        if (path == NULL || fread(path, 1, rec.path_len, f) != rec.path_len) {
+            free(path);
+            break;
+        }
+        path[rec.path_len] = 0;
+
+        RomInfo* info = &roms[count++];
+        info->path = path;
+        info->size = rec.size;
+        info->mtime_ns = rec.mtime_ns;
+        info->hash = rec.hash;
+        info->global_ok = rec.global_ok;
+        info->header = rec.header;
+    }
+    fclose(f);
+
+    if (roms == NULL || count != header.count) {
+        if (roms) free_roms(roms, count);
+        return false;
+    }
+    lib->roms = roms;
+    lib->count = count;
+    return true;
+}
+
+
+// Written next to the index and renamed over it
+static bool write_index(RomLibrary* lib) {
+    size_t len = strlen(lib->index_path);
+    char* tmp = malloc(len + 5);
+    if (tmp == NULL) return false;
+    memcpy(tmp, lib->index_path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    FILE* f = fopen(tmp, "wb");
+    bool ok = f != NULL;
+    if (ok) {
+        LibraryHeader header = { LIBRARY_MAGIC, LIBRARY_VERSION, (uint32_t) lib->count, sizeof(LibraryRecord) };
+        ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+        for (size_t i = 0; ok && i < lib->count; i++) {
+            const RomInfo* info = &lib->roms[i];
+            LibraryRecord rec;
+            memset(&rec, 0, sizeof(rec)); // padding too: the file is compared byte for byte
+            rec.size = info->size;
+            rec.mtime_ns = info->mtime_ns;
+            rec.hash = info->hash;
+            rec.header = info->header;
+            rec.global_ok = info->global_ok;
+            rec.path_len = (uint16_t) strlen(info->path);
+            ok = fwrite(&rec, sizeof(rec), 1, f) == 1 && fwrite(info->path, 1, rec.path_len, f) == rec.path_len;
+        }
+        ok = fclose(f) == 0 && ok;
+    }
+
+    ok = ok && rename(tmp, lib->index_path) == 0;
+    if (!ok) remove(tmp);
+    free(tmp);
+    return ok;
+}
+
+
+// ---------------------------------------------------------------- scanning
+
+static bool add_job(LibraryWork* work, size_t* cap, const char* path, const struct stat* st) {
+    if (work->count == *cap) {
+        size_t grown = *cap ? *cap * 2 : 256;
+        LibraryJob* jobs = realloc(work->jobs, grown * sizeof(LibraryJob));
+        if (jobs == NULL) return false;
+        work->jobs = jobs;
+        *cap = grown;
+    }
+
+    char* copy = strdup(path);
+    if (copy == NULL) return false;
+
+    LibraryJob* job = &work->jobs[work->count++];
+    memset(job, 0, sizeof(*job));
+    job->info.path = copy;
+    job->info.size = (uint64_t) st->st_size;
+    job->info.mtime_ns = mtime_ns(st);
+    return true;
+}
+
+
+// Every ROM under `dir`, depth first; hidden entries are skipped. Links to
+// files are indexed, links to directories are not followed: they can lead
+// back up the tree. Subdirectories that cannot be opened are skipped; false
+// means the root could not be opened or memory ran out.
+static bool walk(const char* dir, int depth, LibraryWork* work, size_t* cap) {
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        if (depth == 0) return false;
+        work->skipped_dirs++;
+        return true;
+    }
+
+    bool ok = true;
+    size_t len = strlen(dir);
+    struct dirent* e;
+    while (ok && (e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+
+        size_t name_len = strlen(e->d_name);
+        char* path = malloc(len + name_len + 2);
+        if (path == NULL) {
+            ok = false;
+            break;
+        }
+        memcpy(path, dir, len);
+        path[len] = '/';
+        memcpy(path + len + 1, e->d_name, name_len + 1);
+        if (len > 0 && dir[len - 1] == '/') memmove(path + len, path + len + 1, name_len + 1);
+
+        struct stat st;
+        if (lstat(path, &st) == 0) {
+            if (S_ISDIR(st.st_mode))
+                ok = walk(path, depth + 1, work, cap);
+            else if (S_ISLNK(st.st_mode) && stat(path, &st) != 0)
+                st.st_mode = 0; // dangling
+
+            if (ok && S_ISREG(st.st_mode) && is_rom_name(e->d_name) && strlen(path) <= UINT16_MAX)
+                ok = add_job(work, cap, path, &st);
+        }
+        free(path);
+    }
+    closedir(d);
+    return ok;
+}
+
+
+// Maps the file, parses the header, hashes and checksums the whole image
+static bool scan_file(RomInfo* info, uint64_t* bytes) {
+    int fd = open(info->path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size >= 0x150;
+    const uint8_t* data = ok ? mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    size_t size = (size_t) st.st_size;
+    info->size = size;
+    info->mtime_ns = mtime_ns(&st);
+    rom_parse_header(data, size, &info->header);
+    info->hash = rom_hash(data, size);
+
+    uint16_t sum = 0;
+    for (size_t i = 0; i < size; i++) sum += data[i];
+    sum -= data[0x14E] + data[0x14F];
+    info->global_ok = sum == info->header.global_checksum;
+
+    munmap((void*) data, size);
+    *bytes += size;
+    return true;
+}
+
+
+static void* scan_worker(void* arg) {
+    LibraryWork* work = arg;
+    uint64_t bytes = 0;
+
+    size_t i;
+    while ((i = atomic_fetch_add(&work->next, 1)) < work->count) {
+        LibraryJob* job = &work->jobs[i];
+        if (job->scan) job->ok = scan_file(&job->info, &bytes);
+    }
+    atomic_fetch_add(&work->bytes, bytes);
+    return NULL;
+}
+
+
+static bool under(const char* path, const char* dir, size_t len) {
+    return strncmp(path, dir, len) == 0 && (path[len] == '/' || (len > 0 && dir[len - 1] == '/'));
+}
+
+
+bool gb_library_scan(RomLibrary* lib, const char* dir, int threads, LibraryScanStats* stats) {
+    double start = host_seconds();
+    LibraryScanStats s = { 0 };
+
+    size_t dir_len = strlen(dir);
+    while (dir_len > 1 && dir[dir_len - 1] == '/') dir_len--;
+
+    LibraryWork work = { 0 };
+    size_t cap = 0;
+    char* root = strndup(dir, dir_len);
+    bool ok = root && walk(root, 0, &work, &cap);
+    if (!ok) {
+        for (size_t i = 0; i < work.count; i++) free((char*) work.jobs[i].info.path);
+        free(work.jobs);
+        free(root);
+        return false;
+    }
+
+    // Unchanged files keep their entry; both lists are sorted by path
+    qsort(work.jobs, work.count, sizeof(LibraryJob), compare_paths);
+    bool* seen = calloc(lib->count ? lib->count : 1, sizeof(bool));
+    size_t old = 0;
+    for (size_t i = 0; i < work.count; i++) {
+        LibraryJob* job = &work.jobs[i];
+        while (old < lib->count && strcmp(lib->roms[old].path, job->info.path) < 0) old++;
+
+        const RomInfo* known = old < lib->count && strcmp(lib->roms[old].path, job->info.path) == 0
+                ? &lib->roms[old] : NULL;
+        if (known && seen) seen[old] = true;
+        if (known && known->size == job->info.size && known->mtime_ns == job->info.mtime_ns) {
+            const char* path = job->info.path;
+            job->info = *known;
+            job->info.path = path;
+            job->ok = true;
+            s.reused++;
+        } else {
+            job->scan = true;
+            s.scanned++;
+        }
+    }
+
+    if (threads <= 0) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > LIBRARY_MAX_THREADS) threads = LIBRARY_MAX_THREADS;
+    if ((size_t) threads > s.scanned) threads = s.scanned > 0 ? (int) s.scanned : 1;
+
+    pthread_t pool[LIBRARY_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&pool[started], NULL, scan_worker, &work) == 0) started++;
+    }
+    scan_worker(&work);
+    for (int i = 0; i < started; i++) pthread_join(pool[i], NULL);
+
+    // New list: entries outside `dir` as they were, then this scan's
+    size_t total = work.count;
+    for (size_t i = 0; i < lib->count; i++) total += !under(lib->roms[i].path, root, dir_len);
+    RomInfo* roms = calloc(total ? total : 1, sizeof(RomInfo));
+    size_t count = 0;
+
+    for (size_t i = 0; roms && i < lib->count; i++) {
+        if (under(lib->roms[i].path, root, dir_len)) {
+            s.removed += seen && !seen[i];
+        } else {
+            roms[count] = lib->roms[i];
+            lib->roms[i].path = NULL;
+            count++;
+        }
+    }
+    for (size_t i = 0; i < work.count; i++) {
+        LibraryJob* job = &work.jobs[i];
+        if (roms && job->ok) {
+            roms[count++] = job->info;
+        } else {
+            if (!job->ok) s.failed++;
+            free((char*) job->info.path);
+        }
+    }
+    s.files = (uint32_t) work.count;
+    s.skipped_dirs = work.skipped_dirs;
+    s.bytes_hashed = atomic_load(&work.bytes);
+
+    if (roms) {
+        qsort(roms, count, sizeof(RomInfo), compare_paths);
+        free_roms(lib->roms, lib->count);
+        lib->roms = roms;
+        lib->count = count;
+        ok = write_index(lib);
+    } else {
+        ok = false;
+    }
+
+    free(seen);
+    free(work.jobs);
+    free(root);
+    s.seconds = host_seconds() - start;
+    if (stats) *stats = s;
+    return ok;
+}
+
+
+// ---------------------------------------------------------------- library
+
+RomLibrary* gb_library_open(const char* index_path) {
+    RomLibrary* lib = calloc(1, sizeof(RomLibrary));
+    if (lib == NULL) return NULL;
+
+    lib->index_path = strdup(index_path);
+    if (lib->index_path == NULL) {
+        free(lib);
+        return NULL;
+    }
+    read_index(lib);
+    return lib;
+}
+
+
+size_t gb_library_count(RomLibrary* lib) {
+    return lib->count;
+}
+
+
+const RomInfo* gb_library_get(RomLibrary* lib, size_t index) {
+    return index < lib->count ? &lib->roms[index] : NULL;
+}
+
+
+void gb_library_close(RomLibrary* lib) {
+    if (lib == NULL) return;
+    free_roms(lib->roms, lib->count);
+    free(lib->index_path);
+    free(lib);
+}
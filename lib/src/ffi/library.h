@@ -0,0 +1,55 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "_gb.h"
+
+// Index file, host byte order:
+//   LibraryHeader
+//   per ROM: LibraryRecord, then path_len bytes of path (no NUL)
+// Records are sorted by path.
+
+#define LIBRARY_MAGIC   0x494C4247 // "GBLI"
+#define LIBRARY_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t record_size;
+} LibraryHeader;
+
+typedef struct {
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t hash;
+    RomHeader header;
+    uint8_t global_ok;
+    uint16_t path_len;
+} LibraryRecord;
+
+struct RomLibrary {
+    char* index_path;
+    RomInfo* roms;           // paths owned, sorted by path
+    size_t count;
+};
+
+// One file of a scan: found by the walk, filled in by a worker unless the
+// index already had it unchanged
+typedef struct {
+    RomInfo info;
+    bool scan;
+    bool ok;
+} LibraryJob;
+
+typedef struct {
+    LibraryJob* jobs;
+    size_t count;
+    _Atomic size_t next;
+    _Atomic uint64_t bytes;
+    uint32_t skipped_dirs;   // walk only
+} LibraryWork;
+
+#endif
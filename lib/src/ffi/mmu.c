@@ -1,37 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "mmu.h"
+#include "gameboy.h"
+#include "rom.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 
 
+// Every page starts out as this one; it is never freed or written
+static MemPage zero_page;
+
+
+static void page_release(MemPage* page) {
+    if (page == NULL || page == &zero_page) return;
+    if (atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1) free(page);
+}
+
+
 void mmu_init(MMU* mmu) {
+    mmu_release(mmu);
     memset(mmu, 0, sizeof(MMU));
+    for (int i = 0; i < MMU_PAGE_COUNT; i++) {
+        mmu->pages[i] = &zero_page;
+    }
+}
+
+
+void mmu_release(MMU* mmu) {
+    for (int i = 0; i < MMU_PAGE_COUNT; i++) {
+        page_release(mmu->pages[i]);
+        mmu->pages[i] = NULL;
+        mmu->owned[i] = 0;
+    }
+    rom_release(mmu->rom);
+    mmu->rom = NULL;
+}
+
+
+void mmu_fork(MMU* child, MMU* parent) {
+    for (int i = 0; i < MMU_PAGE_COUNT; i++) {
+        MemPage* page = parent->pages[i];
+        if (page != &zero_page) atomic_fetch_add_explicit(&page->refs, 1, memory_order_relaxed);
+        parent->owned[i] = 0;
+        child->owned[i] = 0;
+    }
+    rom_retain(child->rom);
+}
+
+
+MemPage* mmu_page_alloc() {
+    void* page = NULL;
+    if (posix_memalign(&page, _Alignof(MemPage), sizeof(MemPage)) != 0) return NULL;
+    atomic_init(&((MemPage*) page)->refs, 1);
+    return page;
+}
+
+
+uint8_t* mmu_page_mut(MMU* mmu, int index) {
+    if (mmu->owned[index]) return mmu->pages[index]->data;
+
+    MemPage* page = mmu->pages[index];
+    if (page != &zero_page && atomic_load_explicit(&page->refs, memory_order_acquire) == 1) {
+        // Остальные копии уже освободили страницу
+        mmu->owned[index] = 1;
+        return page->data;
+    }
+
+    MemPage* copy = mmu_page_alloc();
+    if (copy == NULL) {
+        mmu->out_of_memory = true;
+        return NULL;
+    }
+    memcpy(copy->data, page->data, MMU_PAGE_SIZE);
+    page_release(page);
+
+    mmu->pages[index] = copy;
+    mmu->owned[index] = 1;
+    return copy->data;
+}
+
+
+static inline uint8_t mem_read(MMU* mmu, uint16_t addr) {
+    return mmu->pages[addr >> MMU_PAGE_SHIFT]->data[addr & (MMU_PAGE_SIZE - 1)];
+}
+
+
+static inline void mem_write(MMU* mmu, uint16_t addr, uint8_t val) {
+    int page = addr >> MMU_PAGE_SHIFT;
+    uint8_t* data = mmu->owned[page] ? mmu->pages[page]->data : mmu_page_mut(mmu, page);
+    if (data != NULL) data[addr & (MMU_PAGE_SIZE - 1)] = val;
+}
+
+
+void mmu_connect(MMU* mmu, struct GameBoy* gb) {
+    mmu->gb = gb;
+}
+
+
+void mmu_request_interrupt(MMU* mmu, int interrupt) {
+    mmu->io[0x0F] |= (1 << interrupt);
 }
 
 
 uint8_t mmu_read8(MMU* mmu, uint16_t addr) {
+    STATS_ACCESS(&mmu->gb->stats, addr, reads);
 
     if (!mmu->boot_completed && addr < 0x100) {
         return mmu->boot_rom[addr];
     }
 
-    if (addr <= 0x3FFF)
-        return mmu->rom[addr];
-    else if (addr <= 0x7FFF)
-        return mmu->rom[addr]; // без MBC
-    else if (addr <= 0x9FFF)
-        return mmu->vram[addr - 0x8000];
-    else if (addr <= 0xBFFF)
-        return mmu->eram[addr - 0xA000];
-    else if (addr <= 0xDFFF)
-        return mmu->wram[addr - 0xC000];
+    if (addr <= 0xDFFF)
+        return mem_read(mmu, addr); // ROM (без MBC), VRAM, external RAM, WRAM
     else if (addr <= 0xFDFF)
-        return mmu->wram[addr - 0xE000]; // echo
+        return mem_read(mmu, addr - 0x2000); // echo
     else if (addr <= 0xFE9F)
         return mmu->oam[addr - 0xFE00];
     else if (addr <= 0xFEFF)
         return 0xFF; // недоступно
+    else if (addr == 0xFF00)
+        return joypad_read(&mmu->gb->joypad);
+    else if (addr <= 0xFF02)
+        return serial_read(&mmu->gb->serial, addr);
+    else if (addr >= 0xFF04 && addr <= 0xFF07)
+        return timer_read(&mmu->gb->timer, addr);
+    else if (addr >= 0xFF10 && addr <= 0xFF3F)
+        return apu_read(&mmu->gb->apu, addr);
     else if (addr <= 0xFF7F)
         return mmu->io[addr - 0xFF00];
     else if (addr <= 0xFFFE)
@@ -44,6 +139,7 @@ uint8_t mmu_read8(MMU* mmu, uint16_t addr) {
 
 
 void mmu_write8(MMU* mmu, uint16_t addr, uint8_t val) {
+    STATS_ACCESS(&mmu->gb->stats, addr, writes);
 
     if (addr == 0xFF50 && val == 1) {
         mmu->boot_completed = true;
@@ -53,19 +149,28 @@ void mmu_write8(MMU* mmu, uint16_t addr, uint8_t val) {
     if (addr <= 0x7FFF) {
         // ROM - нельзя писать (позже MBC)
         // TODO: MBC
-    } else if (addr <= 0x9FFF)
-        mmu->vram[addr - 0x8000] = val;
-    else if (addr <= 0xBFFF)
-        mmu->eram[addr - 0xA000] = val;
-    else if (addr <= 0xDFFF)
-        mmu->wram[addr - 0xC000] = val;
-    else if (addr <= 0xFDFF)
-        mmu->wram[addr - 0xE000] = val; // echo
+    } else if (addr <= 0xDFFF) {
+        mem_write(mmu, addr, val);
+        if (addr <= 0x9FFF && mmu->gb->ppu.pipeline)
+            ppu_pipeline_vram(&mmu->gb->ppu, addr, val);
+    } else if (addr <= 0xFDFF)
+        mem_write(mmu, addr - 0x2000, val); // echo
     else if (addr <= 0xFE9F)
         mmu->oam[addr - 0xFE00] = val;
     else if (addr <= 0xFEFF) {
-        printf("Writing to 0xFE00-0xFEFF is prohibited\n");
-    } else if (addr <= 0xFF7F)
+        if (mmu->gb->log_stdout) printf("Writing to 0xFE00-0xFEFF is prohibited\n");
+    } else if (addr == 0xFF00) {
+        if (joypad_write(&mmu->gb->joypad, val))
+            mmu_request_interrupt(mmu, INT_JOYPAD);
+    } else if (addr <= 0xFF02)
+        serial_write(&mmu->gb->serial, addr, val);
+    else if (addr >= 0xFF04 && addr <= 0xFF07)
+        timer_write(&mmu->gb->timer, addr, val);
+    else if (addr >= 0xFF10 && addr <= 0xFF3F)
+        apu_write(&mmu->gb->apu, addr, val);
+    else if (addr >= 0xFF40 && addr <= 0xFF45)
+        ppu_write(&mmu->gb->ppu, addr, val);
+    else if (addr <= 0xFF7F)
         mmu->io[addr - 0xFF00] = val;
     else if (addr <= 0xFFFE)
         mmu->hram[addr - 0xFF80] = val;
@@ -74,19 +179,30 @@ void mmu_write8(MMU* mmu, uint16_t addr, uint8_t val) {
 }
 
 
-void mmu_load_rom(MMU* mmu, const uint8_t* data, size_t size) {
-    printf("ROM title: ");
-    for (int i = 0x134; i < 0x144; i++) {
-        if (data[i] == 0) break;
-        putchar(data[i]);
+bool mmu_load_rom(MMU* mmu, const uint8_t* data, size_t size) {
+    if (mmu->gb->log_stdout) {
+        RomHeader header;
+        rom_parse_header(data, size, &header);
+        printf("ROM title: %s\n", header.title);
+        printf("ROM loaded, size = %zu\n", size);
+        printf("ROM[0x100..0x110] = ");
+        for (int i = 0x100; i < 0x110; i++) {
+            printf("%02X ", data[i]);
+        }
+        printf("\n");
     }
-    printf("\n");
-    printf("ROM loaded, size = %zu\n", size);
-    printf("ROM[0x100..0x110] = ");
-    for (int i = 0x100; i < 0x110; i++) {
-        printf("%02X ", data[i]);
+
+    RomImage* rom = rom_acquire(data, size);
+    if (rom == NULL) return false;
+
+    for (int i = 0; i < ROM_PAGES; i++) {
+        MemPage* page = rom->pages[i] ? rom->pages[i] : &zero_page;
+        if (page != &zero_page) atomic_fetch_add_explicit(&page->refs, 1, memory_order_relaxed);
+        page_release(mmu->pages[i]);
+        mmu->pages[i] = page;
+        mmu->owned[i] = 0;
     }
-    printf("\n");
-    int len = size > 0x8000 ? 0x8000 : size;
-    memcpy(mmu->rom, data, len);
+    rom_release(mmu->rom);
+    mmu->rom = rom;
+    return true;
 }
\ No newline at end of file
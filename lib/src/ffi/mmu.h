@@ -4,23 +4,67 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
+#define INT_VBLANK 0
+#define INT_STAT   1
+#define INT_TIMER  2
+#define INT_SERIAL 3
+#define INT_JOYPAD 4
+
+// 0000-DFFF (ROM, VRAM, external RAM, WRAM) is split into pages that forked
+// instances share until one of them writes. 4 KB pages (shift 12) also work.
+#define MMU_PAGE_SHIFT 8
+#define MMU_PAGE_SIZE  (1 << MMU_PAGE_SHIFT)
+#define MMU_PAGE_COUNT (0xE000 >> MMU_PAGE_SHIFT)
+#define MMU_RAM_PAGE   (0x8000 >> MMU_PAGE_SHIFT) // first page of VRAM
+
+// Data first and cache-line aligned, so a page covers exactly
+// MMU_PAGE_SIZE / 64 lines; allocate with mmu_page_alloc
+typedef struct {
+    _Alignas(64) uint8_t data[MMU_PAGE_SIZE];
+    _Atomic uint32_t refs;
+} MemPage;
+
+// Ordered by how often the run loop touches a field: IF/IE, HRAM and the
+// page table come first, right after the CPU in struct GameBoy.
 typedef struct {
-    uint8_t rom[0x8000];     // 32 КБ ROM (без MBC пока)
-    uint8_t vram[0x2000];    // 8 КБ
-    uint8_t eram[0x2000];    // External RAM
-    uint8_t wram[0x2000];    // 8 КБ
-    uint8_t oam[0xA0];       // 160 байт спрайтов
     uint8_t io[0x80];        // IO-регистры
     uint8_t hram[0x7F];      // High RAM
     uint8_t ie;              // interrupt enable
-    uint8_t boot_rom[0x100]; // Boot ROM
     bool boot_completed;
+    bool out_of_memory;      // a page copy failed and writes to it were lost
+    struct GameBoy* gb;      // владелец: IO-регистры устройств
+    MemPage* pages[MMU_PAGE_COUNT];
+    uint8_t owned[MMU_PAGE_COUNT]; // 1: not shared, writable in place
+    uint8_t oam[0xA0];       // 160 байт спрайтов
+
+    struct RomImage* rom;    // shared pages of 0000-7FFF (rom.h)
+    uint8_t boot_rom[0x100]; // Boot ROM
 } MMU;
 
 void mmu_init(MMU* mmu);
+// Drops this instance's references to its pages
+void mmu_release(MMU* mmu);
+// `child` is a byte copy of `parent`: every page becomes shared by both
+void mmu_fork(MMU* child, MMU* parent);
+// Unshared page with one reference, contents undefined; NULL if out of memory
+MemPage* mmu_page_alloc();
+// Page for writing; copies it first if it is shared. NULL, with
+// out_of_memory set, if the copy cannot be allocated.
+uint8_t* mmu_page_mut(MMU* mmu, int page);
 uint8_t mmu_read8(MMU* mmu, uint16_t addr);
 void mmu_write8(MMU* mmu, uint16_t addr, uint8_t val);
-void mmu_load_rom(MMU* mmu, const uint8_t* data, size_t size);
+void mmu_request_interrupt(MMU* mmu, int interrupt);
+void mmu_connect(MMU* mmu, struct GameBoy* gb);
+// Maps the shared image of `data` (see rom.h) at 0000-7FFF. False if it could
+// not be allocated; the previous ROM stays mapped.
+bool mmu_load_rom(MMU* mmu, const uint8_t* data, size_t size);
+
+
+// Page for reading, valid until the next write through this MMU
+static inline const uint8_t* mmu_page(const MMU* mmu, int page) {
+    return mmu->pages[page]->data;
+}
 
 #endif
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include "movie.h"
+#include "gameboy.h"
+#include "rle.h"
+#include "rom.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Movie layout, host byte order:
+//   header:    magic "GBMV", version, ROM hash, length, keyframe interval,
+//              input count, keyframe count, state size, final framebuffer hash
+//   inputs:    { cycle u64, pressed u8 }...
+//   keyframes: { frame u32, input u32, size u32, RLE-compressed state }...
+// The first keyframe is frame 0, the state recording started from.
+
+#define MOVIE_MAGIC   0x564D4247 // "GBMV"
+#define MOVIE_VERSION 1
+
+#define MOVIE_HEADER_SIZE 44
+#define MOVIE_INPUT_SIZE  9
+
+
+static uint64_t framebuffer_hash(GameBoy* gb) {
+    return rom_hash_seeded(gb->framebuffer, sizeof(gb->framebuffer), ROM_HASH_SEED);
+}
+
+
+static uint64_t movie_rom_hash(GameBoy* gb) {
+    uint64_t hash = ROM_HASH_SEED;
+    for (int i = 0; i < MMU_RAM_PAGE; i++) {
+        hash = rom_hash_seeded(mmu_page(&gb->mmu, i), MMU_PAGE_SIZE, hash);
+    }
+    return hash;
+}
+
+
+static Movie* movie_alloc(size_t state_size) {
+    Movie* movie = calloc(1, sizeof(Movie));
+    if (movie == NULL) return NULL;
+
+    movie->state_size = state_size;
+    movie->scratch = malloc(state_size);
+    if (movie->scratch == NULL) {
+        free(movie);
+        return NULL;
+    }
+    return movie;
+}
+
+
+static bool add_input(Movie* movie, uint64_t cycle, uint8_t pressed) {
+    if (movie->input_count == movie->input_cap) {
+        uint32_t cap = movie->input_cap ? movie->input_cap * 2 : 256;
+        MovieInput* inputs = realloc(movie->inputs, cap * sizeof(MovieInput));
+        if (inputs == NULL) return false;
+        movie->inputs = inputs;
+        movie->input_cap = cap;
+    }
+
+    movie->inputs[movie->input_count++] = (MovieInput) { cycle, pressed };
+    return true;
+}
+
+
+static MovieKeyframe* push_keyframe(Movie* movie) {
+    if (movie->keyframe_count == movie->keyframe_cap) {
+        uint32_t cap = movie->keyframe_cap ? movie->keyframe_cap * 2 : 16;
+        MovieKeyframe* keyframes = realloc(movie->keyframes, cap * sizeof(MovieKeyframe));
+        if (keyframes == NULL) return NULL;
+        movie->keyframes = keyframes;
+        movie->keyframe_cap = cap;
+    }
+
+    MovieKeyframe* k = &movie->keyframes[movie->keyframe_count++];
+    memset(k, 0, sizeof(MovieKeyframe));
+    return k;
+}
+
+
+static bool add_keyframe(Movie* movie) {
+    uint8_t* packed = malloc(RLE_BOUND(movie->state_size));
+    MovieKeyframe* k = packed ? push_keyframe(movie) : NULL;
+    if (k == NULL) {
+        free(packed);
+        return false;
+    }
+
+    gb_save_state(movie->gb, movie->scratch, movie->state_size);
+    size_t size = rle_encode(movie->scratch, movie->state_size, packed);
+    uint8_t* data = realloc(packed, size);
+
+    k->frame = movie->frame;
+    k->input = movie->input_count;
+    k->data = data ? data : packed;
+    k->size = (uint32_t) size;
+    return true;
+}
+
+
+// ---------------------------------------------------------------- frame loop hooks
+
+void movie_end_frame(Movie* movie) {
+    movie->frame++;
+
+    if (movie->mode == MOVIE_RECORDING) {
+        movie->length = movie->frame;
+        if (movie->frame % movie->keyframe_interval == 0) add_keyframe(movie);
+    }
+}
+
+
+void movie_input_applied(Movie* movie, uint8_t pressed) {
+    if (movie->mode != MOVIE_RECORDING || pressed == movie->pressed) return;
+
+    add_input(movie, movie->gb->sched.now, pressed);
+    movie->pressed = pressed;
+}
+
+
+uint64_t movie_next_input(Movie* movie) {
+    if (movie->cursor >= movie->input_count) return EVENT_NEVER;
+    return movie->inputs[movie->cursor].cycle;
+}
+
+
+bool movie_apply_inputs(Movie* movie, uint64_t now) {
+    Joypad* joypad = &movie->gb->joypad;
+    uint8_t pressed = joypad->pressed;
+
+    while (movie->cursor < movie->input_count && movie->inputs[movie->cursor].cycle <= now) {
+        pressed = movie->inputs[movie->cursor++].pressed;
+    }
+    return joypad_set(joypad, pressed);
+}
+
+
+// ---------------------------------------------------------------- API
+
+Movie* gb_movie_record(GameBoy* gb, int keyframe_interval) {
+    if (gb->movie) return NULL;
+
+    Movie* movie = movie_alloc(gb_state_size(gb));
+    if (movie == NULL) return NULL;
+
+    movie->gb = gb;
+    movie->mode = MOVIE_RECORDING;
+    movie->rom_hash = movie_rom_hash(gb);
+    movie->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : MOVIE_KEYFRAME_INTERVAL;
+    movie->pressed = gb->joypad.pressed;
+
+    if (!add_keyframe(movie)) {
+        gb_movie_destroy(movie);
+        return NULL;
+    }
+
+    gb->movie = movie;
+    return movie;
+}
+
+
+void gb_movie_stop(Movie* movie) {
+    if (movie->gb == NULL) return;
+
+    if (movie->mode == MOVIE_RECORDING) {
+        movie->frame_hash = framebuffer_hash(movie->gb);
+    } else {
+        // Нажатия хоста во время воспроизведения не применялись
+        joypad_clear(&movie->gb->joypad);
+    }
+
+    movie->gb->movie = NULL;
+    movie->gb = NULL;
+    movie->mode = MOVIE_IDLE;
+}
+
+
+void gb_movie_destroy(Movie* movie) {
+    if (movie == NULL) return;
+
+    gb_movie_stop(movie);
+    for (uint32_t i = 0; i < movie->keyframe_count; i++) {
+        free(movie->keyframes[i].data);
+    }
+    free(movie->keyframes);
+    free(movie->inputs);
+    free(movie->scratch);
+    free(movie);
+}
+
+
+static bool load_keyframe(Movie* movie, const MovieKeyframe* k) {
+    GameBoy* gb = movie->gb;
+
+    if (!rle_decode(k->data, k->size, movie->scratch, movie->state_size)) return false;
+    if (!gb_load_state(gb, movie->scratch, movie->state_size)) return false;
+
+    movie->frame = k->frame;
+    movie->cursor = k->input;
+    scheduler_set(&gb->sched, EVENT_JOYPAD, movie_next_input(movie));
+    return true;
+}
+
+
+bool gb_movie_play(Movie* movie, GameBoy* gb) {
+    if (movie->mode == MOVIE_RECORDING || gb->movie) return false;
+    if (movie->rom_hash != movie_rom_hash(gb)) return false;
+    if (gb_state_size(gb) != movie->state_size) return false;
+
+    gb_movie_stop(movie);
+    movie->gb = gb;
+    movie->mode = MOVIE_PLAYING;
+    gb->movie = movie;
+
+    joypad_clear(&gb->joypad);
+    if (!load_keyframe(movie, &movie->keyframes[0])) {
+        gb_movie_stop(movie);
+        return false;
+    }
+    return true;
+}
+
+
+bool gb_movie_seek(Movie* movie, uint32_t frame) {
+    if (movie->mode != MOVIE_PLAYING || frame > movie->length) return false;
+
+    // Последний ключевой кадр не позже цели; если цель впереди и ближе, идём от текущего
+    uint32_t i = movie->keyframe_count - 1;
+    while (movie->keyframes[i].frame > frame) i--;
+
+    if (movie->frame > frame || movie->keyframes[i].frame > movie->frame) {
+        if (!load_keyframe(movie, &movie->keyframes[i])) return false;
+    }
+
+    while (movie->frame < frame) {
+        gb_instance_step_frame(movie->gb);
+    }
+    return true;
+}
+
+
+uint32_t gb_movie_frame(Movie* movie) {
+    return movie->frame;
+}
+
+
+uint32_t gb_movie_length(Movie* movie) {
+    return movie->length;
+}
+
+
+bool gb_movie_verify(Movie* movie) {
+    if (movie->mode != MOVIE_PLAYING || movie->frame != movie->length) return false;
+    return framebuffer_hash(movie->gb) == movie->frame_hash;
+}
+
+
+// ---------------------------------------------------------------- serialization
+
+static size_t movie_put(uint8_t* buf, size_t pos, const void* data, size_t n) {
+    if (buf) memcpy(buf + pos, data, n);
+    return pos + n;
+}
+
+
+// Writes into `buf` (NULL: only measures)
+static size_t movie_serialize(Movie* movie, uint8_t* buf) {
+    uint32_t magic = MOVIE_MAGIC;
+    uint32_t version = MOVIE_VERSION;
+    uint32_t state_size = (uint32_t) movie->state_size;
+
+    size_t pos = 0;
+    pos = movie_put(buf, pos, &magic, sizeof(magic));
+    pos = movie_put(buf, pos, &version, sizeof(version));
+    pos = movie_put(buf, pos, &movie->rom_hash, sizeof(movie->rom_hash));
+    pos = movie_put(buf, pos, &movie->length, sizeof(movie->length));
+    pos = movie_put(buf, pos, &movie->keyframe_interval, sizeof(movie->keyframe_interval));
+    pos = movie_put(buf, pos, &movie->input_count, sizeof(movie->input_count));
+    pos = movie_put(buf, pos, &movie->keyframe_count, sizeof(movie->keyframe_count));
+    pos = movie_put(buf, pos, &state_size, sizeof(state_size));
+    pos = movie_put(buf, pos, &movie->frame_hash, sizeof(movie->frame_hash));
+
+    for (uint32_t i = 0; i < movie->input_count; i++) {
+        pos = movie_put(buf, pos, &movie->inputs[i].cycle, sizeof(uint64_t));
+        pos = movie_put(buf, pos, &movie->inputs[i].pressed, 1);
+    }
+
+    for (uint32_t i = 0; i < movie->keyframe_count; i++) {
+        MovieKeyframe* k = &movie->keyframes[i];
+        pos = movie_put(buf, pos, &k->frame, sizeof(k->frame));
+        pos = movie_put(buf, pos, &k->input, sizeof(k->input));
+        pos = movie_put(buf, pos, &k->size, sizeof(k->size));
+        pos = movie_put(buf, pos, k->data, k->size);
+    }
+    return pos;
+}
+
+
+size_t gb_movie_size(Movie* movie) {
+    return movie_serialize(movie, NULL);
+}
+
+
+size_t gb_movie_write(Movie* movie, uint8_t* buf, size_t cap) {
+    if (movie->mode == MOVIE_RECORDING) return 0;
+
+    size_t size = movie_serialize(movie, NULL);
+    if (buf == NULL || cap < size) return 0;
+    return movie_serialize(movie, buf);
+}
+
+
+static bool movie_get(const uint8_t* buf, size_t size, size_t* pos, void* data, size_t n) {
+    if (size - *pos < n) return false;
+    memcpy(data, buf + *pos, n);
+    *pos += n;
+    return true;
+}
+
+
+Movie* gb_movie_open(const uint8_t* buf, size_t size) {
+    uint32_t magic, version, length, interval, input_count, keyframe_count, state_size;
+    uint64_t rom_hash, frame_hash;
+    size_t pos = 0;
+
+    if (buf == NULL || size < MOVIE_HEADER_SIZE) return NULL;
+    movie_get(buf, size, &pos, &magic, sizeof(magic));
+    movie_get(buf, size, &pos, &version, sizeof(version));
+    movie_get(buf, size, &pos, &rom_hash, sizeof(rom_hash));
+    movie_get(buf, size, &pos, &length, sizeof(length));
+    movie_get(buf, size, &pos, &interval, sizeof(interval));
+    movie_get(buf, size, &pos, &input_count, sizeof(input_count));
+    movie_get(buf, size, &pos, &keyframe_count, sizeof(keyframe_count));
+    movie_get(buf, size, &pos, &state_size, sizeof(state_size));
+    movie_get(buf, size, &pos, &frame_hash, sizeof(frame_hash));
+
+    if (magic != MOVIE_MAGIC || version != MOVIE_VERSION) return NULL;
+    if (interval == 0 || keyframe_count == 0) return NULL;
+    // Another state layout could never be played; any instance gives this build's size
+    if (state_size != gb_state_size(gb_default())) return NULL;
+    if ((size - pos) / MOVIE_INPUT_SIZE < input_count) return NULL;
+
+    Movie* movie = movie_alloc(state_size);
+    if (movie == NULL) return NULL;
+
+    movie->rom_hash = rom_hash;
+    movie->length = length;
+    movie->keyframe_interval = interval;
+    movie->frame_hash = frame_hash;
+
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < input_count; i++) {
+        MovieInput in = { 0, 0 };
+        movie_get(buf, size, &pos, &in.cycle, sizeof(in.cycle));
+        movie_get(buf, size, &pos, &in.pressed, 1);
+        ok = add_input(movie, in.cycle, in.pressed);
+    }
+
+    // Keyframes start at frame 0 and are in order
+    for (uint32_t i = 0; ok && i < keyframe_count; i++) {
+        uint32_t frame, input, packed;
+        ok = movie_get(buf, size, &pos, &frame, sizeof(frame))
+             && movie_get(buf, size, &pos, &input, sizeof(input))
+             && movie_get(buf, size, &pos, &packed, sizeof(packed))
+             && packed <= size - pos && frame <= length && input <= input_count
+             && (i == 0 ? frame == 0 : frame > movie->keyframes[i - 1].frame);
+
+        MovieKeyframe* k = ok ? push_keyframe(movie) : NULL;
+        uint8_t* data = k ? malloc(packed ? packed : 1) : NULL;
+        ok = data != NULL;
+        if (ok) {
+            k->frame = frame;
+            k->input = input;
+            k->data = data;
+            k->size = packed;
+            movie_get(buf, size, &pos, data, packed);
+        }
+    }
+
+    if (!ok || pos != size) {
+        gb_movie_destroy(movie);
+        return NULL;
+    }
+    return movie;
+}
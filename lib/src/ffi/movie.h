@@ -0,0 +1,69 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "_gb.h"
+
+#define MOVIE_KEYFRAME_INTERVAL 600 // 10 s
+
+typedef enum {
+    MOVIE_IDLE,
+    MOVIE_RECORDING,
+    MOVIE_PLAYING
+} MovieMode;
+
+// Joypad state from `cycle` on (absolute emulated cycle, see gb_get_cycles)
+typedef struct {
+    uint64_t cycle;
+    uint8_t pressed;
+} MovieInput;
+
+// Save state after `frame` frames, RLE-compressed. `input` is the number of
+// inputs recorded before it.
+typedef struct {
+    uint32_t frame;
+    uint32_t input;
+    uint8_t* data;
+    uint32_t size;
+} MovieKeyframe;
+
+// Input movie: the starting state plus every change of the joypad lines at the
+// exact cycle the emulator applied it. Keyframes let playback seek without
+// re-emulating from the start.
+struct Movie {
+    GameBoy* gb;             // attached instance, NULL when idle
+    MovieMode mode;
+
+    uint64_t rom_hash;
+    uint32_t keyframe_interval;
+    size_t state_size;
+
+    MovieInput* inputs;
+    uint32_t input_count;
+    uint32_t input_cap;
+
+    MovieKeyframe* keyframes;
+    uint32_t keyframe_count;
+    uint32_t keyframe_cap;
+
+    uint32_t length;         // frames recorded
+    uint64_t frame_hash;     // framebuffer after the last frame
+
+    uint32_t frame;          // frames emulated since frame 0
+    uint32_t cursor;         // playback: next input to apply
+    uint8_t pressed;         // recording: joypad lines of the last input
+
+    uint8_t* scratch;        // state_size bytes
+};
+
+// Hooks called by the frame loop on the attached instance
+void movie_end_frame(Movie* movie);
+// Recording: the joypad lines after queued events were applied
+void movie_input_applied(Movie* movie, uint8_t pressed);
+// Playback: replaces the joypad queue as the input source
+uint64_t movie_next_input(Movie* movie);
+bool movie_apply_inputs(Movie* movie, uint64_t now);
+
+#endif
@@ -2,6 +2,7 @@
 #include "mmu.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 
 static const uint32_t DMG_PALETTE[4] = {
@@ -12,7 +13,7 @@ static const uint32_t DMG_PALETTE[4] = {
 };
 
 
-static uint8_t get_tile_pixel(uint8_t* tile_data, int x, int y) {
+static uint8_t get_tile_pixel(const uint8_t* tile_data, int x, int y) {
     uint8_t byte1 = tile_data[y * 2];
     uint8_t byte2 = tile_data[y * 2 + 1];
 
@@ -24,67 +25,336 @@ static uint8_t get_tile_pixel(uint8_t* tile_data, int x, int y) {
 }
 
 
-void ppu_init(PPU* ppu) {
-    memset(ppu->framebuffer, 0xFF, sizeof(ppu->framebuffer));
+#define LCDC_ON (1 << 7)
+
+#define STAT_LYC_FLAG (1 << 2)
+#define STAT_HBLANK   (1 << 3)
+#define STAT_VBLANK   (1 << 4)
+#define STAT_OAM      (1 << 5)
+#define STAT_LYC      (1 << 6)
+
+
+bool ppu_lcd_on(const PPU* ppu) {
+    return ppu->mmu->io[0x40] & LCDC_ON;
+}
+
+
+// Publishes LY, mode and LY=LYC to the registers and raises STAT on a rising
+// edge of the combined signal: a source that turns on while another one is
+// already active does not interrupt again.
+static void ppu_update_stat(PPU* ppu) {
+    uint8_t* io = ppu->mmu->io;
+    bool lcd = ppu_lcd_on(ppu);
+
+    io[0x44] = (uint8_t) ppu->scanline;
+    bool coincidence = lcd && io[0x44] == io[0x45];
+    io[0x41] = 0x80 | (io[0x41] & 0x78) | (coincidence ? STAT_LYC_FLAG : 0) | (lcd ? ppu->mode : 0);
+
+    uint8_t stat = io[0x41];
+    bool line = lcd && (((stat & STAT_LYC) && coincidence)
+                        || ((stat & STAT_HBLANK) && ppu->mode == 0)
+                        || ((stat & STAT_VBLANK) && ppu->mode == 1)
+                        || ((stat & STAT_OAM) && ppu->mode == 2));
+
+    if (line && !ppu->stat_line) mmu_request_interrupt(ppu->mmu, INT_STAT);
+    ppu->stat_line = line;
+}
+
+
+static void ppu_schedule(PPU* ppu) {
+    uint64_t at;
+    switch (ppu->mode) {
+        case 2:  at = ppu->line_start + PPU_MODE2_DOTS; break;
+        case 3:  at = ppu->line_start + PPU_MODE2_DOTS + PPU_MODE3_DOTS; break;
+        default: at = ppu->line_start + PPU_LINE_DOTS; break;
+    }
+    scheduler_set(ppu->sched, EVENT_PPU, at);
+}
+
+
+static void ppu_start(PPU* ppu, uint64_t at) {
     ppu->scanline = 0;
-    ppu->dots = 0;
-    ppu->mode = 0;
+    ppu->mode = 2;
+    ppu->line_start = at;
+    ppu_update_stat(ppu);
+    ppu_schedule(ppu);
+}
+
+
+// Background only, fixed maps: tiles at 8000, map at 9800. The line is drawn
+// aside and only stored, and marked dirty, if it differs from the last frame.
+static void ppu_draw_line(PPU* ppu, int y, const uint8_t* regs, const uint8_t* const* vram) {
+    uint32_t row[SCREEN_WIDTH];
+    uint8_t scy = regs[0x02];
+    uint8_t scx = regs[0x03];
+
+    int bg_y = (y + scy) & 0xFF;
+    int map_row = 0x1800 + (bg_y / 8) * 32;
+
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        int bg_x = (x + scx) & 0xFF;
+
+        int map = map_row + bg_x / 8;
+        int tile_index = vram[map >> MMU_PAGE_SHIFT][map & (MMU_PAGE_SIZE - 1)];
+
+        int tile_addr = tile_index * 16;
+        const uint8_t* tile = vram[tile_addr >> MMU_PAGE_SHIFT] + (tile_addr & (MMU_PAGE_SIZE - 1));
+
+        uint8_t color_index = get_tile_pixel(tile, bg_x % 8, bg_y % 8);
+        row[x] = DMG_PALETTE[color_index];
+    }
+
+    if (memcmp(ppu->framebuffer[y], row, sizeof(row)) != 0) {
+        memcpy(ppu->framebuffer[y], row, sizeof(row));
+        ppu->dirty[y / 32] |= 1u << (y % 32);
+    }
+}
+
+
+static void ppu_pipeline_push(PpuPipeline* p, const PpuCommand* cmd);
+
+
+// Start of mode 3: the line is drawn with the registers and VRAM of this moment
+static void ppu_line(PPU* ppu) {
+    int y = ppu->scanline;
+
+    if (ppu->pipeline) {
+        PpuCommand cmd = { PPU_CMD_LINE, (uint8_t) y, 0, { 0 } };
+        memcpy(cmd.regs, &ppu->mmu->io[0x40], sizeof(cmd.regs));
+        ppu_pipeline_push(ppu->pipeline, &cmd);
+        return;
+    }
+
+    const uint8_t* vram[PPU_VRAM_PAGES];
+    for (int i = 0; i < PPU_VRAM_PAGES; i++) {
+        vram[i] = mmu_page(ppu->mmu, MMU_RAM_PAGE + i);
+    }
+    ppu_draw_line(ppu, y, &ppu->mmu->io[0x40], vram);
+}
+
+
+void ppu_init(PPU* ppu, uint32_t (*framebuffer)[SCREEN_WIDTH], Scheduler* sched, MMU* mmu) {
+    ppu->sched = sched;
+    ppu->mmu = mmu;
+    // The render thread may still be drawing queued lines into the buffer
+    if (ppu->pipeline) ppu_pipeline_sync(ppu);
+
+    memset(framebuffer, 0xFF, SCREEN_HEIGHT * sizeof(framebuffer[0]));
+    ppu->framebuffer = framebuffer;
+    for (int y = 0; y < SCREEN_HEIGHT; y++) ppu->dirty[y / 32] |= 1u << (y % 32);
+    ppu->stat_line = false;
+    ppu->render = true;
+
+    // Состояние после boot ROM: LCD включён, BG включён, BGP = FC
+    mmu->io[0x40] = 0x91;
+    mmu->io[0x47] = 0xFC;
+    ppu_start(ppu, sched->now);
+}
+
+
+int ppu_color_index(uint32_t rgba) {
+    int index = 0;
+    while (index < 3 && DMG_PALETTE[index] != rgba) index++;
+    return index;
 }
 
 
-void ppu_step(PPU* ppu, MMU* mmu, int cycles) {
-    ppu->dots += cycles;
+bool ppu_event(PPU* ppu, uint64_t when) {
+    bool vblank = false;
+    switch (ppu->mode) {
+        case 2:
+            ppu->mode = 3;
+            if (ppu->render) ppu_line(ppu);
+            break;
+        case 3:
+            ppu->mode = 0;
+            break;
+        default:
+            ppu->line_start = when;
+            ppu->scanline++;
+            if (ppu->scanline == SCREEN_HEIGHT) {
+                ppu->mode = 1;
+                mmu_request_interrupt(ppu->mmu, INT_VBLANK);
+                vblank = true;
+            } else if (ppu->scanline == PPU_LINES) {
+                ppu->scanline = 0;
+                ppu->mode = 2;
+            } else if (ppu->mode == 0) {
+                ppu->mode = 2;
+            }
+            break;
+    }
+
+    ppu_update_stat(ppu);
+    ppu_schedule(ppu);
+    return vblank;
+}
 
-    if (ppu->dots >= 456) {
-        ppu->dots -= 456;
-        ppu->scanline++;
 
-        mmu_write8(mmu, 0xFF44, ppu->scanline);
+void ppu_write(PPU* ppu, uint16_t addr, uint8_t val) {
+    uint8_t* io = ppu->mmu->io;
 
-        if (ppu->scanline == 144) {
-            ppu->mode = 1;
-            // Можно триггерить прерывание
-            // TODO: raise_interrupt(INT_VBLANK)
-        } else if (ppu->scanline > 153) {
-            ppu->scanline = 0;
-            ppu->mode = 2; // OAM scan
+    switch (addr) {
+        case 0xFF40: {
+            bool was_on = ppu_lcd_on(ppu);
+            io[0x40] = val;
+            if (was_on && !(val & LCDC_ON)) {
+                // LY = 0, mode 0, и никаких событий до включения
+                ppu->scanline = 0;
+                ppu->mode = 0;
+                scheduler_cancel(ppu->sched, EVENT_PPU);
+                ppu_update_stat(ppu);
+            } else if (!was_on && (val & LCDC_ON)) {
+                ppu_start(ppu, ppu->sched->now);
+            }
+            return;
         }
+        case 0xFF41:
+            io[0x41] = (io[0x41] & 0x87) | (val & 0x78);
+            break;
+        case 0xFF44:
+            return; // только чтение
+        default:
+            io[addr - 0xFF00] = val;
+            break;
+    }
+
+    ppu_update_stat(ppu);
+}
+
+
+// ---------------------------------------------------------------- render thread
+
+static void* ppu_worker(void* arg) {
+    PPU* ppu = arg;
+    PpuPipeline* p = ppu->pipeline;
 
-        if (ppu->scanline < 144) {
-            // Только активные линии — отрисовываем
-            // TODO: ppu_render_scanline()
+    const uint8_t* vram[PPU_VRAM_PAGES];
+    for (int i = 0; i < PPU_VRAM_PAGES; i++) {
+        vram[i] = p->vram + i * MMU_PAGE_SIZE;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        uint32_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&p->head, memory_order_acquire);
+
+        if (tail == head) {
+            pthread_cond_broadcast(&p->idle);
+            if (p->stop) break;
+
+            // Флаг ставится до повторной проверки head: либо мы увидим новую
+            // команду, либо производитель увидит флаг и разбудит нас
+            atomic_store(&p->sleeping, true);
+            if (atomic_load(&p->head) == tail) pthread_cond_wait(&p->wake, &p->lock);
+            atomic_store(&p->sleeping, false);
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        for (; tail != head; tail++) {
+            const PpuCommand* cmd = &p->ring[tail & (PPU_PIPE_SIZE - 1)];
+            if (cmd->kind == PPU_CMD_VRAM)
+                p->vram[cmd->addr] = cmd->value;
+            else
+                ppu_draw_line(ppu, cmd->value, cmd->regs, vram);
         }
+        atomic_store_explicit(&p->tail, tail, memory_order_release);
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+
+// Returns once the worker has caught up; it does nothing until woken again
+static void ppu_pipeline_drain(PpuPipeline* p) {
+    pthread_mutex_lock(&p->lock);
+    while (atomic_load_explicit(&p->tail, memory_order_acquire) != atomic_load(&p->head)) {
+        pthread_cond_signal(&p->wake);
+        pthread_cond_wait(&p->idle, &p->lock);
     }
+    pthread_mutex_unlock(&p->lock);
 }
 
 
-void ppu_render_frame(PPU* ppu, MMU* mmu) {
+static void ppu_pipeline_push(PpuPipeline* p, const PpuCommand* cmd) {
+    uint32_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&p->tail, memory_order_acquire) >= PPU_PIPE_SIZE)
+        ppu_pipeline_drain(p);
 
-    uint8_t scx = mmu_read8(mmu, 0xFF43);
-    uint8_t scy = mmu_read8(mmu, 0xFF42);
+    p->ring[head & (PPU_PIPE_SIZE - 1)] = *cmd;
+    atomic_store(&p->head, head + 1);
 
-    uint16_t tilemap_addr = 0x9800;
-    uint16_t tiledata_addr = 0x8000;
+    // Записи в VRAM ждут ближайшей строки; занятый поток сам увидит новые
+    if (cmd->kind == PPU_CMD_LINE && atomic_load(&p->sleeping)) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_signal(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
 
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
-            int bg_x = (x + scx) & 0xFF;
-            int bg_y = (y + scy) & 0xFF;
 
-            int map_x = bg_x / 8;
-            int map_y = bg_y / 8;
-            int tile_index = mmu_read8(mmu, tilemap_addr + map_y * 32 + map_x);
+void ppu_pipeline_vram(PPU* ppu, uint16_t addr, uint8_t val) {
+    PpuCommand cmd = { PPU_CMD_VRAM, val, (uint16_t) (addr - 0x8000), { 0 } };
+    ppu_pipeline_push(ppu->pipeline, &cmd);
+}
 
-            uint16_t tile_addr = tiledata_addr + tile_index * 16;
-            uint8_t* tile = &mmu->vram[tile_addr - 0x8000];
 
-            int pixel_x = bg_x % 8;
-            int pixel_y = bg_y % 8;
+void ppu_pipeline_sync(PPU* ppu) {
+    PpuPipeline* p = ppu->pipeline;
+    ppu_pipeline_drain(p);
+    for (int i = 0; i < PPU_VRAM_PAGES; i++) {
+        memcpy(p->vram + i * MMU_PAGE_SIZE, mmu_page(ppu->mmu, MMU_RAM_PAGE + i), MMU_PAGE_SIZE);
+    }
+}
 
-            uint8_t color_index = get_tile_pixel(tile, pixel_x, pixel_y);
-            uint32_t color = DMG_PALETTE[color_index];
 
-            ppu->framebuffer[y][x] = color;
-        }
+bool ppu_pipeline_start(PPU* ppu) {
+    if (ppu->pipeline) return true;
+
+    PpuPipeline* p = calloc(1, sizeof(PpuPipeline));
+    if (p == NULL) return false;
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->idle, NULL);
+    ppu->pipeline = p;
+    ppu_pipeline_sync(ppu);
+
+    if (pthread_create(&p->thread, NULL, ppu_worker, ppu) != 0) {
+        ppu->pipeline = NULL;
+        free(p);
+        return false;
     }
-}
\ No newline at end of file
+    return true;
+}
+
+
+void ppu_pipeline_stop(PPU* ppu) {
+    PpuPipeline* p = ppu->pipeline;
+    if (p == NULL) return;
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    pthread_cond_destroy(&p->idle);
+    free(p);
+    ppu->pipeline = NULL;
+}
+
+
+void ppu_finish_frame(PPU* ppu) {
+    if (ppu->pipeline) ppu_pipeline_drain(ppu->pipeline);
+}
+
+
+void ppu_take_dirty(PPU* ppu, uint32_t* mask) {
+    memcpy(mask, ppu->dirty, sizeof(ppu->dirty));
+    memset(ppu->dirty, 0, sizeof(ppu->dirty));
+}
@@ -2,20 +2,91 @@
 #define PPU_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include "mmu.h"
+#include "scheduler.h"
 
 #define SCREEN_WIDTH 160
 #define SCREEN_HEIGHT 144
 
+#define PPU_LINE_DOTS  456
+#define PPU_MODE2_DOTS 80
+#define PPU_MODE3_DOTS 172 // без учёта SCX и спрайтов
+#define PPU_LINES      154
+
+#define PPU_VRAM_SIZE  0x2000
+#define PPU_VRAM_PAGES (PPU_VRAM_SIZE >> MMU_PAGE_SHIFT)
+#define PPU_PIPE_SIZE  16384 // commands, степень двойки
+#define PPU_DIRTY_WORDS ((SCREEN_HEIGHT + 31) / 32)
+
+enum {
+    PPU_CMD_LINE,        // draw line `value` with `regs`
+    PPU_CMD_VRAM         // VRAM byte `addr` (0000-1FFF) became `value`
+};
+
 typedef struct {
-    uint32_t framebuffer[SCREEN_HEIGHT][SCREEN_WIDTH]; // RGBA
-    int scanline;   // 0–153
-    int dots;       // 0–456
-    int mode;       // 0: HBlank, 1: VBlank, 2: OAM, 3: Drawing
+    uint8_t kind;
+    uint8_t value;
+    uint16_t addr;
+    uint8_t regs[12];    // FF40-FF4B at the start of mode 3
+} PpuCommand;
+
+// Render thread: the emulation thread logs VRAM writes and the registers of
+// each line in order; the worker replays them against its own VRAM copy, so
+// every line sees exactly what it would have seen drawn in place.
+typedef struct PpuPipeline {
+    PpuCommand ring[PPU_PIPE_SIZE];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint8_t vram[PPU_VRAM_SIZE];  // worker-only, except while drained
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;          // worker: a line was queued, or stop
+    pthread_cond_t idle;          // ring drained
+    _Atomic bool sleeping;        // worker is (about to be) waiting on `wake`
+    bool stop;
+} PpuPipeline;
+
+// LCDC/STAT/LY/LYC (0xFF40-0xFF45) live in mmu->io; the PPU keeps LY and the
+// STAT mode and coincidence bits there up to date.
+// Nothing is stepped per instruction: every mode change is an EVENT_PPU at a
+// precomputed cycle, and with the LCD off no event is pending at all.
+typedef struct {
+    int scanline;        // 0–153
+    int mode;            // 0: HBlank, 1: VBlank, 2: OAM, 3: Drawing
+    uint64_t line_start; // cycle at which the current line began
+    bool stat_line;      // OR of the enabled STAT sources; interrupts fire on its rising edge
+    bool render;         // draw lines this frame
+    PpuPipeline* pipeline; // render thread, NULL: lines are drawn in place
+    uint32_t (*framebuffer)[SCREEN_WIDTH]; // RGBA, GameBoy.framebuffer
+    uint32_t dirty[PPU_DIRTY_WORDS]; // rows whose pixels changed since ppu_take_dirty;
+                                     // the render thread's until ppu_finish_frame
+
+    Scheduler* sched;
+    MMU* mmu;
 } PPU;
 
-void ppu_init(PPU* ppu);
-void ppu_step(PPU* ppu, MMU* mmu, int cycles);
-void ppu_render_frame(PPU* ppu, MMU* mmu);
+void ppu_init(PPU* ppu, uint32_t (*framebuffer)[SCREEN_WIDTH], Scheduler* sched, MMU* mmu);
+void ppu_write(PPU* ppu, uint16_t addr, uint8_t val);
+// EVENT_PPU handler: the mode change due at `when`. True when it is the
+// start of VBlank, i.e. line 143 was the last one of the frame.
+bool ppu_event(PPU* ppu, uint64_t when);
+bool ppu_lcd_on(const PPU* ppu);
+// Palette index (0-3) that a framebuffer colour was drawn from
+int ppu_color_index(uint32_t rgba);
+
+// Render thread control. ppu_finish_frame waits for queued lines to be drawn;
+// ppu_pipeline_sync also refreshes the worker's VRAM after memory was replaced
+// wholesale (state load, reset).
+bool ppu_pipeline_start(PPU* ppu);
+void ppu_pipeline_stop(PPU* ppu);
+void ppu_pipeline_vram(PPU* ppu, uint16_t addr, uint8_t val);
+void ppu_pipeline_sync(PPU* ppu);
+void ppu_finish_frame(PPU* ppu);
+// Moves the dirty row mask to `mask`; after ppu_finish_frame
+void ppu_take_dirty(PPU* ppu, uint32_t* mask);
 
 #endif
\ No newline at end of file
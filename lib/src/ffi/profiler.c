@@ -0,0 +1,341 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "profiler.h"
+#include "gameboy.h"
+#include "rom.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_TABLE_INITIAL 1024
+#define PROFILE_NAME_MAX      128
+
+
+// Без MBC: 4000-7FFF всегда банк 1, остальное банк 0
+static ProfileLoc profile_loc(uint16_t addr) {
+    uint32_t bank = addr >= 0x4000 && addr < 0x8000 ? 1 : 0;
+    return bank << 16 | addr;
+}
+
+
+void profile_call(Profiler* p, uint16_t target, uint16_t ret) {
+    if (p->depth < PROFILE_MAX_DEPTH) {
+        p->stack[p->depth].target = profile_loc(target);
+        p->stack[p->depth].ret = ret;
+    }
+    p->depth++;
+}
+
+
+// Pops up to the frame that returns to `pc`. A RET that matches no frame
+// (a hand-built jump through the stack) leaves the shadow stack alone.
+void profile_ret(Profiler* p, uint16_t pc) {
+    int top = p->depth < PROFILE_MAX_DEPTH ? p->depth : PROFILE_MAX_DEPTH;
+    if (p->depth > top) {
+        p->depth--; // вне окна: адрес возврата неизвестен
+        return;
+    }
+    for (int i = top - 1; i >= 0; i--) {
+        if (p->stack[i].ret == pc) {
+            p->depth = i;
+            return;
+        }
+    }
+}
+
+
+static uint64_t stack_hash(const ProfileLoc* locs, uint32_t n) {
+    uint64_t hash = rom_hash_seeded(locs, n * sizeof(ProfileLoc), ROM_HASH_SEED);
+    return hash ? hash : 1;
+}
+
+
+static ProfileStack* table_find(ProfileStack* table, uint32_t size, const ProfileLoc* frames,
+                                uint64_t hash, const ProfileLoc* locs, uint32_t n) {
+    uint32_t i = (uint32_t) hash & (size - 1);
+    while (table[i].hash != 0) {
+        ProfileStack* s = &table[i];
+        if (s->hash == hash && s->depth == n && memcmp(frames + s->frames, locs, n * sizeof(ProfileLoc)) == 0)
+            return s;
+        i = (i + 1) & (size - 1);
+    }
+    return &table[i];
+}
+
+
+static bool table_grow(Profiler* p) {
+    uint32_t size = p->table_size ? p->table_size * 2 : PROFILE_TABLE_INITIAL;
+    ProfileStack* table = calloc(size, sizeof(ProfileStack));
+    if (table == NULL) return false;
+
+    for (uint32_t i = 0; i < p->table_size; i++) {
+        ProfileStack* s = &p->table[i];
+        if (s->hash == 0) continue;
+        *table_find(table, size, p->frames, s->hash, p->frames + s->frames, s->depth) = *s;
+    }
+    free(p->table);
+    p->table = table;
+    p->table_size = size;
+    return true;
+}
+
+
+void profile_sample(Profiler* p, uint16_t pc, uint64_t now) {
+    p->last = now;
+    p->samples++;
+
+    ProfileLoc locs[PROFILE_MAX_DEPTH + 1];
+    uint32_t n = p->depth < PROFILE_MAX_DEPTH ? p->depth : PROFILE_MAX_DEPTH;
+    for (uint32_t i = 0; i < n; i++) {
+        locs[i] = p->stack[i].target;
+    }
+    locs[n++] = profile_loc(pc);
+
+    uint64_t hash = stack_hash(locs, n);
+    if (p->used * 4 >= p->table_size * 3 && !table_grow(p)) return;
+
+    ProfileStack* s = table_find(p->table, p->table_size, p->frames, hash, locs, n);
+    if (s->hash == 0) {
+        if (p->frames_used + n > p->frames_cap) {
+            uint32_t cap = p->frames_cap ? p->frames_cap * 2 : 4096;
+            ProfileLoc* frames = realloc(p->frames, cap * sizeof(ProfileLoc));
+            if (frames == NULL) return;
+            p->frames = frames;
+            p->frames_cap = cap;
+        }
+        memcpy(p->frames + p->frames_used, locs, n * sizeof(ProfileLoc));
+        s->hash = hash;
+        s->frames = p->frames_used;
+        s->depth = n;
+        p->frames_used += n;
+        p->used++;
+    }
+    s->count++;
+}
+
+
+Profiler* gb_profile_start(GameBoy* gb, uint32_t interval) {
+    if (gb->profile != NULL) return NULL;
+
+    Profiler* p = calloc(1, sizeof(Profiler));
+    if (p == NULL || !table_grow(p)) {
+        free(p);
+        return NULL;
+    }
+
+    p->gb = gb;
+    p->interval = interval > 0 ? interval : 1024;
+    p->last = gb->sched.now;
+
+    gb->profile = p;
+    if (!gb->hidden) gb->cpu.profile = p;
+    return p;
+}
+
+
+void gb_profile_stop(Profiler* p) {
+    if (p == NULL) return;
+    p->gb->profile = NULL;
+    p->gb->cpu.profile = NULL;
+
+    for (uint32_t i = 0; i < p->symbol_count; i++) {
+        free(p->symbols[i].name);
+    }
+    free(p->symbols);
+    free(p->table);
+    free(p->frames);
+    free(p);
+}
+
+
+uint64_t gb_profile_samples(Profiler* p) {
+    return p->samples;
+}
+
+
+static int symbol_cmp(const void* a, const void* b) {
+    ProfileLoc x = ((const ProfileSymbol*) a)->loc;
+    ProfileLoc y = ((const ProfileSymbol*) b)->loc;
+    return x < y ? -1 : x > y;
+}
+
+
+// RGBDS ("BB:AAAA Name" lines, ';' comments) and WLA DX ([labels] section
+// of the same form; other sections skipped)
+bool gb_profile_load_symbols(Profiler* p, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return false;
+
+    char line[512];
+    bool labels = true;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '[') {
+            labels = strncmp(line, "[labels]", 8) == 0;
+            continue;
+        }
+
+        unsigned bank, addr;
+        char name[PROFILE_NAME_MAX];
+        if (!labels || sscanf(line, "%x:%x %127s", &bank, &addr, name) != 3 || addr > 0xFFFF)
+            continue;
+
+        if ((p->symbol_count & (p->symbol_count - 1)) == 0) {
+            uint32_t cap = p->symbol_count ? p->symbol_count * 2 : 64;
+            ProfileSymbol* symbols = realloc(p->symbols, cap * sizeof(ProfileSymbol));
+            if (symbols == NULL) break;
+            p->symbols = symbols;
+        }
+        p->symbols[p->symbol_count].loc = (bank & 0xFFFF) << 16 | addr;
+        p->symbols[p->symbol_count].name = strdup(name);
+        p->symbol_count++;
+    }
+    fclose(f);
+
+    qsort(p->symbols, p->symbol_count, sizeof(ProfileSymbol), symbol_cmp);
+    return true;
+}
+
+
+// Nearest symbol at or below `loc` in the same bank, -1 if none
+static int symbol_find(Profiler* p, ProfileLoc loc) {
+    int lo = 0, hi = (int) p->symbol_count - 1, found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (p->symbols[mid].loc <= loc) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (found >= 0 && p->symbols[found].loc >> 16 != loc >> 16) return -1;
+    return found;
+}
+
+
+// Symbolized locations group under the symbol's own loc
+static ProfileLoc symbol_key(Profiler* p, ProfileLoc loc) {
+    int i = symbol_find(p, loc);
+    return i >= 0 ? p->symbols[i].loc : loc;
+}
+
+
+static const char* symbol_name(Profiler* p, ProfileLoc key, char* buf) {
+    int i = symbol_find(p, key);
+    if (i >= 0 && p->symbols[i].loc == key) return p->symbols[i].name;
+    snprintf(buf, PROFILE_NAME_MAX, "%02X:%04X", key >> 16, key & 0xFFFF);
+    return buf;
+}
+
+
+typedef struct {
+    ProfileLoc key;
+    uint64_t self;
+    uint64_t total;
+} ProfileEntry;
+
+
+static int entry_key_cmp(const void* a, const void* b) {
+    ProfileLoc x = ((const ProfileEntry*) a)->key;
+    ProfileLoc y = ((const ProfileEntry*) b)->key;
+    return x < y ? -1 : x > y;
+}
+
+
+static int entry_self_cmp(const void* a, const void* b) {
+    uint64_t x = ((const ProfileEntry*) a)->self;
+    uint64_t y = ((const ProfileEntry*) b)->self;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+
+void gb_profile_report(Profiler* p, FILE* out, int top) {
+    ProfileEntry* entries = malloc((p->frames_used + 1) * sizeof(ProfileEntry));
+    if (entries == NULL) return;
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < p->table_size; i++) {
+        ProfileStack* s = &p->table[i];
+        if (s->hash == 0) continue;
+
+        uint32_t first = count;
+        for (uint32_t d = 0; d < s->depth; d++) {
+            ProfileLoc key = symbol_key(p, p->frames[s->frames + d]);
+            bool leaf = d == s->depth - 1;
+
+            // Рекурсия считается в total один раз
+            uint32_t j = first;
+            while (j < count && entries[j].key != key) j++;
+            if (j == count) entries[count++] = (ProfileEntry) { key, 0, s->count };
+            if (leaf) entries[j].self += s->count;
+        }
+    }
+
+    qsort(entries, count, sizeof(ProfileEntry), entry_key_cmp);
+    uint32_t merged = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (merged > 0 && entries[merged - 1].key == entries[i].key) {
+            entries[merged - 1].self += entries[i].self;
+            entries[merged - 1].total += entries[i].total;
+        } else {
+            entries[merged++] = entries[i];
+        }
+    }
+    qsort(entries, merged, sizeof(ProfileEntry), entry_self_cmp);
+
+    double scale = p->samples ? 100.0 / p->samples : 0;
+    fprintf(out, "%llu samples, one every %u cycles\n\n", (unsigned long long) p->samples, p->interval);
+    fprintf(out, "  self %%  total %%  symbol\n");
+    for (uint32_t i = 0; i < merged && (int) i < top; i++) {
+        char buf[PROFILE_NAME_MAX];
+        fprintf(out, "  %6.2f  %7.2f  %s\n", entries[i].self * scale, entries[i].total * scale,
+                symbol_name(p, entries[i].key, buf));
+    }
+    free(entries);
+}
+
+
+typedef struct {
+    char* text;
+    uint64_t count;
+} FoldedLine;
+
+
+static int folded_cmp(const void* a, const void* b) {
+    return strcmp(((const FoldedLine*) a)->text, ((const FoldedLine*) b)->text);
+}
+
+
+// Brendan Gregg's folded format: "root;caller;leaf count", one line per stack
+void gb_profile_write_folded(Profiler* p, FILE* out) {
+    FoldedLine* lines = malloc((p->used + 1) * sizeof(FoldedLine));
+    if (lines == NULL) return;
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < p->table_size; i++) {
+        ProfileStack* s = &p->table[i];
+        if (s->hash == 0) continue;
+
+        char* text = malloc(s->depth * PROFILE_NAME_MAX + 1);
+        if (text == NULL) continue;
+        size_t len = 0;
+        for (uint32_t d = 0; d < s->depth; d++) {
+            char buf[PROFILE_NAME_MAX];
+            const char* name = symbol_name(p, symbol_key(p, p->frames[s->frames + d]), buf);
+            len += sprintf(text + len, d ? ";%s" : "%s", name);
+        }
+        lines[count++] = (FoldedLine) { text, s->count };
+    }
+
+    // Разные PC внутри одной функции дают одинаковые строки
+    qsort(lines, count, sizeof(FoldedLine), folded_cmp);
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t n = lines[i].count;
+        while (i + 1 < count && strcmp(lines[i].text, lines[i + 1].text) == 0) {
+            free(lines[i].text);
+            n += lines[++i].count;
+        }
+        fprintf(out, "%s %llu\n", lines[i].text, (unsigned long long) n);
+        free(lines[i].text);
+    }
+    free(lines);
+}
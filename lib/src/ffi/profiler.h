@@ -0,0 +1,58 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "_gb.h"
+
+#define PROFILE_MAX_DEPTH 64
+
+// Frame or sample location: bank << 16 | address
+typedef uint32_t ProfileLoc;
+
+typedef struct {
+    ProfileLoc target;       // called address
+    uint16_t ret;            // where the matching RET goes
+} ProfileFrame;
+
+// One distinct call stack, leaf (sampled PC) last
+typedef struct {
+    uint64_t hash;           // 0: empty slot
+    uint32_t frames;         // offset into `frames`
+    uint32_t depth;
+    uint64_t count;
+} ProfileStack;
+
+typedef struct {
+    ProfileLoc loc;
+    char* name;
+} ProfileSymbol;
+
+struct Profiler {
+    GameBoy* gb;
+    uint32_t interval;
+    uint64_t last;           // cycle of the last sample
+    uint64_t samples;
+
+    // Shadow call stack; frames past PROFILE_MAX_DEPTH are only counted
+    ProfileFrame stack[PROFILE_MAX_DEPTH];
+    int depth;
+
+    // Samples aggregated per distinct stack, open addressing
+    ProfileStack* table;
+    uint32_t table_size;     // степень двойки
+    uint32_t used;
+    ProfileLoc* frames;
+    uint32_t frames_used;
+    uint32_t frames_cap;
+
+    ProfileSymbol* symbols;  // sorted by loc
+    uint32_t symbol_count;
+};
+
+void profile_call(Profiler* p, uint16_t target, uint16_t ret);
+void profile_ret(Profiler* p, uint16_t pc);
+void profile_sample(Profiler* p, uint16_t pc, uint64_t now);
+
+#endif
@@ -0,0 +1,297 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "recorder.h"
+#include "host_time.h"
+#include "gameboy.h"
+#include "rle.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REC_FPS 60
+
+
+static size_t image_bytes(const RecImage* img) {
+    return img->indexed ? REC_PIXELS : REC_PIXELS * 4;
+}
+
+
+// Palette indices, keeping the colours of `prev` at their indices so that
+// consecutive frames stay XOR-comparable. Falls back to a fresh palette, then
+// to raw RGBA, when there are more than 256 colours.
+static void image_from_pixels(RecImage* img, const RecImage* prev, const uint32_t* px) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        img->indexed = true;
+        img->colors = 0;
+        if (attempt == 0 && prev->indexed) {
+            img->colors = prev->colors;
+            memcpy(img->palette, prev->palette, prev->colors * sizeof(uint32_t));
+        }
+
+        uint32_t last = 0;
+        int last_index = -1;
+        int i = 0;
+        for (; i < REC_PIXELS; i++) {
+            if (px[i] != last || last_index < 0) {
+                int c = 0;
+                while (c < img->colors && img->palette[c] != px[i]) c++;
+                if (c == img->colors) {
+                    if (c == 256) break;
+                    img->palette[img->colors++] = px[i];
+                }
+                last = px[i];
+                last_index = c;
+            }
+            img->data[i] = (uint8_t) last_index;
+        }
+        if (i == REC_PIXELS) return;
+    }
+
+    img->indexed = false;
+    img->colors = 0;
+    memcpy(img->data, px, REC_PIXELS * 4);
+}
+
+
+// Delta frames need the same format and, for indices, an extended palette
+static bool image_follows(bool indexed, int colors, const uint32_t* palette, const RecImage* prev) {
+    if (indexed != prev->indexed) return false;
+    if (!indexed) return true;
+    return colors >= prev->colors
+        && memcmp(palette, prev->palette, prev->colors * sizeof(uint32_t)) == 0;
+}
+
+
+static void encode_frame(Recorder* rec, const uint32_t* px) {
+    RecImage* img = &rec->images[rec->current];
+    RecImage* prev = &rec->images[rec->current ^ 1];
+    image_from_pixels(img, prev, px);
+
+    bool key = rec->since_key == 0 || rec->since_key >= rec->keyframe_interval
+            || !image_follows(img->indexed, img->colors, img->palette, prev);
+    size_t size = image_bytes(img);
+
+    // XOR in place into the previous image, which is not needed afterwards
+    const uint8_t* src = img->data;
+    if (!key) {
+        for (size_t i = 0; i < size; i++) prev->data[i] ^= img->data[i];
+        src = prev->data;
+    }
+
+    size_t packed = rle_encode(src, size, rec->packed);
+    RecFrame frame = { (uint32_t) packed, 0, 0, 0 };
+    if (key) frame.flags |= REC_KEY;
+    if (img->indexed) {
+        frame.flags |= REC_INDEXED;
+        frame.colors = (uint8_t) (img->colors - 1);
+    }
+
+    size_t written = fwrite(&frame, sizeof(frame), 1, rec->file) * sizeof(frame);
+    if (img->indexed) written += fwrite(img->palette, sizeof(uint32_t), img->colors, rec->file) * sizeof(uint32_t);
+    written += fwrite(rec->packed, 1, packed, rec->file);
+    if (written != sizeof(frame) + img->colors * sizeof(uint32_t) + packed) rec->failed = true;
+
+    rec->since_key = key ? 1 : rec->since_key + 1;
+    rec->current ^= 1;
+
+    pthread_mutex_lock(&rec->lock);
+    rec->frames++;
+    rec->bytes += written;
+    pthread_mutex_unlock(&rec->lock);
+}
+
+
+static void* recorder_worker(void* arg) {
+    Recorder* rec = arg;
+
+    pthread_mutex_lock(&rec->lock);
+    for (;;) {
+        uint32_t tail = atomic_load_explicit(&rec->tail, memory_order_relaxed);
+        uint32_t head = atomic_load(&rec->head);
+
+        if (tail == head) {
+            if (rec->stop) break;
+            // The producer checks `sleeping` after publishing a frame
+            atomic_store(&rec->sleeping, true);
+            if (atomic_load(&rec->head) == tail) pthread_cond_wait(&rec->wake, &rec->lock);
+            atomic_store(&rec->sleeping, false);
+            continue;
+        }
+        pthread_mutex_unlock(&rec->lock);
+
+        double start = host_seconds();
+        encode_frame(rec, rec->raw[tail & (REC_QUEUE - 1)]);
+        double elapsed = host_seconds() - start;
+
+        atomic_store_explicit(&rec->tail, tail + 1, memory_order_release);
+        pthread_mutex_lock(&rec->lock);
+        rec->encode_seconds += elapsed;
+        pthread_cond_broadcast(&rec->idle);
+    }
+    pthread_mutex_unlock(&rec->lock);
+    return NULL;
+}
+
+
+Recorder* gb_recorder_start(GameBoy* gb, const char* path, int keyframe_interval) {
+    if (gb->recorder != NULL) return NULL;
+
+    Recorder* rec = calloc(1, sizeof(Recorder));
+    if (rec == NULL) return NULL;
+
+    rec->packed = malloc(RLE_BOUND(REC_PIXELS * 4));
+    rec->file = rec->packed ? fopen(path, "wb") : NULL;
+    if (rec->file == NULL) {
+        free(rec->packed);
+        free(rec);
+        return NULL;
+    }
+
+    RecHeader header = { REC_MAGIC, REC_VERSION, SCREEN_WIDTH, SCREEN_HEIGHT, REC_FPS };
+    if (fwrite(&header, sizeof(header), 1, rec->file) != 1) rec->failed = true;
+
+    rec->gb = gb;
+    rec->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : 600;
+    rec->bytes = sizeof(header);
+
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_cond_init(&rec->wake, NULL);
+    pthread_cond_init(&rec->idle, NULL);
+    if (pthread_create(&rec->thread, NULL, recorder_worker, rec) != 0) {
+        pthread_mutex_destroy(&rec->lock);
+        pthread_cond_destroy(&rec->wake);
+        pthread_cond_destroy(&rec->idle);
+        fclose(rec->file);
+        remove(path);
+        free(rec->packed);
+        free(rec);
+        return NULL;
+    }
+
+    gb->recorder = rec;
+    return rec;
+}
+
+
+void recorder_push(Recorder* rec, const uint32_t* framebuffer) {
+    uint32_t head = atomic_load_explicit(&rec->head, memory_order_relaxed);
+
+    // Lossless: wait for the encoder rather than drop the frame
+    if (head - atomic_load_explicit(&rec->tail, memory_order_acquire) >= REC_QUEUE) {
+        rec->stalls++;
+        pthread_mutex_lock(&rec->lock);
+        while (head - atomic_load(&rec->tail) >= REC_QUEUE) {
+            pthread_cond_wait(&rec->idle, &rec->lock);
+        }
+        pthread_mutex_unlock(&rec->lock);
+    }
+
+    memcpy(rec->raw[head & (REC_QUEUE - 1)], framebuffer, sizeof(rec->raw[0]));
+    atomic_store(&rec->head, head + 1);
+
+    if (atomic_load(&rec->sleeping)) {
+        pthread_mutex_lock(&rec->lock);
+        pthread_cond_signal(&rec->wake);
+        pthread_mutex_unlock(&rec->lock);
+    }
+}
+
+
+void gb_recorder_stats(Recorder* rec, RecorderStats* stats) {
+    pthread_mutex_lock(&rec->lock);
+    stats->frames = rec->frames;
+    stats->bytes = rec->bytes;
+    stats->encode_us_per_frame = rec->frames ? rec->encode_seconds * 1e6 / rec->frames : 0;
+    pthread_mutex_unlock(&rec->lock);
+
+    stats->pending = atomic_load(&rec->head) - atomic_load(&rec->tail);
+    stats->stalls = rec->stalls;
+    stats->bytes_per_minute = stats->frames ? (double) stats->bytes * REC_FPS * 60 / stats->frames : 0;
+}
+
+
+bool gb_recorder_stop(Recorder* rec, RecorderStats* stats) {
+    if (rec == NULL) return false;
+    rec->gb->recorder = NULL;
+
+    pthread_mutex_lock(&rec->lock);
+    rec->stop = true;
+    pthread_cond_signal(&rec->wake);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->thread, NULL);
+
+    if (stats) gb_recorder_stats(rec, stats);
+    bool ok = !rec->failed && fclose(rec->file) == 0;
+
+    pthread_mutex_destroy(&rec->lock);
+    pthread_cond_destroy(&rec->wake);
+    pthread_cond_destroy(&rec->idle);
+    free(rec->packed);
+    free(rec);
+    return ok;
+}
+
+
+// ---------------------------------------------------------------- reading
+
+bool rec_open(RecReader* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+    r->file = fopen(path, "rb");
+    if (r->file == NULL) return false;
+
+    if (fread(&r->header, sizeof(r->header), 1, r->file) != 1
+        || r->header.magic != REC_MAGIC || r->header.version != REC_VERSION
+        || r->header.width != SCREEN_WIDTH || r->header.height != SCREEN_HEIGHT) {
+        fclose(r->file);
+        r->file = NULL;
+        return false;
+    }
+
+    r->packed = malloc(RLE_BOUND(REC_PIXELS * 4));
+    r->work = malloc(REC_PIXELS * 4);
+    return r->packed && r->work;
+}
+
+
+bool rec_next(RecReader* r, uint32_t* rgba) {
+    RecFrame frame;
+    if (fread(&frame, sizeof(frame), 1, r->file) != 1) return false;
+    if (frame.size > RLE_BOUND(REC_PIXELS * 4)) return false;
+
+    bool indexed = (frame.flags & REC_INDEXED) != 0;
+    int colors = indexed ? frame.colors + 1 : 0;
+    uint32_t palette[256];
+    if (fread(palette, sizeof(uint32_t), colors, r->file) != (size_t) colors) return false;
+    if (fread(r->packed, 1, frame.size, r->file) != frame.size) return false;
+
+    RecImage* img = &r->image;
+    size_t size = indexed ? REC_PIXELS : REC_PIXELS * 4;
+    bool key = (frame.flags & REC_KEY) != 0;
+    if (!key && (r->frame == 0 || !image_follows(indexed, colors, palette, img))) return false;
+    if (!rle_decode(r->packed, frame.size, r->work, size)) return false;
+
+    if (key) {
+        memcpy(img->data, r->work, size);
+    } else {
+        for (size_t i = 0; i < size; i++) img->data[i] ^= r->work[i];
+    }
+    img->indexed = indexed;
+    img->colors = colors;
+    memcpy(img->palette, palette, colors * sizeof(uint32_t));
+
+    if (img->indexed) {
+        for (int i = 0; i < REC_PIXELS; i++) rgba[i] = img->palette[img->data[i]];
+    } else {
+        memcpy(rgba, img->data, REC_PIXELS * 4);
+    }
+    r->frame++;
+    return true;
+}
+
+
+void rec_close(RecReader* r) {
+    if (r->file) fclose(r->file);
+    free(r->packed);
+    free(r->work);
+    r->file = NULL;
+    r->packed = r->work = NULL;
+}
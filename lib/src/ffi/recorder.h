@@ -0,0 +1,99 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "_gb.h"
+#include "ppu.h"
+
+// Recording file, host byte order:
+//   RecHeader
+//   per frame: RecFrame, palette (colors * uint32) if indexed, RLE payload
+// The payload decodes to one byte per pixel (palette index) when the frame
+// has at most 256 colours, RGBA words otherwise. Delta frames are XORed with
+// the previous frame, which always has the same format and palette.
+
+#define REC_MAGIC    0x43524247 // "GBRC"
+#define REC_VERSION  1
+#define REC_QUEUE    16         // raw frames waiting for the encoder, степень двойки
+#define REC_PIXELS   (SCREEN_WIDTH * SCREEN_HEIGHT)
+
+#define REC_KEY      1
+#define REC_INDEXED  2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint16_t width;
+    uint16_t height;
+    uint32_t fps;
+} RecHeader;
+
+typedef struct {
+    uint32_t size;           // RLE payload bytes
+    uint8_t flags;           // REC_KEY, REC_INDEXED
+    uint8_t colors;          // palette entries - 1, if indexed
+    uint16_t reserved;
+} RecFrame;
+
+// Encoder side of one frame: indices or RGBA, and the palette
+typedef struct {
+    bool indexed;
+    int colors;
+    uint32_t palette[256];
+    uint8_t data[REC_PIXELS * 4];
+} RecImage;
+
+struct Recorder {
+    GameBoy* gb;
+    FILE* file;
+    int keyframe_interval;
+
+    // Emulation thread -> encoder, lock-free unless the encoder sleeps
+    uint32_t raw[REC_QUEUE][REC_PIXELS];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint32_t stalls;         // pushes that had to wait for a free slot
+
+    // Encoder-only
+    RecImage images[2];      // current and previous
+    int current;
+    int since_key;
+    uint8_t* packed;
+    bool failed;
+
+    // Guarded by `lock`
+    uint64_t frames;
+    uint64_t bytes;
+    double encode_seconds;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    _Atomic bool sleeping;
+    bool stop;
+};
+
+void recorder_push(Recorder* rec, const uint32_t* framebuffer);
+
+// Sequential decoding, for tools
+typedef struct {
+    FILE* file;
+    RecHeader header;
+    RecImage image;          // last decoded frame
+    uint8_t* packed;
+    uint8_t* work;
+    uint32_t frame;
+} RecReader;
+
+bool rec_open(RecReader* r, const char* path);
+// Decodes the next frame into `rgba` (width * height words); false at the end
+// or on a damaged file
+bool rec_next(RecReader* r, uint32_t* rgba);
+void rec_close(RecReader* r);
+
+#endif
@@ -0,0 +1,273 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "rewind.h"
+#include "host_time.h"
+#include "rle.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+static RewindEntry* entry_at(Rewind* rw, uint32_t index) {
+    return &rw->entries[(rw->first + index) % REWIND_MAX_FRAMES];
+}
+
+
+// Drops the oldest keyframe and every delta that depends on it.
+// Caller holds the lock.
+static void evict_group(Rewind* rw) {
+    rw->groups--;
+    do {
+        RewindEntry* e = entry_at(rw, 0);
+        rw->bytes -= e->size;
+        free(e->data);
+        e->data = NULL;
+        rw->first = (rw->first + 1) % REWIND_MAX_FRAMES;
+        rw->count--;
+    } while (rw->count > 0 && !entry_at(rw, 0)->keyframe);
+}
+
+
+static void compress_snapshot(Rewind* rw, const uint8_t* raw) {
+    uint8_t* packed = malloc(RLE_BOUND(rw->state_size));
+    if (packed == NULL) {
+        // Кадр теряется; следующий сохранённый не должен зависеть от него
+        pthread_mutex_lock(&rw->lock);
+        rw->force_keyframe = true;
+        pthread_mutex_unlock(&rw->lock);
+        return;
+    }
+
+    pthread_mutex_lock(&rw->lock);
+    bool keyframe = rw->force_keyframe || rw->since_key >= rw->keyframe_interval;
+    rw->force_keyframe = false;
+    pthread_mutex_unlock(&rw->lock);
+
+    const uint8_t* src = raw;
+    if (keyframe) {
+        memcpy(rw->key_raw, raw, rw->state_size);
+        rw->since_key = 0;
+    } else {
+        uint8_t* x = rw->work;
+        for (size_t i = 0; i < rw->state_size; i++) {
+            x[i] = raw[i] ^ rw->key_raw[i];
+        }
+        src = x;
+    }
+    rw->since_key++;
+
+    size_t size = rle_encode(src, rw->state_size, packed);
+    uint8_t* data = realloc(packed, size);
+    if (data == NULL) data = packed;
+
+    pthread_mutex_lock(&rw->lock);
+    if (rw->count == REWIND_MAX_FRAMES) evict_group(rw);
+
+    RewindEntry* e = entry_at(rw, rw->count);
+    e->data = data;
+    e->size = (uint32_t) size;
+    e->keyframe = keyframe;
+    rw->count++;
+    rw->bytes += size;
+    if (keyframe) rw->groups++;
+
+    // The group still being filled is never evicted
+    while (rw->bytes > rw->budget && rw->groups > 1) {
+        evict_group(rw);
+    }
+    pthread_mutex_unlock(&rw->lock);
+}
+
+
+static void* rewind_worker(void* arg) {
+    Rewind* rw = arg;
+
+    pthread_mutex_lock(&rw->lock);
+    while (!rw->stop) {
+        uint32_t tail = atomic_load_explicit(&rw->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(&rw->head, memory_order_acquire);
+
+        if (tail == head) {
+            rw->busy = false;
+            pthread_cond_broadcast(&rw->idle);
+            // The producer checks `sleeping` after publishing a snapshot
+            atomic_store(&rw->sleeping, true);
+            if (atomic_load(&rw->head) == tail) pthread_cond_wait(&rw->wake, &rw->lock);
+            atomic_store(&rw->sleeping, false);
+            continue;
+        }
+
+        rw->busy = true;
+        pthread_mutex_unlock(&rw->lock);
+
+        double start = host_seconds();
+        compress_snapshot(rw, rw->raw[tail & (REWIND_QUEUE_SIZE - 1)]);
+        double elapsed = host_seconds() - start;
+
+        atomic_store_explicit(&rw->tail, tail + 1, memory_order_release);
+        pthread_mutex_lock(&rw->lock);
+        rw->compress_seconds += elapsed;
+        rw->compressed_frames++;
+    }
+    pthread_mutex_unlock(&rw->lock);
+    return NULL;
+}
+
+
+static void free_buffers(Rewind* rw) {
+    for (int i = 0; i < REWIND_QUEUE_SIZE; i++) {
+        free(rw->raw[i]);
+    }
+    free(rw->key_raw);
+    free(rw->work);
+    free(rw->restore);
+    free(rw);
+}
+
+
+Rewind* gb_rewind_create(GameBoy* gb, size_t budget, int keyframe_interval) {
+    Rewind* rw = calloc(1, sizeof(Rewind));
+    if (rw == NULL) return NULL;
+
+    rw->gb = gb;
+    rw->state_size = gb_state_size(gb);
+    rw->budget = budget;
+    rw->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : 60;
+    rw->force_keyframe = true;
+
+    bool ok = true;
+    for (int i = 0; i < REWIND_QUEUE_SIZE; i++) {
+        rw->raw[i] = malloc(rw->state_size);
+        ok = ok && rw->raw[i];
+    }
+    rw->key_raw = malloc(rw->state_size);
+    rw->work = malloc(rw->state_size);
+    rw->restore = malloc(rw->state_size);
+    if (!ok || !rw->key_raw || !rw->work || !rw->restore) {
+        free_buffers(rw);
+        return NULL;
+    }
+
+    pthread_mutex_init(&rw->lock, NULL);
+    pthread_cond_init(&rw->wake, NULL);
+    pthread_cond_init(&rw->idle, NULL);
+    if (pthread_create(&rw->thread, NULL, rewind_worker, rw) != 0) {
+        pthread_mutex_destroy(&rw->lock);
+        pthread_cond_destroy(&rw->wake);
+        pthread_cond_destroy(&rw->idle);
+        free_buffers(rw);
+        return NULL;
+    }
+    return rw;
+}
+
+
+void gb_rewind_destroy(Rewind* rw) {
+    if (rw == NULL) return;
+
+    pthread_mutex_lock(&rw->lock);
+    rw->stop = true;
+    pthread_cond_signal(&rw->wake);
+    pthread_mutex_unlock(&rw->lock);
+    pthread_join(rw->thread, NULL);
+
+    while (rw->count > 0) evict_group(rw);
+    pthread_mutex_destroy(&rw->lock);
+    pthread_cond_destroy(&rw->wake);
+    pthread_cond_destroy(&rw->idle);
+    free_buffers(rw);
+}
+
+
+bool gb_rewind_push(Rewind* rw) {
+    uint32_t head = atomic_load_explicit(&rw->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rw->tail, memory_order_acquire);
+
+    if (head - tail >= REWIND_QUEUE_SIZE) {
+        rw->dropped++;
+        return false;
+    }
+
+    gb_save_state(rw->gb, rw->raw[head & (REWIND_QUEUE_SIZE - 1)], rw->state_size);
+    atomic_store(&rw->head, head + 1);
+
+    if (atomic_load(&rw->sleeping)) {
+        pthread_mutex_lock(&rw->lock);
+        pthread_cond_signal(&rw->wake);
+        pthread_mutex_unlock(&rw->lock);
+    }
+    return true;
+}
+
+
+// Waits until every pushed snapshot is in `entries`. Returns with the lock held.
+static void wait_idle_locked(Rewind* rw) {
+    pthread_mutex_lock(&rw->lock);
+    while (rw->busy || atomic_load(&rw->tail) != atomic_load(&rw->head)) {
+        pthread_cond_signal(&rw->wake);
+        pthread_cond_wait(&rw->idle, &rw->lock);
+    }
+}
+
+
+static void pop_newest(Rewind* rw) {
+    RewindEntry* e = entry_at(rw, rw->count - 1);
+    if (e->keyframe) rw->groups--;
+    rw->bytes -= e->size;
+    free(e->data);
+    e->data = NULL;
+    rw->count--;
+}
+
+
+int gb_rewind_step(Rewind* rw, int frames) {
+    wait_idle_locked(rw);
+
+    // The newest entry is the current frame: drop it, then go back. The
+    // restored entry stays as the new current frame.
+    int rewound = 0;
+    bool ok = false;
+    if (frames > 0 && rw->count > 1) {
+        pop_newest(rw);
+        rewound++;
+        while (rewound < frames && rw->count > 1) {
+            pop_newest(rw);
+            rewound++;
+        }
+
+        uint32_t index = rw->count - 1;
+        uint32_t key = index;
+        while (!entry_at(rw, key)->keyframe) key--;
+
+        RewindEntry* k = entry_at(rw, key);
+        ok = rle_decode(k->data, k->size, rw->restore, rw->state_size);
+
+        if (ok && key != index) {
+            RewindEntry* e = entry_at(rw, index);
+            ok = rle_decode(e->data, e->size, rw->work, rw->state_size);
+            for (size_t i = 0; ok && i < rw->state_size; i++) {
+                rw->restore[i] ^= rw->work[i];
+            }
+        }
+    }
+
+    // Новые кадры после перемотки начинают свою группу
+    rw->force_keyframe = true;
+    pthread_mutex_unlock(&rw->lock);
+
+    if (ok) ok = gb_load_state(rw->gb, rw->restore, rw->state_size);
+    return ok ? rewound : 0;
+}
+
+
+void gb_rewind_stats(Rewind* rw, RewindStats* stats) {
+    pthread_mutex_lock(&rw->lock);
+    stats->frames = rw->count;
+    stats->bytes = rw->bytes + (uint64_t) rw->count * sizeof(RewindEntry);
+    stats->dropped = rw->dropped;
+    stats->compress_us_per_frame = rw->compressed_frames
+            ? rw->compress_seconds * 1e6 / rw->compressed_frames : 0;
+    pthread_mutex_unlock(&rw->lock);
+
+    stats->seconds = stats->frames / 60.0;
+    stats->bytes_per_minute = stats->frames ? (double) stats->bytes * 3600.0 / stats->frames : 0;
+}
@@ -0,0 +1,63 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "_gb.h"
+
+#define REWIND_QUEUE_SIZE 8      // raw snapshots waiting for the worker, степень двойки
+#define REWIND_MAX_FRAMES 65536  // ~18 минут при 60 fps
+
+typedef struct {
+    uint8_t* data;
+    uint32_t size;
+    bool keyframe;
+} RewindEntry;
+
+// Per-frame snapshots for rewinding. The emulation thread only copies the
+// save state into a free slot; a worker thread XORs it against the group's
+// keyframe and RLE-compresses the result. Memory is bounded by evicting the
+// oldest keyframe group once the budget is exceeded.
+struct Rewind {
+    GameBoy* gb;
+    size_t state_size;
+    size_t budget;
+    int keyframe_interval;
+
+    // Emulation thread -> worker
+    uint8_t* raw[REWIND_QUEUE_SIZE];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint32_t dropped;
+
+    // Compressed frames, oldest first. Guarded by `lock`.
+    RewindEntry entries[REWIND_MAX_FRAMES];
+    uint32_t first;
+    uint32_t count;
+    size_t bytes;
+    uint32_t groups;         // keyframes stored
+    bool force_keyframe;
+
+    // Worker-only
+    uint8_t* key_raw;        // uncompressed keyframe of the newest group
+    uint8_t* work;           // XOR / compression scratch
+    int since_key;
+    double compress_seconds;   // guarded by `lock`
+    uint64_t compressed_frames;
+
+    // Rewinding side scratch
+    uint8_t* restore;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;     // worker: new snapshot or shutdown
+    pthread_cond_t idle;     // queue drained
+    _Atomic bool sleeping;   // worker is (about to be) waiting on `wake`
+    bool busy;
+    bool stop;
+};
+
+#endif
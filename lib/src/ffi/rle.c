@@ -0,0 +1,89 @@
+#include "rle.h"
+#include <string.h>
+
+
+static size_t run_length(const uint8_t* src, size_t pos, size_t size) {
+    size_t end = pos + 1;
+    while (end < size && src[end] == src[pos] && end - pos < 0xFFFF) end++;
+    return end - pos;
+}
+
+
+size_t rle_encode(const uint8_t* src, size_t size, uint8_t* dst) {
+    size_t in = 0;
+    size_t out = 0;
+    size_t literal = 0; // start of the pending literal span
+
+    while (in < size) {
+        size_t run = run_length(src, in, size);
+
+        if (run < 3) {
+            in += run;
+            // Literal spans are flushed in pieces of at most 128 bytes
+            while (in - literal >= 128) {
+                dst[out++] = 0x7F;
+                memcpy(dst + out, src + literal, 128);
+                out += 128;
+                literal += 128;
+            }
+            continue;
+        }
+
+        if (in > literal) {
+            dst[out++] = (uint8_t) (in - literal - 1);
+            memcpy(dst + out, src + literal, in - literal);
+            out += in - literal;
+        }
+
+        if (run <= 129) {
+            dst[out++] = (uint8_t) (0x80 + run - 3);
+        } else {
+            dst[out++] = 0xFF;
+            dst[out++] = run & 0xFF;
+            dst[out++] = run >> 8;
+        }
+        dst[out++] = src[in];
+
+        in += run;
+        literal = in;
+    }
+
+    if (in > literal) {
+        dst[out++] = (uint8_t) (in - literal - 1);
+        memcpy(dst + out, src + literal, in - literal);
+        out += in - literal;
+    }
+
+    return out;
+}
+
+
+bool rle_decode(const uint8_t* src, size_t src_size, uint8_t* dst, size_t size) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < src_size) {
+        uint8_t token = src[in++];
+        size_t n;
+
+        if (token < 0x80) {
+            n = token + 1;
+            if (in + n > src_size || out + n > size) return false;
+            memcpy(dst + out, src + in, n);
+            in += n;
+        } else {
+            if (token < 0xFF) {
+                n = token - 0x80 + 3;
+            } else {
+                if (in + 2 > src_size) return false;
+                n = src[in] | (src[in + 1] << 8);
+                in += 2;
+            }
+            if (in + 1 > src_size || out + n > size) return false;
+            memset(dst + out, src[in++], n);
+        }
+        out += n;
+    }
+
+    return out == size;
+}
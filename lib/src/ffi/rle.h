@@ -0,0 +1,18 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Byte-oriented run-length coding tuned for XOR deltas (long zero runs):
+//   0x00-0x7F  n+1 literal bytes follow
+//   0x80-0xFE  next byte repeated n-0x80+3 times (3..129)
+//   0xFF       16-bit LE count, then the byte repeated count times
+#define RLE_BOUND(n) ((n) + (n) / 128 + 16)
+
+size_t rle_encode(const uint8_t* src, size_t size, uint8_t* dst);
+// Fails unless the input decodes to exactly `size` bytes
+bool rle_decode(const uint8_t* src, size_t src_size, uint8_t* dst, size_t size);
+
+#endif
@@ -0,0 +1,176 @@
+#include "rom.h"
+#include "_gb.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static RomImage* registry;
+
+
+uint64_t rom_hash_seeded(const void* data, size_t size, uint64_t hash) {
+    const uint8_t* p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+
+uint64_t rom_hash(const uint8_t* data, size_t size) {
+    return rom_hash_seeded(data, size, ROM_HASH_SEED);
+}
+
+
+bool rom_parse_header(const uint8_t* data, size_t size, RomHeader* header) {
+    memset(header, 0, sizeof(*header));
+    if (size < 0x150) return false;
+
+    // CGB cartridges give the last title byte to the CGB flag
+    header->cgb_flag = data[0x143];
+    int len = header->cgb_flag & 0x80 ? 15 : 16;
+    int n = 0;
+    while (n < len && data[0x134 + n] != 0) {
+        uint8_t c = data[0x134 + n];
+        header->title[n++] = c >= 0x20 && c < 0x7F ? (char) c : '?';
+    }
+    while (n > 0 && header->title[n - 1] == ' ') n--;
+    header->title[n] = 0;
+
+    header->sgb_flag = data[0x146];
+    header->cart_type = data[0x147];
+    header->rom_size = data[0x148];
+    header->ram_size = data[0x149];
+    header->version = data[0x14C];
+    header->header_checksum = data[0x14D];
+    header->global_checksum = (uint16_t) (data[0x14E] << 8 | data[0x14F]);
+
+    uint8_t x = 0;
+    for (int i = 0x134; i <= 0x14C; i++) x = (uint8_t) (x - data[i] - 1);
+    header->header_ok = x == header->header_checksum;
+    return true;
+}
+
+
+static size_t page_bytes(size_t size, int page) {
+    size_t pos = (size_t) page << MMU_PAGE_SHIFT;
+    if (pos >= size) return 0;
+    return size - pos < MMU_PAGE_SIZE ? size - pos : MMU_PAGE_SIZE;
+}
+
+
+static bool all_zero(const uint8_t* data, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (data[i]) return false;
+    }
+    return true;
+}
+
+
+// Same hash and size; the mapped bytes are compared as well, pages left to
+// the zero page included
+static bool rom_matches(const RomImage* rom, uint64_t hash, const uint8_t* data, size_t size) {
+    if (rom->hash != hash || rom->size != size) return false;
+
+    for (int i = 0; i < ROM_PAGES; i++) {
+        size_t n = page_bytes(size, i);
+        const uint8_t* src = data + ((size_t) i << MMU_PAGE_SHIFT);
+        if (rom->pages[i] ? memcmp(rom->pages[i]->data, src, n) != 0 : !all_zero(src, n))
+            return false;
+    }
+    return true;
+}
+
+
+static void rom_free(RomImage* rom) {
+    for (int i = 0; i < ROM_PAGES; i++) {
+        MemPage* page = rom->pages[i];
+        if (page && atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1) free(page);
+    }
+    free(rom);
+}
+
+
+static RomImage* rom_create(const uint8_t* data, size_t size, uint64_t hash) {
+    RomImage* rom = calloc(1, sizeof(RomImage));
+    if (rom == NULL) return NULL;
+
+    rom->hash = hash;
+    rom->size = size;
+    rom->refs = 1;
+
+    for (int i = 0; i < ROM_PAGES; i++) {
+        size_t n = page_bytes(size, i);
+        const uint8_t* src = data + ((size_t) i << MMU_PAGE_SHIFT);
+
+        if (all_zero(src, n)) continue; // остаётся нулевой страницей
+
+        MemPage* page = mmu_page_alloc();
+        if (page == NULL) {
+            rom_free(rom);
+            return NULL;
+        }
+        memset(page->data, 0, MMU_PAGE_SIZE);
+        memcpy(page->data, src, n);
+        rom->pages[i] = page;
+    }
+    return rom;
+}
+
+
+RomImage* rom_acquire(const uint8_t* data, size_t size) {
+    uint64_t hash = rom_hash(data, size);
+
+    pthread_mutex_lock(&registry_lock);
+    RomImage* rom = registry;
+    while (rom && !rom_matches(rom, hash, data, size)) rom = rom->next;
+
+    if (rom) {
+        rom->refs++;
+    } else if ((rom = rom_create(data, size, hash)) != NULL) {
+        rom->next = registry;
+        registry = rom;
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return rom;
+}
+
+
+void rom_retain(RomImage* rom) {
+    if (rom == NULL) return;
+    pthread_mutex_lock(&registry_lock);
+    rom->refs++;
+    pthread_mutex_unlock(&registry_lock);
+}
+
+
+void rom_release(RomImage* rom) {
+    if (rom == NULL) return;
+
+    pthread_mutex_lock(&registry_lock);
+    bool last = --rom->refs == 0;
+    if (last) {
+        RomImage** link = &registry;
+        while (*link != rom) link = &(*link)->next;
+        *link = rom->next;
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    if (last) rom_free(rom);
+}
+
+
+void gb_rom_cache_stats(RomCacheStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_mutex_lock(&registry_lock);
+    for (RomImage* rom = registry; rom; rom = rom->next) {
+        stats->images++;
+        stats->users += rom->refs;
+        for (int i = 0; i < ROM_PAGES; i++) {
+            if (rom->pages[i]) stats->bytes += sizeof(MemPage);
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
@@ -0,0 +1,39 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mmu.h"
+#include "_gb.h"
+
+#define ROM_PAGES MMU_RAM_PAGE // 0000-7FFF
+
+// Read-only pages of one ROM, shared by every instance that loads the same
+// data. Entries live in a process-wide registry keyed by a hash of the whole
+// file; `refs` counts the MMUs using the entry and is guarded by the
+// registry lock. Each page also carries one reference per MMU mapping it, like
+// any other MemPage, plus one held by the entry.
+typedef struct RomImage {
+    uint64_t hash;
+    size_t size;
+    uint32_t refs;
+    MemPage* pages[ROM_PAGES]; // NULL: all zero
+    struct RomImage* next;
+} RomImage;
+
+#define ROM_HASH_SEED 0xCBF29CE484222325ULL
+
+// FNV-1a 64 continuing from `hash`, ROM_HASH_SEED to start one. The hash
+// used throughout: ROMs, movie checks, profiler stacks, tools.
+uint64_t rom_hash_seeded(const void* data, size_t size, uint64_t hash);
+// Of the whole file: registry key and RomInfo.hash
+uint64_t rom_hash(const uint8_t* data, size_t size);
+// Cartridge header at 0100-014F; false if the file is too short to have one
+bool rom_parse_header(const uint8_t* data, size_t size, RomHeader* header);
+
+// Entry for `data`, created if needed, with a reference for the caller
+RomImage* rom_acquire(const uint8_t* data, size_t size);
+void rom_retain(RomImage* rom);
+void rom_release(RomImage* rom);
+
+#endif
@@ -0,0 +1,275 @@
+#include "scale.h"
+#include "_gb.h"
+#include <string.h>
+
+// Pixels are 0xRRGGBBAA words; alpha is the low byte
+#define ALPHA 0x000000FFu
+
+
+static inline Pixels load(const uint32_t* p) {
+    Pixels v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+static inline void store(uint32_t* p, Pixels v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+
+static inline Pixels splat(uint32_t p) {
+    return (Pixels) { p, p, p, p };
+}
+
+
+// mask ? a : b, `mask` lanes all ones or all zeros
+static inline Pixels pick(Pixels mask, Pixels a, Pixels b) {
+    return (mask & a) | (~mask & b);
+}
+
+
+static bool scale_args(const uint32_t* src, int width, int height, const uint32_t* dst) {
+    return src && dst && width > 0 && height > 0 && width <= SCALE_MAX_WIDTH;
+}
+
+
+// `row` repeated `factor` times per pixel into `out`
+static void stretch_row(const uint32_t* row, int width, int factor, uint32_t* out) {
+    int x = 0;
+    if (factor == 2) {
+        for (; x + 4 <= width; x += 4) {
+            Pixels v = load(row + x);
+            store(out + 2 * x, __builtin_shufflevector(v, v, 0, 0, 1, 1));
+            store(out + 2 * x + 4, __builtin_shufflevector(v, v, 2, 2, 3, 3));
+        }
+    } else if (factor == 3) {
+        for (; x + 4 <= width; x += 4) {
+            Pixels v = load(row + x);
+            store(out + 3 * x, __builtin_shufflevector(v, v, 0, 0, 0, 1));
+            store(out + 3 * x + 4, __builtin_shufflevector(v, v, 1, 1, 2, 2));
+            store(out + 3 * x + 8, __builtin_shufflevector(v, v, 2, 3, 3, 3));
+        }
+    } else if (factor >= 4) {
+        // Two overlapping 4-pixel stores fill a cell of 4..6
+        for (; x < width; x++) {
+            Pixels v = splat(row[x]);
+            store(out + x * factor, v);
+            store(out + x * factor + factor - 4, v);
+        }
+    }
+    for (; x < width; x++) {
+        for (int i = 0; i < factor; i++) out[x * factor + i] = row[x];
+    }
+}
+
+
+bool gb_scale_nearest(const uint32_t* src, int width, int height, int factor, uint32_t* dst) {
+    if (!scale_args(src, width, height, dst) || factor < 1 || factor > SCALE_MAX_FACTOR) return false;
+
+    size_t out_width = (size_t) width * factor;
+    for (int y = 0; y < height; y++) {
+        uint32_t* out = dst + (size_t) y * factor * out_width;
+        stretch_row(src + (size_t) y * width, width, factor, out);
+        for (int i = 1; i < factor; i++) memcpy(out + i * out_width, out, out_width * sizeof(uint32_t));
+    }
+    return true;
+}
+
+
+// Row `y` with one extra pixel repeated at each edge, `pad[1]` is column 0
+static void padded_row(const uint32_t* src, int width, int height, int y, uint32_t* pad) {
+    if (y < 0) y = 0;
+    if (y >= height) y = height - 1;
+    const uint32_t* row = src + (size_t) y * width;
+    memcpy(pad + 1, row, width * sizeof(uint32_t));
+    pad[0] = row[0];
+    pad[width + 1] = row[width - 1];
+}
+
+
+// Scale2x/AdvMAME2x, 4 pixels at a time
+//   A B C      E0 E1
+//   D E F  ->  E2 E3
+//   G H I
+bool gb_scale2x(const uint32_t* src, int width, int height, uint32_t* dst) {
+    if (!scale_args(src, width, height, dst)) return false;
+
+    uint32_t rows[3][SCALE_MAX_WIDTH + 8];
+    uint32_t* above = rows[0];
+    uint32_t* row = rows[1];
+    uint32_t* below = rows[2];
+    padded_row(src, width, height, -1, above);
+    padded_row(src, width, height, 0, row);
+
+    size_t out_width = (size_t) width * 2;
+    for (int y = 0; y < height; y++) {
+        padded_row(src, width, height, y + 1, below);
+        uint32_t* out0 = dst + (size_t) y * 2 * out_width;
+        uint32_t* out1 = out0 + out_width;
+
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            Pixels b = load(above + x + 1), h = load(below + x + 1);
+            Pixels d = load(row + x), e = load(row + x + 1), f = load(row + x + 2);
+
+            Pixels changed = (Pixels) (b != h) & (Pixels) (d != f);
+            Pixels e0 = pick(changed & (Pixels) (d == b), d, e);
+            Pixels e1 = pick(changed & (Pixels) (b == f), f, e);
+            Pixels e2 = pick(changed & (Pixels) (d == h), d, e);
+            Pixels e3 = pick(changed & (Pixels) (h == f), f, e);
+
+            store(out0 + 2 * x, __builtin_shufflevector(e0, e1, 0, 4, 1, 5));
+            store(out0 + 2 * x + 4, __builtin_shufflevector(e0, e1, 2, 6, 3, 7));
+            store(out1 + 2 * x, __builtin_shufflevector(e2, e3, 0, 4, 1, 5));
+            store(out1 + 2 * x + 4, __builtin_shufflevector(e2, e3, 2, 6, 3, 7));
+        }
+        for (; x < width; x++) {
+            uint32_t b = above[x + 1], h = below[x + 1];
+            uint32_t d = row[x], e = row[x + 1], f = row[x + 2];
+            bool changed = b != h && d != f;
+            out0[2 * x] = changed && d == b ? d : e;
+            out0[2 * x + 1] = changed && b == f ? f : e;
+            out1[2 * x] = changed && d == h ? d : e;
+            out1[2 * x + 1] = changed && h == f ? f : e;
+        }
+
+        uint32_t* t = above;
+        above = row;
+        row = below;
+        below = t;
+    }
+    return true;
+}
+
+
+// p0 q0 r0 p1 | q1 r1 p2 q2 | r2 p3 q3 r3
+static inline void store3(uint32_t* out, Pixels p, Pixels q, Pixels r) {
+    store(out, __builtin_shufflevector(__builtin_shufflevector(p, q, 0, 4, 1, 5), r, 0, 1, 4, 2));
+    store(out + 4, __builtin_shufflevector(__builtin_shufflevector(q, r, 1, 5, 2, 6), p, 0, 1, 6, 2));
+    store(out + 8, __builtin_shufflevector(__builtin_shufflevector(p, q, 3, 7, 3, 7), r, 6, 0, 1, 7));
+}
+
+
+// Scale3x/AdvMAME3x: the same rules extended to 3x3 cells
+//   A B C      E0 E1 E2
+//   D E F  ->  E3 E4 E5
+//   G H I      E6 E7 E8
+bool gb_scale3x(const uint32_t* src, int width, int height, uint32_t* dst) {
+    if (!scale_args(src, width, height, dst)) return false;
+
+    uint32_t rows[3][SCALE_MAX_WIDTH + 8];
+    uint32_t* above = rows[0];
+    uint32_t* row = rows[1];
+    uint32_t* below = rows[2];
+    padded_row(src, width, height, -1, above);
+    padded_row(src, width, height, 0, row);
+
+    size_t out_width = (size_t) width * 3;
+    for (int y = 0; y < height; y++) {
+        padded_row(src, width, height, y + 1, below);
+        uint32_t* out[3];
+        out[0] = dst + (size_t) y * 3 * out_width;
+        out[1] = out[0] + out_width;
+        out[2] = out[1] + out_width;
+
+        // The tail is done by going back to the last full group of four
+        for (int x = 0; x < width; x += 4) {
+            if (x + 4 > width) x = width < 4 ? 0 : width - 4;
+            int n = width < 4 ? width : 4;
+
+            Pixels a = load(above + x), b = load(above + x + 1), c = load(above + x + 2);
+            Pixels d = load(row + x), e = load(row + x + 1), f = load(row + x + 2);
+            Pixels g = load(below + x), h = load(below + x + 1), i = load(below + x + 2);
+
+            Pixels changed = (Pixels) (b != h) & (Pixels) (d != f);
+            Pixels db = changed & (Pixels) (d == b);
+            Pixels bf = changed & (Pixels) (b == f);
+            Pixels dh = changed & (Pixels) (d == h);
+            Pixels hf = changed & (Pixels) (h == f);
+
+            Pixels cell[9];
+            cell[0] = pick(db, d, e);
+            cell[1] = pick((db & (Pixels) (e != c)) | (bf & (Pixels) (e != a)), b, e);
+            cell[2] = pick(bf, f, e);
+            cell[3] = pick((db & (Pixels) (e != g)) | (dh & (Pixels) (e != a)), d, e);
+            cell[4] = e;
+            cell[5] = pick((bf & (Pixels) (e != i)) | (hf & (Pixels) (e != c)), f, e);
+            cell[6] = pick(dh, d, e);
+            cell[7] = pick((dh & (Pixels) (e != i)) | (hf & (Pixels) (e != g)), h, e);
+            cell[8] = pick(hf, f, e);
+
+            for (int r = 0; r < 3; r++) {
+                if (n == 4) {
+                    store3(out[r] + x * 3, cell[r * 3], cell[r * 3 + 1], cell[r * 3 + 2]);
+                    continue;
+                }
+                for (int k = 0; k < n; k++) {
+                    uint32_t* o = out[r] + (x + k) * 3;
+                    o[0] = cell[r * 3][k];
+                    o[1] = cell[r * 3 + 1][k];
+                    o[2] = cell[r * 3 + 2][k];
+                }
+            }
+        }
+
+        uint32_t* t = above;
+        above = row;
+        row = below;
+        below = t;
+    }
+    return true;
+}
+
+
+// a * (256 - w) + b * w, per channel, w in 0..256
+static inline Pixels blend(Pixels a, Pixels b, uint16_t w) {
+    Channels16 ca = __builtin_convertvector((Channels) a, Channels16);
+    Channels16 cb = __builtin_convertvector((Channels) b, Channels16);
+    Channels16 mixed = (ca * (uint16_t) (256 - w) + cb * w) >> 8;
+    return (Pixels) __builtin_convertvector(mixed, Channels);
+}
+
+
+bool gb_lcd_filter(const uint32_t* src, uint32_t* history, int width, int height,
+                   int factor, int ghosting, int grid, uint32_t* dst) {
+    if (!scale_args(src, width, height, dst) || !history) return false;
+    if (factor < 1 || factor > SCALE_MAX_FACTOR) return false;
+    if (ghosting < 0 || ghosting > 255 || grid < 0 || grid > 255) return false;
+
+    uint32_t lit[SCALE_MAX_WIDTH + 4];
+    uint32_t dim[SCALE_MAX_WIDTH + 4];
+    Pixels black = splat(ALPHA);
+    size_t out_width = (size_t) width * factor;
+
+    for (int y = 0; y < height; y++) {
+        const uint32_t* in = src + (size_t) y * width;
+        uint32_t* past = history + (size_t) y * width;
+
+        // Ghosting: the panel keeps part of what it showed before
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            Pixels v = blend(load(in + x), load(past + x), (uint16_t) ghosting);
+            store(past + x, v);
+            store(lit + x, v);
+            store(dim + x, blend(v, black, (uint16_t) grid) | black);
+        }
+        for (; x < width; x++) {
+            Pixels v = blend(splat(in[x]), splat(past[x]), (uint16_t) ghosting);
+            past[x] = lit[x] = v[0];
+            dim[x] = (blend(v, black, (uint16_t) grid) | black)[0];
+        }
+
+        // Grid: the last row and column of every cell are the gaps between pixels
+        uint32_t* out = dst + (size_t) y * factor * out_width;
+        if (factor == 1) {
+            memcpy(out, lit, width * sizeof(uint32_t));
+            continue;
+        }
+        stretch_row(lit, width, factor, out);
+        for (x = 0; x < width; x++) out[x * factor + factor - 1] = dim[x];
+        for (int i = 1; i < factor - 1; i++) memcpy(out + i * out_width, out, out_width * sizeof(uint32_t));
+        stretch_row(dim, width, factor, out + (factor - 1) * out_width);
+    }
+    return true;
+}
@@ -0,0 +1,15 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <stdint.h>
+
+#define SCALE_MAX_WIDTH  1024   // source pixels per row
+#define SCALE_MAX_FACTOR 6
+
+// Four RGBA pixels / sixteen channel bytes. GCC and Clang vector extensions:
+// SSE2 on x86-64, NEON on arm64, plain code elsewhere.
+typedef uint32_t Pixels __attribute__((vector_size(16)));
+typedef uint8_t Channels __attribute__((vector_size(16)));
+typedef uint16_t Channels16 __attribute__((vector_size(32)));
+
+#endif
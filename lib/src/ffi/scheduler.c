@@ -0,0 +1,44 @@
+#include "scheduler.h"
+
+
+static void scheduler_update_next(Scheduler* sched) {
+    uint64_t next = EVENT_NEVER;
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        if (sched->when[i] < next) next = sched->when[i];
+    }
+    sched->next = next;
+}
+
+
+void scheduler_init(Scheduler* sched) {
+    sched->now = 0;
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        sched->when[i] = EVENT_NEVER;
+    }
+    sched->next = EVENT_NEVER;
+}
+
+
+void scheduler_set(Scheduler* sched, EventType type, uint64_t when) {
+    sched->when[type] = when;
+    scheduler_update_next(sched);
+}
+
+
+void scheduler_cancel(Scheduler* sched, EventType type) {
+    scheduler_set(sched, type, EVENT_NEVER);
+}
+
+
+int scheduler_pop(Scheduler* sched, uint64_t* when) {
+    if (sched->next > sched->now) return -1;
+
+    int type = 0;
+    for (int i = 1; i < EVENT_COUNT; i++) {
+        if (sched->when[i] < sched->when[type]) type = i;
+    }
+
+    *when = sched->when[type];
+    scheduler_cancel(sched, type);
+    return type;
+}
@@ -0,0 +1,33 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#define EVENT_NEVER UINT64_MAX
+
+typedef enum {
+    EVENT_JOYPAD = 0,
+    EVENT_SERIAL,
+    EVENT_TIMER,
+    EVENT_PPU,
+    EVENT_COUNT
+} EventType;
+
+// Master clock plus one pending deadline per device. The run loop only
+// compares `now` against `next` after each instruction; devices compute
+// their state lazily and schedule the moment something observable happens.
+typedef struct {
+    uint64_t now;                 // T-cycles since reset
+    uint64_t next;                // earliest pending deadline
+    uint64_t when[EVENT_COUNT];
+} Scheduler;
+
+void scheduler_init(Scheduler* sched);
+void scheduler_set(Scheduler* sched, EventType type, uint64_t when);
+void scheduler_cancel(Scheduler* sched, EventType type);
+
+// Removes and returns the earliest event due at or before `now`, -1 if none.
+// Its deadline is stored in *when.
+int scheduler_pop(Scheduler* sched, uint64_t* when);
+
+#endif
@@ -0,0 +1,120 @@
+#include "serial.h"
+#include <stdio.h>
+#include <string.h>
+
+
+void serial_init(Serial* serial, MMU* mmu, Scheduler* sched) {
+    Serial* peer = serial->peer;
+    bool mirror = serial->mirror_stdout;
+
+    memset(serial, 0, sizeof(Serial));
+    serial->sc = 0x7E;
+    serial->mmu = mmu;
+    serial->sched = sched;
+
+    // кабель и зеркалирование переживают сброс
+    serial->peer = peer;
+    serial->mirror_stdout = mirror;
+}
+
+
+uint8_t serial_read(Serial* serial, uint16_t addr) {
+    if (addr == 0xFF01) return serial->sb;
+    return serial->sc | 0x7E;
+}
+
+
+void serial_write(Serial* serial, uint16_t addr, uint8_t val) {
+    if (addr == 0xFF01) {
+        serial->sb = val;
+        return;
+    }
+
+    serial->sc = val;
+
+    // Only the side driving the clock times the transfer; an external-clock
+    // transfer waits for the peer to complete one.
+    if ((val & 0x81) == 0x81)
+        scheduler_set(serial->sched, EVENT_SERIAL, serial->sched->now + SERIAL_CYCLES_PER_BYTE);
+    else
+        scheduler_cancel(serial->sched, EVENT_SERIAL);
+}
+
+
+static void serial_capture(Serial* serial, uint8_t byte) {
+    if (serial->muted) return;
+
+    uint32_t head = atomic_load_explicit(&serial->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&serial->tail, memory_order_acquire);
+
+    if (head - tail < SERIAL_BUFFER_SIZE) {
+        serial->buffer[head & (SERIAL_BUFFER_SIZE - 1)] = byte;
+        atomic_store_explicit(&serial->head, head + 1, memory_order_release);
+    } else {
+        serial->dropped++;
+    }
+
+    if (serial->mirror_stdout) {
+        if (serial->mirror_len == SERIAL_MIRROR_SIZE) serial_flush_mirror(serial);
+        serial->mirror[serial->mirror_len++] = byte;
+    }
+}
+
+
+void serial_complete(Serial* serial) {
+    uint8_t out = serial->sb;
+    uint8_t in = 0xFF; // кабель не подключён
+
+    Serial* peer = serial->peer;
+    if (peer) {
+        in = peer->sb;
+        peer->sb = out;
+        if ((peer->sc & 0x81) == 0x80) {
+            peer->sc &= 0x7F;
+            serial_capture(peer, in);
+            mmu_request_interrupt(peer->mmu, INT_SERIAL);
+        }
+    }
+
+    serial->sb = in;
+    serial->sc &= 0x7F;
+    serial_capture(serial, out);
+    mmu_request_interrupt(serial->mmu, INT_SERIAL);
+}
+
+
+size_t serial_drain(Serial* serial, uint8_t* out, size_t max) {
+    uint32_t tail = atomic_load_explicit(&serial->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&serial->head, memory_order_acquire);
+
+    size_t n = 0;
+    while (tail != head && n < max) {
+        out[n++] = serial->buffer[tail & (SERIAL_BUFFER_SIZE - 1)];
+        tail++;
+    }
+
+    atomic_store_explicit(&serial->tail, tail, memory_order_release);
+    return n;
+}
+
+
+void serial_flush_mirror(Serial* serial) {
+    if (serial->mirror_len == 0) return;
+    fwrite(serial->mirror, 1, serial->mirror_len, stdout);
+    fflush(stdout);
+    serial->mirror_len = 0;
+}
+
+
+void serial_link(Serial* a, Serial* b) {
+    serial_unlink(a);
+    serial_unlink(b);
+    a->peer = b;
+    b->peer = a;
+}
+
+
+void serial_unlink(Serial* serial) {
+    if (serial->peer) serial->peer->peer = NULL;
+    serial->peer = NULL;
+}
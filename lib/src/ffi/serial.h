@@ -0,0 +1,49 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "mmu.h"
+#include "scheduler.h"
+
+#define SERIAL_BUFFER_SIZE 4096    // степень двойки
+#define SERIAL_MIRROR_SIZE 256
+#define SERIAL_CYCLES_PER_BYTE 4096 // 8 бит по 512 тактов (8192 Гц)
+
+typedef struct Serial {
+    uint8_t sb;              // 0xFF01
+    uint8_t sc;              // 0xFF02
+
+    MMU* mmu;                // for raising INT_SERIAL
+    Scheduler* sched;        // EVENT_SERIAL: end of a transfer on the internal clock
+    struct Serial* peer;     // other end of the link cable, NULL if unplugged
+
+    // Transmitted bytes. SPSC: the emulator pushes, gb_serial_read pops.
+    uint8_t buffer[SERIAL_BUFFER_SIZE];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint32_t dropped;
+    bool muted;              // run-ahead frames: nothing is captured
+
+    // Optional stdout mirror, written out once per frame
+    bool mirror_stdout;
+    uint8_t mirror[SERIAL_MIRROR_SIZE];
+    int mirror_len;
+} Serial;
+
+void serial_init(Serial* serial, MMU* mmu, Scheduler* sched);
+uint8_t serial_read(Serial* serial, uint16_t addr);
+void serial_write(Serial* serial, uint16_t addr, uint8_t val);
+
+// EVENT_SERIAL handler: finishes the running transfer
+void serial_complete(Serial* serial);
+
+size_t serial_drain(Serial* serial, uint8_t* out, size_t max);
+void serial_flush_mirror(Serial* serial);
+
+void serial_link(Serial* a, Serial* b);
+void serial_unlink(Serial* serial);
+
+#endif
@@ -0,0 +1,121 @@
+#define _GNU_SOURCE // syscall(), shm_open()
+
+#include "shm_export.h"
+#include "gameboy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__ANDROID__)
+#define SHM_SUPPORTED 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#endif
+
+
+void shm_publish(ShmExport* ex, const uint32_t* framebuffer, uint64_t cycle) {
+    ShmLayout* shm = ex->shm;
+    uint64_t n = atomic_load_explicit(&shm->frames, memory_order_relaxed) + 1;
+    ShmSlot* slot = &shm->slots[(n - 1) % SHM_SLOTS];
+
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(slot->pixels, framebuffer, sizeof(slot->pixels));
+    slot->frame = n;
+    slot->cycle = cycle;
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&shm->frames, n, memory_order_release);
+    shm->sample_rate = (uint32_t) ex->gb->apu.sample_rate;
+    atomic_fetch_add_explicit(&shm->futex, 1, memory_order_release);
+
+#ifdef __linux__
+    syscall(SYS_futex, &shm->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+
+// APU tap: every synthesized stereo frame, whether or not the host reads audio
+void shm_audio(void* ctx, const int16_t* frames, uint32_t n) {
+    ShmLayout* shm = ((ShmExport*) ctx)->shm;
+    uint64_t head = atomic_load_explicit(&shm->audio_head, memory_order_relaxed);
+
+    // Readers validate their copies against the write cursor
+    atomic_store_explicit(&shm->audio_write, head + n, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t slot = (uint32_t) ((head + i) & (SHM_AUDIO_FRAMES - 1));
+        shm->audio[slot * 2] = frames[i * 2];
+        shm->audio[slot * 2 + 1] = frames[i * 2 + 1];
+    }
+    atomic_store_explicit(&shm->audio_head, head + n, memory_order_release);
+}
+
+
+ShmExport* gb_shm_export(GameBoy* gb, const char* name) {
+#ifdef SHM_SUPPORTED
+    if (gb->shm != NULL || strlen(name) >= sizeof(((ShmExport*) 0)->name)) return NULL;
+
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) return NULL;
+
+    size_t size = sizeof(ShmLayout);
+    void* mem = ftruncate(fd, (off_t) size) == 0
+            ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    ShmExport* ex = mem != MAP_FAILED ? calloc(1, sizeof(ShmExport)) : NULL;
+    if (ex == NULL) {
+        if (mem != MAP_FAILED) munmap(mem, size);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // ftruncate обнулил сегмент, остаётся заголовок
+    ShmLayout* shm = mem;
+    shm->version = SHM_VERSION;
+    shm->size = (uint32_t) size;
+    shm->sample_rate = (uint32_t) gb->apu.sample_rate;
+    atomic_thread_fence(memory_order_release);
+    shm->magic = SHM_MAGIC;
+
+    ex->gb = gb;
+    ex->shm = shm;
+    strcpy(ex->name, name);
+    gb->shm = ex;
+    apu_set_tap(&gb->apu, shm_audio, ex);
+    return ex;
+#else
+    return NULL;
+#endif
+}
+
+
+void gb_shm_close(ShmExport* ex) {
+#ifdef SHM_SUPPORTED
+    if (ex == NULL) return;
+    ex->gb->shm = NULL;
+    apu_set_tap(&ex->gb->apu, NULL, NULL);
+
+    atomic_store(&ex->shm->closed, 1);
+    atomic_fetch_add(&ex->shm->futex, 1);
+#ifdef __linux__
+    syscall(SYS_futex, &ex->shm->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+
+    // Уже открытые отображения у читателей остаются в силе
+    munmap(ex->shm, sizeof(ShmLayout));
+    shm_unlink(ex->name);
+    free(ex);
+#endif
+}
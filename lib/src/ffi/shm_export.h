@@ -0,0 +1,64 @@
+#ifndef SHM_EXPORT_H
+#define SHM_EXPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "_gb.h"
+
+// Layout of the shared-memory segment written by gb_shm_export. Readers map
+// it read-only and need nothing else from the core. Host byte order.
+//
+// Frames: `frames` counts published frames; frame n (from 1) is in slot
+// (n - 1) % SHM_SLOTS. Each slot is a seqlock: `seq` is odd while the slot is
+// written. Read `seq`, use the pixels in place, read `seq` again; if it is
+// odd or changed, the frame was overwritten meanwhile and must be dropped.
+//
+// Audio: int16 stereo ring of SHM_AUDIO_FRAMES frames; `audio_head` counts
+// frames ever written. `audio_write` is raised to where the writer is about
+// to write before it touches the ring, so frames older than
+// audio_write - SHM_AUDIO_FRAMES may be overwritten. Copy frames below
+// audio_head, then (acquire fence) check them against audio_write.
+//
+// Waiting: `futex` is bumped and woken (shared, not FUTEX_PRIVATE) after
+// every frame, so Linux readers can FUTEX_WAIT on it; readers elsewhere poll
+// `frames`. Readers never write, a read-only mapping is enough.
+
+#define SHM_MAGIC        0x48534247 // "GBSH"
+#define SHM_VERSION      2
+#define SHM_SLOTS        4
+#define SHM_WIDTH        160
+#define SHM_HEIGHT       144
+#define SHM_AUDIO_FRAMES 16384      // степень двойки
+
+typedef struct {
+    _Alignas(64) _Atomic uint32_t seq;
+    uint64_t frame;
+    uint64_t cycle;
+    uint32_t pixels[SHM_HEIGHT * SHM_WIDTH]; // RGBA, as gb_instance_framebuffer
+} ShmSlot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;           // of the whole segment
+    uint32_t sample_rate;
+    _Atomic uint32_t futex;
+    _Atomic uint32_t closed; // the writer went away
+    _Alignas(64) _Atomic uint64_t frames;
+    _Atomic uint64_t audio_head;
+    _Atomic uint64_t audio_write;
+    int16_t audio[SHM_AUDIO_FRAMES * 2];
+    ShmSlot slots[SHM_SLOTS];
+} ShmLayout;
+
+struct ShmExport {
+    GameBoy* gb;
+    ShmLayout* shm;
+    char name[64];
+};
+
+void shm_publish(ShmExport* ex, const uint32_t* framebuffer, uint64_t cycle);
+void shm_audio(void* ctx, const int16_t* frames, uint32_t n);
+
+#endif
@@ -0,0 +1,247 @@
+#include "_gb.h"
+#include "gameboy.h"
+#include <string.h>
+
+// Save state layout, host byte order:
+//   header:  magic "GBST", version, total size, ROM id
+//   sections: { tag, payload length, payload }...
+// Payloads are the device fields listed below in order. Any change to a list
+// (or to the size of a field in it) must bump STATE_VERSION.
+
+#define STATE_MAGIC   0x54534247 // "GBST"
+#define STATE_VERSION 4
+
+enum {
+    SECTION_CPU = 1,
+    SECTION_MMU,
+    SECTION_PPU,
+    SECTION_SCHED,
+    SECTION_TIMER,
+    SECTION_SERIAL,
+    SECTION_JOYPAD,
+    SECTION_APU
+};
+
+typedef struct {
+    uint8_t* buf;   // NULL: only count bytes
+    size_t cap;
+    size_t pos;
+} StateWriter;
+
+typedef struct {
+    const uint8_t* buf;
+    size_t pos;
+    bool ok;        // false: a page could not be made writable
+} StateReader;
+
+#define PUT(w, field) state_put(w, &(field), sizeof(field))
+#define GET(r, field) state_get(r, &(field), sizeof(field))
+
+// Field list entry: saved through `w` or loaded through `r`
+#define F(x) do { if (w) PUT(w, x); else GET(r, x); } while (0)
+
+#define SECTION_COUNT 8
+
+
+static inline void state_put(StateWriter* w, const void* data, size_t n) {
+    if (w->buf && w->pos + n <= w->cap) memcpy(w->buf + w->pos, data, n);
+    w->pos += n;
+}
+
+
+static inline void state_get(StateReader* r, void* data, size_t n) {
+    memcpy(data, r->buf + r->pos, n);
+    r->pos += n;
+}
+
+
+static uint32_t rom_id(GameBoy* gb) {
+    // Header checksum and global checksum
+    MMU* mmu = &gb->mmu;
+    return mmu_read8(mmu, 0x14D) | (mmu_read8(mmu, 0x14E) << 8) | (mmu_read8(mmu, 0x14F) << 16);
+}
+
+
+// ---------------------------------------------------------------- fields
+
+// `timed`: the execution mode, part of the state because timed and untimed
+// runs of the same input diverge
+static void cpu_fields(CPU* cpu, bool* timed, StateWriter* w, StateReader* r) {
+    F(cpu->af); F(cpu->bc); F(cpu->de); F(cpu->hl);
+    F(cpu->sp); F(cpu->pc);
+    F(cpu->halted); F(cpu->ime); F(cpu->ime_pending);
+    F(*timed);
+}
+
+
+static void mmu_fields(MMU* mmu, StateWriter* w, StateReader* r) {
+    // VRAM, external RAM, WRAM
+    for (int i = MMU_RAM_PAGE; i < MMU_PAGE_COUNT; i++) {
+        if (w) {
+            state_put(w, mmu_page(mmu, i), MMU_PAGE_SIZE);
+        } else {
+            // Страницы без изменений остаются общими с форками
+            if (memcmp(mmu_page(mmu, i), r->buf + r->pos, MMU_PAGE_SIZE) != 0) {
+                uint8_t* page = mmu_page_mut(mmu, i);
+                if (page) memcpy(page, r->buf + r->pos, MMU_PAGE_SIZE);
+                else r->ok = false;
+            }
+            r->pos += MMU_PAGE_SIZE;
+        }
+    }
+
+    F(mmu->oam);
+    F(mmu->io); F(mmu->hram); F(mmu->ie);
+    F(mmu->boot_completed);
+}
+
+
+static void ppu_fields(PPU* ppu, StateWriter* w, StateReader* r) {
+    F(ppu->scanline); F(ppu->mode); F(ppu->line_start); F(ppu->stat_line);
+}
+
+
+static void sched_fields(Scheduler* sched, StateWriter* w, StateReader* r) {
+    F(sched->now); F(sched->when);
+}
+
+
+static void timer_fields(Timer* timer, StateWriter* w, StateReader* r) {
+    F(timer->div_base); F(timer->tima_base);
+    F(timer->tima); F(timer->tma); F(timer->tac); F(timer->reloading);
+    F(timer->reload_end);
+}
+
+
+static void serial_fields(Serial* serial, StateWriter* w, StateReader* r) {
+    F(serial->sb); F(serial->sc);
+}
+
+
+static void joypad_fields(Joypad* joypad, StateWriter* w, StateReader* r) {
+    F(joypad->select); F(joypad->pressed);
+}
+
+
+static void apu_fields(APU* apu, StateWriter* w, StateReader* r) {
+    F(apu->regs); F(apu->wave_ram); F(apu->power);
+
+    for (int i = 0; i < 4; i++) {
+        ApuChannel* ch = &apu->ch[i];
+        F(ch->enabled); F(ch->dac); F(ch->length_enable); F(ch->length);
+        F(ch->freq); F(ch->period); F(ch->next_step); F(ch->pos);
+        F(ch->volume); F(ch->env_period); F(ch->env_timer); F(ch->env_up);
+        F(ch->amp);
+    }
+
+    F(apu->sweep_shadow); F(apu->sweep_timer); F(apu->sweep_enabled); F(apu->sweep_negated);
+    F(apu->lfsr); F(apu->fs_step); F(apu->fs_next); F(apu->time);
+}
+
+
+// Runs every section through either the writer or the reader.
+// When writing, payload lengths are also stored in `lens` if given.
+static void state_sections(GameBoy* gb, StateWriter* w, StateReader* r, uint32_t* lens) {
+    for (uint32_t tag = SECTION_CPU; tag <= SECTION_APU; tag++) {
+        size_t start = 0;
+        uint32_t len = 0;
+
+        if (w) {
+            PUT(w, tag);
+            start = w->pos;
+            PUT(w, len);
+        } else {
+            r->pos += sizeof(tag) + sizeof(len); // проверено в state_validate
+        }
+
+        switch (tag) {
+            case SECTION_CPU:    cpu_fields(&gb->cpu, &gb->timed, w, r); break;
+            case SECTION_MMU:    mmu_fields(&gb->mmu, w, r); break;
+            case SECTION_PPU:    ppu_fields(&gb->ppu, w, r); break;
+            case SECTION_SCHED:  sched_fields(&gb->sched, w, r); break;
+            case SECTION_TIMER:  timer_fields(&gb->timer, w, r); break;
+            case SECTION_SERIAL: serial_fields(&gb->serial, w, r); break;
+            case SECTION_JOYPAD: joypad_fields(&gb->joypad, w, r); break;
+            case SECTION_APU:    apu_fields(&gb->apu, w, r); break;
+        }
+
+        if (w) {
+            len = (uint32_t) (w->pos - start - sizeof(len));
+            if (lens) lens[tag - SECTION_CPU] = len;
+            if (w->buf && w->pos <= w->cap) memcpy(w->buf + start, &len, sizeof(len));
+        }
+    }
+}
+
+
+static void state_header(GameBoy* gb, StateWriter* w, uint32_t size) {
+    uint32_t magic = STATE_MAGIC;
+    uint32_t version = STATE_VERSION;
+    uint32_t id = w->buf ? rom_id(gb) : 0; // counting reads nothing
+    PUT(w, magic);
+    PUT(w, version);
+    PUT(w, size);
+    PUT(w, id);
+}
+
+
+// Fixed by the layout of this STATE_VERSION; no field list has a variable length
+size_t gb_state_size(GameBoy* gb) {
+    StateWriter w = { NULL, 0, 0 };
+    state_header(gb, &w, 0);
+    state_sections(gb, &w, NULL, NULL);
+    return w.pos;
+}
+
+
+size_t gb_save_state(GameBoy* gb, uint8_t* buf, size_t cap) {
+    size_t size = gb_state_size(gb);
+    if (buf == NULL || cap < size) return 0;
+
+    StateWriter w = { buf, cap, 0 };
+    state_header(gb, &w, (uint32_t) size);
+    state_sections(gb, &w, NULL, NULL);
+    return w.pos;
+}
+
+
+// The blob must match what this build would write for this ROM, header and
+// section lengths included, before anything is touched
+static bool state_validate(GameBoy* gb, const uint8_t* buf, size_t size) {
+    uint32_t lens[SECTION_COUNT];
+    StateWriter count = { NULL, 0, 0 };
+    state_header(gb, &count, 0);
+    size_t pos = count.pos;
+    state_sections(gb, &count, NULL, lens);
+
+    if (buf == NULL || size != count.pos) return false;
+
+    uint32_t header[4];
+    memcpy(header, buf, sizeof(header));
+    if (header[0] != STATE_MAGIC || header[1] != STATE_VERSION) return false;
+    if (header[2] != size || header[3] != rom_id(gb)) return false;
+
+    for (uint32_t tag = SECTION_CPU; tag <= SECTION_APU; tag++) {
+        uint32_t got[2];
+        memcpy(got, buf + pos, sizeof(got));
+        if (got[0] != tag || got[1] != lens[tag - SECTION_CPU]) return false;
+        pos += sizeof(got) + got[1];
+    }
+    return true;
+}
+
+
+bool gb_load_state(GameBoy* gb, const uint8_t* buf, size_t size) {
+    if (!state_validate(gb, buf, size)) return false;
+
+    StateReader r = { buf, 4 * sizeof(uint32_t), true };
+    state_sections(gb, NULL, &r, NULL);
+
+    // Derived state
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        scheduler_set(&gb->sched, i, gb->sched.when[i]);
+    }
+    apu_restore(&gb->apu);
+    if (gb->ppu.pipeline) ppu_pipeline_sync(&gb->ppu);
+    return r.ok;
+}
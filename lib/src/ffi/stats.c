@@ -0,0 +1,78 @@
+#include "stats.h"
+
+#ifdef GB_STATS
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char* region_names[REGION_COUNT] = {
+        "ROM0", "ROMX", "VRAM", "ERAM", "WRAM", "ECHO", "OAM", "unusable", "IO", "HRAM", "IE"
+};
+
+
+void stats_record(GbStats* stats, int opcode, uint64_t ticks) {
+    int bucket = ticks ? 63 - __builtin_clzll(ticks) : 0;
+    if (bucket >= STATS_BUCKETS) bucket = STATS_BUCKETS - 1;
+
+    stats->count[opcode]++;
+    stats->ticks[opcode] += ticks;
+    stats->histogram[opcode][bucket]++;
+}
+
+
+static const GbStats* sort_stats;
+
+static int by_ticks(const void* a, const void* b) {
+    uint64_t ta = sort_stats->ticks[*(const int*) a];
+    uint64_t tb = sort_stats->ticks[*(const int*) b];
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+
+void stats_report(const GbStats* stats, FILE* out, int top) {
+    int order[STATS_OPCODES];
+    uint64_t total_count = 0, total_ticks = 0;
+    for (int i = 0; i < STATS_OPCODES; i++) {
+        order[i] = i;
+        total_count += stats->count[i];
+        total_ticks += stats->ticks[i];
+    }
+
+    sort_stats = stats;
+    qsort(order, STATS_OPCODES, sizeof(int), by_ticks);
+
+    fprintf(out, "%-7s %12s %7s %12s %7s %8s  histogram (log2 ticks: 1 2 4 ... 32K+)\n",
+            "opcode", "count", "count%", "ticks", "ticks%", "avg");
+
+    if (top <= 0 || top > STATS_OPCODES) top = STATS_OPCODES;
+    for (int n = 0; n < top; n++) {
+        int op = order[n];
+        if (stats->count[op] == 0) break;
+
+        char name[8];
+        if (op < 0x100)
+            snprintf(name, sizeof(name), "%02X", op);
+        else
+            snprintf(name, sizeof(name), "CB %02X", op & 0xFF);
+
+        fprintf(out, "%-7s %12llu %6.2f%% %12llu %6.2f%% %8.1f ", name,
+                (unsigned long long) stats->count[op], 100.0 * stats->count[op] / total_count,
+                (unsigned long long) stats->ticks[op], 100.0 * stats->ticks[op] / total_ticks,
+                (double) stats->ticks[op] / stats->count[op]);
+
+        // Доля каждого корзины одной цифрой 0-9
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            uint64_t h = stats->histogram[op][b];
+            fputc(h == 0 ? '.' : '0' + (int) (h * 9 / stats->count[op]), out);
+        }
+        fputc('\n', out);
+    }
+
+    fprintf(out, "\n%-9s %14s %14s\n", "region", "reads", "writes");
+    for (int r = 0; r < REGION_COUNT; r++) {
+        fprintf(out, "%-9s %14llu %14llu\n", region_names[r],
+                (unsigned long long) stats->reads[r], (unsigned long long) stats->writes[r]);
+    }
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Instrumentation build (-DGB_STATS): per-opcode counts and host-time
+// histograms, memory accesses per region. Without GB_STATS this header
+// declares nothing and the hooks below compile to nothing.
+
+#ifdef GB_STATS
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#define STATS_OPCODES 512 // 0x00-0xFF, then CB 0x00-0xFF
+#define STATS_BUCKETS 16  // host ticks per execution, log2
+
+typedef enum {
+    REGION_ROM0,     // 0000-3FFF
+    REGION_ROMX,     // 4000-7FFF
+    REGION_VRAM,     // 8000-9FFF
+    REGION_ERAM,     // A000-BFFF
+    REGION_WRAM,     // C000-DFFF
+    REGION_ECHO,     // E000-FDFF
+    REGION_OAM,      // FE00-FE9F
+    REGION_UNUSABLE, // FEA0-FEFF
+    REGION_IO,       // FF00-FF7F
+    REGION_HRAM,     // FF80-FFFE
+    REGION_IE,       // FFFF
+    REGION_COUNT
+} MemRegion;
+
+typedef struct GbStats {
+    uint64_t count[STATS_OPCODES];
+    uint64_t ticks[STATS_OPCODES];
+    uint64_t histogram[STATS_OPCODES][STATS_BUCKETS];
+    uint64_t reads[REGION_COUNT];
+    uint64_t writes[REGION_COUNT];
+} GbStats;
+
+
+// rdtsc on x86, the virtual counter on ARM64, nanoseconds elsewhere
+static inline uint64_t stats_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+
+static inline MemRegion stats_region(uint16_t addr) {
+    if (addr < 0xE000) return (MemRegion) (addr < 0x8000 ? addr >> 14 : (addr >> 13) - 2);
+    if (addr < 0xFE00) return REGION_ECHO;
+    if (addr < 0xFEA0) return REGION_OAM;
+    if (addr < 0xFF00) return REGION_UNUSABLE;
+    if (addr < 0xFF80) return REGION_IO;
+    if (addr < 0xFFFF) return REGION_HRAM;
+    return REGION_IE;
+}
+
+
+void stats_record(GbStats* stats, int opcode, uint64_t ticks);
+// Opcodes sorted by total host time, the `top` first (all if 0), then regions
+void stats_report(const GbStats* stats, FILE* out, int top);
+
+#define STATS_ACCESS(stats, addr, dir) ((stats)->dir[stats_region(addr)]++)
+
+#else
+
+#define STATS_ACCESS(stats, addr, dir) ((void) 0)
+
+#endif
+
+#endif
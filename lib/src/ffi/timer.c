@@ -0,0 +1,142 @@
+#include "timer.h"
+#include <string.h>
+
+// Falling-edge period of the counter bit selected by TAC: bits 9, 3, 5, 7
+static const uint64_t timer_periods[4] = { 1024, 16, 64, 256 };
+
+
+void timer_init(Timer* timer, Scheduler* sched, MMU* mmu) {
+    memset(timer, 0, sizeof(Timer));
+    timer->sched = sched;
+    timer->mmu = mmu;
+
+    // После boot ROM внутренний счётчик DMG равен 0xABCC (DIV = 0xAB).
+    // Arithmetic on div_base is modulo 2^64, so a "negative" base is fine.
+    timer->div_base = sched->now - 0xABCC;
+    timer->tima_base = sched->now;
+    timer->tac = 0xF8;
+}
+
+
+static inline bool timer_enabled(const Timer* timer) {
+    return timer->tac & 0x04;
+}
+
+
+static inline uint64_t timer_period(const Timer* timer) {
+    return timer_periods[timer->tac & 0x03];
+}
+
+
+// Selected counter bit ANDed with the enable bit: TIMA ticks when this falls
+static bool timer_signal(const Timer* timer, uint64_t at) {
+    if (!timer_enabled(timer)) return false;
+    uint64_t period = timer_period(timer);
+    return ((at - timer->div_base) & (period - 1)) >= period / 2;
+}
+
+
+static void timer_sync(Timer* timer, uint64_t now) {
+    if (timer_enabled(timer) && !timer->reloading) {
+        uint64_t period = timer_period(timer);
+        uint64_t edges = (now - timer->div_base) / period - (timer->tima_base - timer->div_base) / period;
+        // не переполняется: переполнение — событие, которое срабатывает раньше
+        timer->tima += (uint8_t) edges;
+    }
+    timer->tima_base = now;
+}
+
+
+static void timer_schedule(Timer* timer) {
+    if (timer->reloading) return; // reload is already pending
+
+    if (!timer_enabled(timer)) {
+        scheduler_cancel(timer->sched, EVENT_TIMER);
+        return;
+    }
+
+    uint64_t period = timer_period(timer);
+    uint64_t first_edge = timer->div_base + ((timer->tima_base - timer->div_base) / period + 1) * period;
+    scheduler_set(timer->sched, EVENT_TIMER, first_edge + (uint64_t) (0xFF - timer->tima) * period);
+}
+
+
+static void timer_overflow(Timer* timer, uint64_t at) {
+    timer->tima = 0;
+    timer->tima_base = at;
+    timer->reloading = true;
+    scheduler_set(timer->sched, EVENT_TIMER, at + 4);
+}
+
+
+// Extra tick caused by a falling edge from a DIV or TAC write. While a
+// reload is pending TIMA is about to be overwritten anyway.
+static void timer_glitch_tick(Timer* timer, uint64_t now) {
+    if (timer->reloading)
+        return;
+    if (timer->tima == 0xFF)
+        timer_overflow(timer, now);
+    else
+        timer->tima++;
+}
+
+
+void timer_event(Timer* timer, uint64_t when) {
+    if (timer->reloading) {
+        timer->reloading = false;
+        timer->tima = timer->tma;
+        timer->tima_base = when;
+        timer->reload_end = when + 4;
+        mmu_request_interrupt(timer->mmu, INT_TIMER);
+        timer_schedule(timer);
+    } else {
+        timer_overflow(timer, when);
+    }
+}
+
+
+uint8_t timer_read(Timer* timer, uint16_t addr) {
+    uint64_t now = timer->sched->now;
+
+    switch (addr) {
+        case 0xFF04: return (uint8_t) ((now - timer->div_base) >> 8);
+        case 0xFF05: timer_sync(timer, now); return timer->tima;
+        case 0xFF06: return timer->tma;
+        default:     return timer->tac | 0xF8;
+    }
+}
+
+
+void timer_write(Timer* timer, uint16_t addr, uint8_t val) {
+    uint64_t now = timer->sched->now;
+    timer_sync(timer, now);
+
+    switch (addr) {
+        case 0xFF04: { // DIV: любой write обнуляет счётчик
+            bool before = timer_signal(timer, now);
+            timer->div_base = now;
+            if (before) timer_glitch_tick(timer, now);
+            break;
+        }
+        case 0xFF05:
+            // A write during the 4 cycles after an overflow cancels the reload;
+            // one during the reload itself is overwritten by TMA
+            if (now < timer->reload_end) return;
+            timer->reloading = false;
+            timer->tima = val;
+            break;
+        case 0xFF06:
+            timer->tma = val;
+            if (now >= timer->reload_end) return;
+            timer->tima = val;
+            break;
+        default: { // TAC
+            bool before = timer_signal(timer, now);
+            timer->tac = val | 0xF8;
+            if (before && !timer_signal(timer, now)) timer_glitch_tick(timer, now);
+            break;
+        }
+    }
+
+    timer_schedule(timer);
+}
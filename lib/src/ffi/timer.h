@@ -0,0 +1,34 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mmu.h"
+#include "scheduler.h"
+
+// DIV/TIMA/TMA/TAC (0xFF04-0xFF07).
+// Nothing is ticked per instruction: the 16-bit internal counter is
+// (now - div_base), TIMA is brought up to date on access by counting falling
+// edges of the TAC-selected counter bit, and overflow is a scheduled event.
+typedef struct {
+    uint64_t div_base;   // cycle at which the internal counter was last 0
+    uint64_t tima_base;  // cycle at which `tima` was last brought up to date
+    uint8_t tima;
+    uint8_t tma;
+    uint8_t tac;
+    bool reloading;      // overflowed, TIMA reads 0 until the reload 4 cycles later
+    uint64_t reload_end; // end of the M-cycle of the last reload: until then TMA
+                         // writes also land in TIMA and TIMA writes are lost
+
+    Scheduler* sched;
+    MMU* mmu;
+} Timer;
+
+void timer_init(Timer* timer, Scheduler* sched, MMU* mmu);
+uint8_t timer_read(Timer* timer, uint16_t addr);
+void timer_write(Timer* timer, uint16_t addr, uint8_t val);
+
+// EVENT_TIMER handler: overflow or TMA reload due at `when`
+void timer_event(Timer* timer, uint64_t when);
+
+#endif
@@ -0,0 +1,173 @@
+#include "trace.h"
+#include "gameboy.h"
+#include <stdlib.h>
+
+
+static void* trace_writer(void* arg) {
+    Trace* t = arg;
+
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        uint64_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+
+        if (tail == head) {
+            if (t->stop) break;
+            pthread_cond_wait(&t->data, &t->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&t->lock);
+
+        // До конца кольца за один раз, остаток на следующем круге
+        uint32_t start = (uint32_t) (tail & (t->size - 1));
+        uint64_t n = head - tail;
+        if (n > t->size - start) n = t->size - start;
+        if (!t->failed && fwrite(&t->ring[start], sizeof(TraceRecord), n, t->file) != n)
+            t->failed = true;
+
+        atomic_store_explicit(&t->tail, tail + n, memory_order_release);
+        pthread_mutex_lock(&t->lock);
+        pthread_cond_signal(&t->space);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+
+static void trace_wake_writer(Trace* t) {
+    pthread_mutex_lock(&t->lock);
+    pthread_cond_signal(&t->data);
+    pthread_mutex_unlock(&t->lock);
+}
+
+
+static void trace_wait_space(Trace* t, uint64_t head) {
+    pthread_mutex_lock(&t->lock);
+    while (head - atomic_load_explicit(&t->tail, memory_order_acquire) >= t->size) {
+        pthread_cond_signal(&t->data);
+        pthread_cond_wait(&t->space, &t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+}
+
+
+// mmu_read8 without its side effects: devices are not synced and nothing is
+// counted as a guest access, so tracing does not change what it records.
+// IO reads the raw register bytes.
+static uint8_t trace_peek(const MMU* mmu, uint16_t addr) {
+    if (!mmu->boot_completed && addr < 0x100) return mmu->boot_rom[addr];
+    if (addr >= 0xE000 && addr <= 0xFDFF) addr -= 0x2000; // echo
+    if (addr <= 0xDFFF) return mmu_page(mmu, addr >> MMU_PAGE_SHIFT)[addr & (MMU_PAGE_SIZE - 1)];
+    if (addr <= 0xFE9F) return mmu->oam[addr - 0xFE00];
+    if (addr <= 0xFEFF) return 0xFF;
+    if (addr <= 0xFF7F) return mmu->io[addr - 0xFF00];
+    if (addr <= 0xFFFE) return mmu->hram[addr - 0xFF80];
+    return mmu->ie;
+}
+
+
+void trace_record(Trace* t, GameBoy* gb) {
+    uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    if (t->file && head - atomic_load_explicit(&t->tail, memory_order_acquire) >= t->size)
+        trace_wait_space(t, head);
+
+    CPU* cpu = &gb->cpu;
+    TraceRecord* r = &t->ring[head & (t->size - 1)];
+    r->cycle = gb->sched.now;
+    r->af = cpu->af; r->bc = cpu->bc; r->de = cpu->de; r->hl = cpu->hl;
+    r->sp = cpu->sp; r->pc = cpu->pc;
+    for (int i = 0; i < 4; i++) {
+        r->mem[i] = trace_peek(&gb->mmu, (uint16_t) (cpu->pc + i));
+    }
+
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+    if (t->file && ((head + 1) & (TRACE_CHUNK - 1)) == 0) trace_wake_writer(t);
+}
+
+
+Trace* gb_trace_start(GameBoy* gb, const char* path, uint32_t records) {
+    if (gb->trace != NULL) return NULL;
+
+    Trace* t = calloc(1, sizeof(Trace));
+    if (t == NULL) return NULL;
+
+    if (path) {
+        t->file = fopen(path, "wb");
+        if (t->file == NULL) {
+            free(t);
+            return NULL;
+        }
+        TraceHeader header = { TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord) };
+        fwrite(&header, sizeof(header), 1, t->file);
+        records = TRACE_FILE_RING;
+    }
+
+    t->size = 1;
+    while (t->size < records) t->size <<= 1;
+    t->ring = malloc((size_t) t->size * sizeof(TraceRecord));
+    if (t->ring == NULL) {
+        if (t->file) fclose(t->file);
+        free(t);
+        return NULL;
+    }
+
+    t->gb = gb;
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->data, NULL);
+    pthread_cond_init(&t->space, NULL);
+    if (t->file && pthread_create(&t->thread, NULL, trace_writer, t) != 0) {
+        // Без писателя кольцо заполнится и эмуляция встанет
+        pthread_mutex_destroy(&t->lock);
+        pthread_cond_destroy(&t->data);
+        pthread_cond_destroy(&t->space);
+        fclose(t->file);
+        free(t->ring);
+        free(t);
+        return NULL;
+    }
+
+    gb->trace = t;
+    return t;
+}
+
+
+bool gb_trace_stop(Trace* t) {
+    if (t == NULL) return false;
+    t->gb->trace = NULL;
+
+    bool ok = true;
+    if (t->file) {
+        pthread_mutex_lock(&t->lock);
+        t->stop = true;
+        pthread_cond_signal(&t->data);
+        pthread_mutex_unlock(&t->lock);
+        pthread_join(t->thread, NULL);
+        ok = !t->failed && fclose(t->file) == 0;
+    }
+
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->data);
+    pthread_cond_destroy(&t->space);
+    free(t->ring);
+    free(t);
+    return ok;
+}
+
+
+uint64_t gb_trace_count(Trace* t) {
+    return atomic_load(&t->head);
+}
+
+
+size_t gb_trace_read(Trace* t, TraceRecord* out, size_t max) {
+    if (t->file) return 0;
+
+    uint64_t head = atomic_load(&t->head);
+    uint64_t kept = head < t->size ? head : t->size;
+    if (max > kept) max = kept;
+
+    for (uint64_t i = head - max; i < head; i++) {
+        *out++ = t->ring[i & (t->size - 1)];
+    }
+    return max;
+}
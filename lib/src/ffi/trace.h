@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "_gb.h"
+
+#define TRACE_MAGIC   0x52544247 // "GBTR"
+#define TRACE_VERSION 1
+#define TRACE_CHUNK   4096       // records per writer wake-up, степень двойки
+#define TRACE_FILE_RING (16 * TRACE_CHUNK)
+
+// File header, then TraceRecords in host byte order
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+} TraceHeader;
+
+// Ring mode keeps the newest `size` records. File mode streams every record
+// from a writer thread; when the ring is full the emulator waits for it, so
+// nothing is dropped.
+struct Trace {
+    GameBoy* gb;
+    TraceRecord* ring;
+    uint32_t size;           // степень двойки
+    _Atomic uint64_t head;   // records taken
+    _Atomic uint64_t tail;   // file mode: records written
+
+    FILE* file;              // NULL in ring mode
+    bool failed;             // writer only, read after join
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t data;     // writer: a chunk is ready, or stop
+    pthread_cond_t space;    // emulator: the ring was drained
+    bool stop;
+};
+
+// Called before every instruction of a traced instance
+void trace_record(Trace* trace, GameBoy* gb);
+
+#endif
@@ -0,0 +1,271 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "vec_env.h"
+#include "gameboy.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+// Shades 0-3 as the LCD shows them: each pixel's palette index through BGP
+static void observe_frame(VecEnv* env, GameBoy* gb, uint8_t* out) {
+    const uint32_t* fb = gb_instance_framebuffer(gb);
+    int scale = env->config.obs_scale;
+    uint8_t bgp = gb->mmu.io[0x47];
+
+    for (int y = 0; y < env->obs_height; y++) {
+        const uint32_t* row = fb + y * scale * SCREEN_WIDTH;
+        for (int x = 0; x < env->obs_width; x++) {
+            *out++ = (uint8_t) (bgp >> (2 * ppu_color_index(row[x * scale])) & 3);
+        }
+    }
+}
+
+
+static void observe_ram(VecEnv* env, GameBoy* gb, uint8_t* out) {
+    for (int i = 0; i < env->config.ram_count; i++) {
+        out[i] = mmu_read8(&gb->mmu, env->ram_addrs[i]);
+    }
+}
+
+
+static void reset_one(VecEnv* env, int i) {
+    GameBoy* gb = env->envs[i];
+    gb_load_state(gb, env->start_state, env->state_size);
+    env->steps[i] = 0;
+    env->buttons[i] = gb->joypad.pressed;
+}
+
+
+static void write_start(VecEnv* env, int i) {
+    size_t obs = (size_t) env->obs_width * env->obs_height;
+    int ram = env->config.ram_count;
+    if (env->out_obs) memcpy(env->out_obs + i * obs, env->start_obs, obs);
+    if (env->out_ram) memcpy(env->out_ram + i * ram, env->start_ram, ram);
+}
+
+
+static void step_one(VecEnv* env, int i) {
+    GameBoy* gb = env->envs[i];
+    const VecEnvConfig* c = &env->config;
+
+    uint8_t action = env->actions ? env->actions[i] : 0;
+    uint8_t changed = action ^ env->buttons[i];
+    for (int b = 0; changed; b++, changed >>= 1) {
+        if (changed & 1) gb_set_button(gb, (JoypadButton) b, (action >> b) & 1);
+    }
+    env->buttons[i] = action;
+
+    for (int f = 0; f < c->frame_skip; f++) {
+        gb_set_video_enabled(gb, f == c->frame_skip - 1);
+        gb_instance_step_frame(gb);
+    }
+    env->steps[i]++;
+
+    bool done = (c->max_steps && env->steps[i] >= c->max_steps)
+             || (c->done_mask && (mmu_read8(&gb->mmu, c->done_addr) & c->done_mask) == c->done_value);
+    if (env->out_done) env->out_done[i] = done;
+
+    if (done) {
+        reset_one(env, i);
+        write_start(env, i);
+        return;
+    }
+
+    size_t obs = (size_t) env->obs_width * env->obs_height;
+    if (env->out_obs) observe_frame(env, gb, env->out_obs + i * obs);
+    if (env->out_ram) observe_ram(env, gb, env->out_ram + i * c->ram_count);
+}
+
+
+static void run_batch(VecEnv* env) {
+    int count = env->config.count;
+    int i;
+    while ((i = atomic_fetch_add_explicit(&env->next, VEC_CHUNK, memory_order_relaxed)) < count) {
+        int end = i + VEC_CHUNK < count ? i + VEC_CHUNK : count;
+        for (; i < end; i++) {
+            if (env->reset) {
+                reset_one(env, i);
+                write_start(env, i);
+            } else {
+                step_one(env, i);
+            }
+        }
+    }
+}
+
+
+static void* vec_worker(void* arg) {
+    VecEnv* env = arg;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&env->lock);
+    for (;;) {
+        while (env->generation == seen && !env->stop) pthread_cond_wait(&env->start, &env->lock);
+        if (env->stop) break;
+        seen = env->generation;
+        pthread_mutex_unlock(&env->lock);
+
+        run_batch(env);
+
+        pthread_mutex_lock(&env->lock);
+        if (--env->running == 0) pthread_cond_signal(&env->finished);
+    }
+    pthread_mutex_unlock(&env->lock);
+    return NULL;
+}
+
+
+// Runs one step or reset over all instances, the caller taking part
+static void vec_run(VecEnv* env, const uint8_t* actions, uint8_t* out_obs, uint8_t* out_ram,
+                    uint8_t* out_done, bool reset) {
+    env->actions = actions;
+    env->out_obs = out_obs;
+    env->out_ram = out_ram;
+    env->out_done = out_done;
+    env->reset = reset;
+    atomic_store(&env->next, 0);
+
+    pthread_mutex_lock(&env->lock);
+    env->generation++;
+    env->running = env->thread_count;
+    pthread_cond_broadcast(&env->start);
+    pthread_mutex_unlock(&env->lock);
+
+    run_batch(env);
+
+    pthread_mutex_lock(&env->lock);
+    while (env->running > 0) pthread_cond_wait(&env->finished, &env->lock);
+    pthread_mutex_unlock(&env->lock);
+}
+
+
+VecEnv* gb_vec_create(const uint8_t* rom, int size, const VecEnvConfig* config) {
+    if (config->count <= 0 || config->ram_count < 0) return NULL;
+
+    VecEnv* env = calloc(1, sizeof(VecEnv));
+    if (env == NULL) return NULL;
+
+    VecEnvConfig* c = &env->config;
+    *c = *config;
+    if (c->frame_skip <= 0) c->frame_skip = 1;
+    if (c->obs_scale <= 0) c->obs_scale = 1;
+    if (c->threads <= 0) c->threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (c->threads > c->count) c->threads = c->count;
+    if (c->threads < 1) c->threads = 1;
+
+    env->obs_width = (SCREEN_WIDTH + c->obs_scale - 1) / c->obs_scale;
+    env->obs_height = (SCREEN_HEIGHT + c->obs_scale - 1) / c->obs_scale;
+    env->ram_addrs = malloc((c->ram_count + 1) * sizeof(uint16_t));
+    if (env->ram_addrs == NULL) {
+        gb_vec_destroy(env);
+        return NULL;
+    }
+    if (c->ram_count) memcpy(env->ram_addrs, config->ram_addrs, c->ram_count * sizeof(uint16_t));
+    c->ram_addrs = env->ram_addrs;
+
+    // Template: boot, warm up, remember the start
+    GameBoy* template = gb_create();
+    if (template == NULL) {
+        gb_vec_destroy(env);
+        return NULL;
+    }
+    if (!gb_instance_load_rom(template, rom, size)) {
+        gb_destroy(template);
+        gb_vec_destroy(env);
+        return NULL;
+    }
+    gb_audio_set_enabled(template, false);
+    for (int f = 0; f < c->warmup_frames; f++) gb_instance_step_frame(template);
+
+    env->state_size = gb_state_size(template);
+    env->start_state = malloc(env->state_size);
+    env->start_obs = malloc((size_t) env->obs_width * env->obs_height);
+    env->start_ram = malloc(c->ram_count + 1);
+    env->envs = calloc(c->count, sizeof(GameBoy*));
+    env->steps = calloc(c->count, sizeof(uint32_t));
+    env->buttons = calloc(c->count, 1);
+    bool ok = env->start_state && env->start_obs && env->start_ram && env->envs && env->steps && env->buttons;
+
+    if (ok) {
+        gb_save_state(template, env->start_state, env->state_size);
+        observe_frame(env, template, env->start_obs);
+        observe_ram(env, template, env->start_ram);
+    }
+
+    // Forks share the ROM and every page nobody writes to
+    for (int i = 0; ok && i < c->count; i++) {
+        env->envs[i] = gb_fork(template);
+        ok = env->envs[i] != NULL;
+        if (ok) {
+            gb_audio_set_enabled(env->envs[i], false);
+            env->buttons[i] = template->joypad.pressed;
+        }
+    }
+    gb_destroy(template);
+
+    // Threads last: gb_vec_destroy only tears them down once this is set
+    env->threads = ok ? calloc(c->threads, sizeof(pthread_t)) : NULL;
+    if (env->threads == NULL) {
+        gb_vec_destroy(env);
+        return NULL;
+    }
+
+    pthread_mutex_init(&env->lock, NULL);
+    pthread_cond_init(&env->start, NULL);
+    pthread_cond_init(&env->finished, NULL);
+    for (int i = 0; i < c->threads - 1; i++) {
+        if (pthread_create(&env->threads[i], NULL, vec_worker, env) != 0) break;
+        env->thread_count++;
+    }
+    return env;
+}
+
+
+void gb_vec_destroy(VecEnv* env) {
+    if (env == NULL) return;
+
+    if (env->threads) {
+        pthread_mutex_lock(&env->lock);
+        env->stop = true;
+        pthread_cond_broadcast(&env->start);
+        pthread_mutex_unlock(&env->lock);
+        for (int i = 0; i < env->thread_count; i++) pthread_join(env->threads[i], NULL);
+
+        pthread_mutex_destroy(&env->lock);
+        pthread_cond_destroy(&env->start);
+        pthread_cond_destroy(&env->finished);
+        free(env->threads);
+    }
+
+    for (int i = 0; env->envs && i < env->config.count; i++) gb_destroy(env->envs[i]);
+    free(env->envs);
+    free(env->steps);
+    free(env->buttons);
+    free(env->start_state);
+    free(env->start_obs);
+    free(env->start_ram);
+    free(env->ram_addrs);
+    free(env);
+}
+
+
+void gb_vec_shape(VecEnv* env, int* width, int* height) {
+    *width = env->obs_width;
+    *height = env->obs_height;
+}
+
+
+void gb_vec_reset(VecEnv* env, uint8_t* out_obs, uint8_t* out_ram) {
+    vec_run(env, NULL, out_obs, out_ram, NULL, true);
+}
+
+
+void gb_vec_step(VecEnv* env, const uint8_t* actions, uint8_t* out_obs, uint8_t* out_ram, uint8_t* out_done) {
+    vec_run(env, actions, out_obs, out_ram, out_done, false);
+}
+
+
+GameBoy* gb_vec_instance(VecEnv* env, int index) {
+    return index >= 0 && index < env->config.count ? env->envs[index] : NULL;
+}
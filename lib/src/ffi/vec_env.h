@@ -0,0 +1,49 @@
+#ifndef VEC_ENV_H
+#define VEC_ENV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "_gb.h"
+
+#define VEC_CHUNK 4 // instances a worker takes at a time
+
+// Instances forked from one booted template, stepped by a fixed pool of
+// workers plus the calling thread. A step hands out instances in chunks
+// through `next`; `generation` starts the workers, `running` counts those
+// still busy.
+struct VecEnv {
+    VecEnvConfig config;
+    uint16_t* ram_addrs;
+    int obs_width;
+    int obs_height;
+
+    GameBoy** envs;
+    uint32_t* steps;         // in the current episode
+    uint8_t* buttons;        // pressed mask as last set
+    uint8_t* start_state;    // reset target
+    size_t state_size;
+    uint8_t* start_obs;
+    uint8_t* start_ram;
+
+    // Arguments of the step in progress
+    const uint8_t* actions;
+    uint8_t* out_obs;
+    uint8_t* out_ram;
+    uint8_t* out_done;
+    bool reset;
+    _Atomic int next;
+
+    pthread_t* threads;
+    int thread_count;        // workers, without the caller
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finished;
+    uint64_t generation;
+    int running;
+    bool stop;
+};
+
+#endif
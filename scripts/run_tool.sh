@@ -0,0 +1,29 @@
+#!/bin/bash
+
+# Usage: run_tool.sh <tool> [args...]
+# Builds tools/<tool>.c against the emulator core and runs it.
+# Extra compiler flags come from $TOOL_CFLAGS (e.g. -DGB_STATS).
+
+TOOL="$1"
+shift
+
+SRC_DIR="lib/src/ffi/"
+BUILD_DIR="build"
+OUTPUT="$BUILD_DIR/$TOOL"
+
+CFLAGS="-Wall -Werror -std=c11 -O2 -I$SRC_DIR $TOOL_CFLAGS"
+
+# main.c is the standalone harness, every tool brings its own main()
+SRC_FILES=$(find "$SRC_DIR" -name "*.c" ! -name "main.c")
+
+mkdir -p "$BUILD_DIR"
+
+echo "🔧 Compiling $TOOL..."
+gcc $CFLAGS $SRC_FILES "tools/$TOOL.c" -o "$OUTPUT" -lpthread
+
+if [ $? -ne 0 ]; then
+  echo "Compilation failed"
+  exit 1
+fi
+
+"$OUTPUT" "$@"
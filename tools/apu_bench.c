@@ -0,0 +1,83 @@
+#include "common.h"
+#include "gameboy.h"
+
+// Usage: apu_bench [seconds] [sample_rate]
+// Plays all four channels with a register write every scanline and reports
+// how many output samples per host second the APU synthesizes.
+
+#define CYCLES_PER_FRAME 70224
+#define CYCLES_PER_LINE  456
+
+
+static void start_channels(GameBoy* gb) {
+    MMU* mmu = &gb->mmu;
+
+    mmu_write8(mmu, 0xFF26, 0x80); // power
+    mmu_write8(mmu, 0xFF24, 0x77);
+    mmu_write8(mmu, 0xFF25, 0xFF);
+
+    mmu_write8(mmu, 0xFF10, 0x27); // sweep
+    mmu_write8(mmu, 0xFF11, 0x80);
+    mmu_write8(mmu, 0xFF12, 0xF3);
+    mmu_write8(mmu, 0xFF14, 0x87);
+
+    mmu_write8(mmu, 0xFF16, 0x40);
+    mmu_write8(mmu, 0xFF17, 0xF0);
+    mmu_write8(mmu, 0xFF19, 0x87);
+
+    for (int i = 0; i < 16; i++) {
+        mmu_write8(mmu, 0xFF30 + i, (uint8_t) (i * 0x11));
+    }
+    mmu_write8(mmu, 0xFF1A, 0x80);
+    mmu_write8(mmu, 0xFF1C, 0x20);
+    mmu_write8(mmu, 0xFF1E, 0x87);
+
+    mmu_write8(mmu, 0xFF21, 0xF0);
+    mmu_write8(mmu, 0xFF22, 0x13);
+    mmu_write8(mmu, 0xFF23, 0x80);
+}
+
+
+static double run(int seconds, int rate, bool synth) {
+    GameBoy* gb = gb_create();
+    gb_audio_set_sample_rate(gb, rate);
+    gb_audio_set_enabled(gb, synth);
+    start_channels(gb);
+
+    int frames = seconds * 60;
+    int16_t samples[4096 * 2];
+    uint64_t produced = 0;
+
+    double start = now_seconds();
+    for (int f = 0; f < frames; f++) {
+        for (int line = 0; line < 154; line++) {
+            gb->sched.now += CYCLES_PER_LINE;
+            mmu_write8(&gb->mmu, 0xFF18, (uint8_t) (f + line));
+            mmu_write8(&gb->mmu, 0xFF1D, (uint8_t) (line * 3));
+        }
+        apu_end_frame(&gb->apu);
+
+        size_t n;
+        while ((n = gb_audio_read(gb, samples, 4096)) > 0) produced += n;
+    }
+    double elapsed = now_seconds() - start;
+
+    double emulated = (double) frames * CYCLES_PER_FRAME / APU_CLOCK_RATE;
+    printf("%-10s %8.3f s host  %10.0f samples/s  %8.1fx realtime  (%llu samples)\n",
+           synth ? "synth" : "registers", elapsed,
+           produced / elapsed, emulated / elapsed, (unsigned long long) produced);
+
+    gb_destroy(gb);
+    return elapsed;
+}
+
+
+int main(int argc, char** argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 60;
+    int rate = argc > 2 ? atoi(argv[2]) : 48000;
+
+    printf("APU benchmark: %d s emulated at %d Hz\n", seconds, rate);
+    run(seconds, rate, false);
+    run(seconds, rate, true);
+    return 0;
+}
@@ -0,0 +1,287 @@
+#define _GNU_SOURCE // syscall()
+
+#include "common.h"
+#include "gameboy.h"
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Usage: bench [--frames N] [--out FILE] [--baseline FILE] [--threshold PCT]
+// Runs the fixed workloads below, best of five, and writes the results as
+// JSON (stdout unless --out). With --baseline, every workload whose fps fell
+// by more than the threshold (default 5%) is flagged and the exit status is 1.
+
+#define RUNS 5
+#define CYCLES_PER_FRAME 70224
+#define LINES_PER_FRAME  154
+
+typedef struct {
+    const char* name;
+    const char* rom;
+    void (*setup)(GameBoy* gb);
+    void (*per_frame)(GameBoy* gb, int frame);
+} Workload;
+
+typedef struct {
+    double seconds;
+    uint64_t cycles;
+    uint64_t instructions;
+    int frames;
+    bool counters;
+    uint64_t hw_cycles, hw_instructions, cache_misses, branch_misses;
+} Result;
+
+
+// ---------------------------------------------------------------- workloads
+
+static void headless(GameBoy* gb) {
+    gb_set_video_enabled(gb, false);
+}
+
+
+// Random tiles everywhere and a new scroll position every frame
+static void ppu_setup(GameBoy* gb) {
+    uint32_t x = 12345;
+    for (uint16_t addr = 0x8000; addr < 0xA000; addr++) {
+        x = x * 1103515245 + 12345;
+        mmu_write8(&gb->mmu, addr, (uint8_t) (x >> 16));
+    }
+}
+
+
+static void ppu_frame(GameBoy* gb, int frame) {
+    mmu_write8(&gb->mmu, 0xFF42, (uint8_t) (frame * 3));
+    mmu_write8(&gb->mmu, 0xFF43, (uint8_t) (frame * 5));
+}
+
+
+static void timed(GameBoy* gb) {
+    gb_set_cycle_accurate(gb, true);
+}
+
+
+static const Workload workloads[] = {
+        { "tetris_attract",  "assets/roms/Tetris.gb",                NULL,      NULL },
+        { "cpu_instrs",      "assets/roms/cpu_instrs/cpu_instrs.gb", NULL,      NULL },
+        { "ppu_heavy",       "assets/roms/Tetris.gb",                ppu_setup, ppu_frame },
+        { "headless_skip",   "assets/roms/Tetris.gb",                headless,  NULL },
+        { "cpu_instrs_timed", "assets/roms/cpu_instrs/cpu_instrs.gb", timed,    NULL },
+};
+
+#define WORKLOAD_COUNT (int) (sizeof(workloads) / sizeof(workloads[0]))
+
+
+// ---------------------------------------------------------------- perf counters
+
+#ifdef __linux__
+static const uint64_t counter_config[4] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+
+static int counters_open(int fds[4]) {
+    for (int i = 0; i < 4; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = counter_config[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fds[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] < 0) {
+            while (i-- > 0) close(fds[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static void counters_run(int fds[4], bool start) {
+    for (int i = 0; i < 4; i++) {
+        if (start) ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], start ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+}
+
+
+static void counters_read(int fds[4], Result* r) {
+    uint64_t v[4];
+    for (int i = 0; i < 4; i++) {
+        if (read(fds[i], &v[i], sizeof(uint64_t)) != sizeof(uint64_t)) v[i] = 0;
+        close(fds[i]);
+    }
+    r->hw_cycles = v[0];
+    r->hw_instructions = v[1];
+    r->cache_misses = v[2];
+    r->branch_misses = v[3];
+}
+#else
+static int counters_open(int fds[4]) { return 0; }
+static void counters_run(int fds[4], bool start) {}
+static void counters_read(int fds[4], Result* r) {}
+#endif
+
+
+// ---------------------------------------------------------------- running
+
+static bool run_once(const Workload* w, const uint8_t* rom, size_t rom_size, int frames, Result* r) {
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) rom_size);
+    gb_audio_set_enabled(gb, false);
+    if (w->setup) w->setup(gb);
+
+    int fds[4];
+    r->counters = counters_open(fds);
+
+    uint64_t cycles = gb_get_cycles(gb);
+    uint64_t instructions = gb_get_instructions(gb);
+    if (r->counters) counters_run(fds, true);
+    double start = now_seconds();
+
+    for (int f = 0; f < frames; f++) {
+        if (w->per_frame) w->per_frame(gb, f);
+        gb_instance_step_frame(gb);
+    }
+
+    r->seconds = now_seconds() - start;
+    if (r->counters) {
+        counters_run(fds, false);
+        counters_read(fds, r);
+    }
+    r->cycles = gb_get_cycles(gb) - cycles;
+    r->instructions = gb_get_instructions(gb) - instructions;
+    r->frames = frames;
+
+    gb_destroy(gb);
+    return true;
+}
+
+
+static void write_result(FILE* out, const char* name, const Result* r, bool last) {
+    double fps = r->frames / r->seconds;
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"name\": \"%s\",\n", name);
+    fprintf(out, "      \"frames\": %d,\n", r->frames);
+    fprintf(out, "      \"seconds\": %.6f,\n", r->seconds);
+    fprintf(out, "      \"fps\": %.2f,\n", fps);
+    fprintf(out, "      \"emulated_mhz\": %.3f,\n", r->cycles / r->seconds / 1e6);
+    fprintf(out, "      \"realtime\": %.2f,\n", fps / (4194304.0 / CYCLES_PER_FRAME));
+    fprintf(out, "      \"ns_per_instruction\": %.3f,\n", r->instructions ? r->seconds * 1e9 / r->instructions : 0);
+    fprintf(out, "      \"ns_per_scanline\": %.1f,\n", r->seconds * 1e9 / ((double) r->frames * LINES_PER_FRAME));
+    if (r->counters) {
+        fprintf(out, "      \"counters\": { \"cycles\": %llu, \"instructions\": %llu, "
+                     "\"ipc\": %.3f, \"cache_misses\": %llu, \"branch_misses\": %llu }\n",
+                (unsigned long long) r->hw_cycles, (unsigned long long) r->hw_instructions,
+                r->hw_cycles ? (double) r->hw_instructions / r->hw_cycles : 0,
+                (unsigned long long) r->cache_misses, (unsigned long long) r->branch_misses);
+    } else {
+        fprintf(out, "      \"counters\": null\n");
+    }
+    fprintf(out, "    }%s\n", last ? "" : ",");
+}
+
+
+// Finds "fps" of workload `name` in a file written by write_result
+static double baseline_fps(const char* json, const char* name) {
+    char key[128];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+
+    const char* p = strstr(json, key);
+    if (!p) return 0;
+    p = strstr(p, "\"fps\":");
+    return p ? atof(p + 6) : 0;
+}
+
+
+int main(int argc, char** argv) {
+    int frames = 3000;
+    const char* out_path = NULL;
+    const char* baseline_path = NULL;
+    double threshold = 5;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--frames") == 0) frames = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--out") == 0) out_path = argv[i + 1];
+        else if (strcmp(argv[i], "--baseline") == 0) baseline_path = argv[i + 1];
+        else if (strcmp(argv[i], "--threshold") == 0) threshold = atof(argv[i + 1]);
+    }
+
+    size_t baseline_size;
+    char* baseline = NULL;
+    if (baseline_path) {
+        uint8_t* data = read_file(baseline_path, &baseline_size);
+        if (!data) {
+            fprintf(stderr, "cannot read baseline %s\n", baseline_path);
+            return 1;
+        }
+        baseline = realloc(data, baseline_size + 1);
+        baseline[baseline_size] = 0;
+    }
+
+    // Ядро печатает заголовок ROM; JSON пишем в отдельный поток
+    fflush(stdout);
+    FILE* out = out_path ? fopen(out_path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) return 1;
+
+    Result results[WORKLOAD_COUNT];
+    memset(results, 0, sizeof(results));
+
+    for (int i = 0; i < WORKLOAD_COUNT; i++) {
+        const Workload* w = &workloads[i];
+        size_t rom_size;
+        uint8_t* rom = read_file(w->rom, &rom_size);
+        if (!rom) {
+            fprintf(stderr, "%s: cannot read %s\n", w->name, w->rom);
+            return 1;
+        }
+
+        for (int run = 0; run < RUNS; run++) {
+            Result r;
+            memset(&r, 0, sizeof(r));
+            run_once(w, rom, rom_size, frames, &r);
+            if (run == 0 || r.seconds < results[i].seconds) results[i] = r;
+        }
+        free(rom);
+        fprintf(stderr, "%-16s %8.1f fps  %7.2f MHz  %6.2f ns/instr\n", w->name,
+                results[i].frames / results[i].seconds, results[i].cycles / results[i].seconds / 1e6,
+                results[i].instructions ? results[i].seconds * 1e9 / results[i].instructions : 0);
+    }
+
+    fprintf(out, "{\n  \"frames\": %d,\n  \"runs\": %d,\n  \"workloads\": [\n", frames, RUNS);
+    for (int i = 0; i < WORKLOAD_COUNT; i++) {
+        write_result(out, workloads[i].name, &results[i], i == WORKLOAD_COUNT - 1);
+    }
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+
+    int regressions = 0;
+    if (baseline) {
+        fprintf(stderr, "\nagainst %s (threshold %.1f%%):\n", baseline_path, threshold);
+        for (int i = 0; i < WORKLOAD_COUNT; i++) {
+            double before = baseline_fps(baseline, workloads[i].name);
+            double now = results[i].frames / results[i].seconds;
+            if (before <= 0) {
+                fprintf(stderr, "%-16s not in baseline\n", workloads[i].name);
+                continue;
+            }
+
+            double change = (now - before) * 100 / before;
+            bool regressed = change < -threshold;
+            regressions += regressed;
+            fprintf(stderr, "%-16s %8.1f -> %8.1f fps  %+6.1f%%%s\n", workloads[i].name,
+                    before, now, change, regressed ? "  REGRESSION" : "");
+        }
+        free(baseline);
+    }
+    return regressions ? 1 : 0;
+}
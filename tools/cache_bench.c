@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+#include "common.h"
+#include "gameboy.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Usage: cache_bench [rom] [instances] [frames]
+// Shows which 64-byte lines of struct GameBoy the per-instruction fields
+// occupy, then runs one instance alone and `instances` of them round-robin
+// (one frame each, so every switch starts from a cold cache) and reports
+// frames/s with L1D read misses, LLC misses and dTLB read misses per frame
+// from perf counters, where the kernel allows them.
+
+#define LINE 64
+
+typedef struct {
+    const char* name;
+    size_t offset;
+    size_t size;
+} Field;
+
+#define FIELD(f) { #f, offsetof(GameBoy, f), sizeof(((GameBoy*) 0)->f) }
+
+// Read or written for every instruction by gb_run_loop, cpu_step and the MMU
+static const Field hot[] = {
+        FIELD(cpu.af), FIELD(cpu.bc), FIELD(cpu.de), FIELD(cpu.hl), FIELD(cpu.sp), FIELD(cpu.pc),
+        FIELD(cpu.halted), FIELD(cpu.ime), FIELD(cpu.ime_pending), FIELD(cpu.mmu), FIELD(cpu.profile),
+        FIELD(sched.now), FIELD(sched.next),
+        FIELD(mmu.io[0x0F]), FIELD(mmu.ie), FIELD(mmu.hram), FIELD(mmu.boot_completed), FIELD(mmu.gb),
+        FIELD(trace), FIELD(hidden), FIELD(instructions),
+};
+
+enum { EV_L1D, EV_LLC, EV_DTLB, EV_COUNT };
+
+static const char* event_names[EV_COUNT] = { "L1D misses", "LLC misses", "dTLB misses" };
+static int event_fd[EV_COUNT] = { -1, -1, -1 };
+static FILE* out;             // stdout itself goes to /dev/null: loading a ROM prints
+
+
+static void open_counters() {
+    static const uint64_t configs[EV_COUNT][2] = {
+            { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    };
+    for (int i = 0; i < EV_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = (uint32_t) configs[i][0];
+        attr.config = configs[i][1];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        event_fd[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+
+static void counters(bool enable) {
+    for (int i = 0; i < EV_COUNT; i++) {
+        if (event_fd[i] < 0) continue;
+        if (enable) ioctl(event_fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(event_fd[i], enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+}
+
+
+static void report(const char* label, uint64_t frames, double elapsed) {
+    fprintf(out, "%-18s %8.0f frames/s", label, frames / elapsed);
+    for (int i = 0; i < EV_COUNT; i++) {
+        uint64_t value;
+        if (event_fd[i] >= 0 && read(event_fd[i], &value, sizeof(value)) == sizeof(value))
+            fprintf(out, "  %s %8.0f", event_names[i], (double) value / frames);
+        else
+            fprintf(out, "  %s      n/a", event_names[i]);
+    }
+    fprintf(out, "\n");
+}
+
+
+static void layout() {
+    uint64_t lines[64] = { 0 };
+    int count = 0;
+    size_t last = 0;
+
+    fprintf(out, "struct GameBoy: %zu bytes, alignment %zu\n", sizeof(GameBoy), _Alignof(GameBoy));
+    for (size_t i = 0; i < sizeof(hot) / sizeof(hot[0]); i++) {
+        for (size_t line = hot[i].offset / LINE; line <= (hot[i].offset + hot[i].size - 1) / LINE; line++) {
+            int j = 0;
+            while (j < count && lines[j] != line) j++;
+            if (j == count && count < 64) lines[count++] = line;
+        }
+        if (hot[i].offset + hot[i].size > last) last = hot[i].offset + hot[i].size;
+    }
+    fprintf(out, "per-instruction fields: %d cache line(s), spread over the first %zu bytes\n", count, last);
+    fprintf(out, "page table mmu.pages:   offset %zu, %zu bytes\n",
+           offsetof(GameBoy, mmu.pages), sizeof(((GameBoy*) 0)->mmu.pages));
+    fprintf(out, "framebuffer:            offset %zu\n",
+           (size_t) ((uint8_t*) gb_instance_framebuffer(gb_default()) - (uint8_t*) gb_default()));
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    int count = argc > 2 ? atoi(argv[2]) : 256;
+    int frames = argc > 3 ? atoi(argv[3]) : 2400;
+
+    size_t size;
+    uint8_t* rom = read_file(path, &size);
+    if (!rom || count <= 0 || frames <= 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    fflush(stdout);
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) return 1;
+
+    GameBoy** gbs = calloc(count, sizeof(GameBoy*));
+    for (int i = 0; i < count; i++) {
+        gbs[i] = gb_create();
+        gb_instance_load_rom(gbs[i], rom, (int) size);
+        gb_audio_set_enabled(gbs[i], false);
+    }
+
+    layout();
+    open_counters();
+    if (event_fd[EV_L1D] < 0 && event_fd[EV_LLC] < 0)
+        fprintf(out, "perf counters unavailable (perf_event_paranoid, or no PMU in this VM)\n");
+
+    counters(true);
+    double start = now_seconds();
+    for (int f = 0; f < frames; f++) gb_instance_step_frame(gbs[0]);
+    double elapsed = now_seconds() - start;
+    counters(false);
+    report("1 instance", frames, elapsed);
+
+    int rounds = frames / count > 0 ? frames / count : 1;
+    counters(true);
+    start = now_seconds();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < count; i++) gb_instance_step_frame(gbs[i]);
+    }
+    elapsed = now_seconds() - start;
+    counters(false);
+
+    char label[32];
+    snprintf(label, sizeof(label), "%d round-robin", count);
+    report(label, (uint64_t) rounds * count, elapsed);
+
+    for (int i = 0; i < count; i++) gb_destroy(gbs[i]);
+    free(gbs);
+    free(rom);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef TOOLS_COMMON_H
+#define TOOLS_COMMON_H
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "rom.h" // rom_hash_seeded
+
+// Reads a whole file into a malloc'ed buffer, NULL on failure
+static inline uint8_t* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t* data = len > 0 ? malloc(len) : NULL;
+    if (data && fread(data, 1, len, f) != (size_t) len) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+
+    *size = data ? (size_t) len : 0;
+    return data;
+}
+
+
+static inline double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include "common.h"
+#include "gameboy.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+// Usage: conformance [dir] [jobs] [seconds]   (0: one job per core / built-in budgets)
+// Runs every .gb under `dir` (default assets/roms) in parallel and prints a
+// pass/fail matrix. A ROM passes when it prints "Passed" on serial, or when
+// the result at 0xA000 reads 0 behind the DE B0 61 signature (newer suites);
+// "Failed" or a non-zero result fails it. Each ROM gets a budget of emulated
+// seconds (`seconds` overrides the built-in table) and stops early once it
+// reports.
+
+#define MAX_ROMS     256
+#define TEXT_SIZE    4096
+#define FRAME_RATE   (4194304.0 / 70224)
+
+typedef enum {
+    RESULT_TIMEOUT,
+    RESULT_PASS,
+    RESULT_FAIL,
+    RESULT_ERROR
+} Result;
+
+static const char* result_names[] = { "TIMEOUT", "PASS", "FAIL", "ERROR" };
+
+typedef struct {
+    char path[512];
+    double budget;           // emulated seconds
+    Result result;
+    double emulated;
+    double host;
+    char text[TEXT_SIZE];    // serial output, or the text at 0xA004
+} Job;
+
+static Job jobs[MAX_ROMS];
+static int job_count;
+static atomic_int next_job;
+
+// Multi-test ROMs take longer than the single ones
+static const struct { const char* name; double seconds; } budgets[] = {
+        { "cpu_instrs.gb", 70 },
+        { "dmg_sound.gb",  50 },
+        { "cgb_sound.gb",  50 },
+        { "oam_bug.gb",    30 },
+};
+
+
+static double budget_for(const char* path, double override) {
+    if (override > 0) return override;
+
+    const char* name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    for (size_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+        if (strcmp(name, budgets[i].name) == 0) return budgets[i].seconds;
+    }
+    return 20;
+}
+
+
+static void discover(const char* dir, double override) {
+    DIR* d = opendir(dir);
+    if (!d) return;
+
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL && job_count < MAX_ROMS) {
+        if (e->d_name[0] == '.') continue;
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+
+        size_t len = strlen(e->d_name);
+        if (len > 3 && strcmp(e->d_name + len - 3, ".gb") == 0) {
+            Job* job = &jobs[job_count++];
+            memset(job, 0, sizeof(Job));
+            snprintf(job->path, sizeof(job->path), "%s", path);
+            job->budget = budget_for(path, override);
+        } else {
+            discover(path, override); // не каталог — opendir просто не откроет
+        }
+    }
+    closedir(d);
+}
+
+
+static int compare_jobs(const void* a, const void* b) {
+    return strcmp(((const Job*) a)->path, ((const Job*) b)->path);
+}
+
+
+// Newer suites: 0xA000 status (0x80 while running), DE B0 61, text at 0xA004
+static bool memory_result(GameBoy* gb, Job* job) {
+    MMU* mmu = &gb->mmu;
+    if (mmu_read8(mmu, 0xA001) != 0xDE || mmu_read8(mmu, 0xA002) != 0xB0 || mmu_read8(mmu, 0xA003) != 0x61)
+        return false;
+
+    uint8_t status = mmu_read8(mmu, 0xA000);
+    if (status == 0x80) return false;
+
+    int n = 0;
+    for (uint16_t addr = 0xA004; addr < 0xC000 && n < TEXT_SIZE - 1; addr++) {
+        uint8_t c = mmu_read8(mmu, addr);
+        if (c == 0) break;
+        job->text[n++] = (char) c;
+    }
+    job->text[n] = 0;
+    job->result = status == 0 ? RESULT_PASS : RESULT_FAIL;
+    return true;
+}
+
+
+static void run_job(Job* job) {
+    size_t size;
+    uint8_t* rom = read_file(job->path, &size);
+    if (!rom) {
+        job->result = RESULT_ERROR;
+        snprintf(job->text, TEXT_SIZE, "cannot read ROM");
+        return;
+    }
+
+    GameBoy* gb = gb_create();
+    bool loaded = gb_instance_load_rom(gb, rom, (int) size);
+    free(rom);
+    if (!loaded) {
+        gb_destroy(gb);
+        job->result = RESULT_ERROR;
+        snprintf(job->text, TEXT_SIZE, "cannot map ROM");
+        return;
+    }
+    gb_audio_set_enabled(gb, false);
+
+    size_t text_len = 0;
+    int frames = (int) (job->budget * FRAME_RATE);
+    double start = now_seconds();
+
+    for (int f = 0; f < frames; f++) {
+        gb_instance_step_frame(gb);
+        job->emulated = (f + 1) / FRAME_RATE;
+
+        text_len += gb_serial_read(gb, (uint8_t*) job->text + text_len, TEXT_SIZE - 1 - text_len);
+        job->text[text_len] = 0;
+
+        if (strstr(job->text, "Failed")) {
+            job->result = RESULT_FAIL;
+            break;
+        }
+        if (strstr(job->text, "Passed")) {
+            job->result = RESULT_PASS;
+            break;
+        }
+        // Подпись в памяти проверяем раз в секунду эмуляции
+        if (f % 60 == 59 && memory_result(gb, job)) break;
+    }
+
+    job->host = now_seconds() - start;
+    gb_destroy(gb);
+}
+
+
+static void* worker(void* arg) {
+    int i;
+    while ((i = atomic_fetch_add(&next_job, 1)) < job_count) {
+        run_job(&jobs[i]);
+    }
+    return NULL;
+}
+
+
+// Last non-empty line of the captured text, for the matrix
+static const char* summary(Job* job, char* out, size_t cap) {
+    char* text = job->text;
+    size_t len = strlen(text);
+    while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == ' ')) len--;
+
+    size_t start = len;
+    while (start > 0 && text[start - 1] != '\n') start--;
+
+    size_t n = len - start < cap - 1 ? len - start : cap - 1;
+    memcpy(out, text + start, n);
+    out[n] = 0;
+    return out;
+}
+
+
+// One row per top-level directory (suite)
+static void print_suites(FILE* out, const char* dir) {
+    fprintf(out, "\n%-20s %5s %5s %8s %6s\n", "suite", "pass", "fail", "timeout", "error");
+
+    size_t skip = strlen(dir) + 1;
+    for (int i = 0; i < job_count;) {
+        const char* name = jobs[i].path + skip;
+        size_t len = strcspn(name, "/");
+        int counts[4] = { 0 };
+
+        int j = i;
+        while (j < job_count && strncmp(jobs[j].path + skip, name, len) == 0
+               && (jobs[j].path[skip + len] == '/' || jobs[j].path[skip + len] == 0)) {
+            counts[jobs[j].result]++;
+            j++;
+        }
+
+        fprintf(out, "%-20.*s %5d %5d %8d %6d\n", (int) len, name,
+                counts[RESULT_PASS], counts[RESULT_FAIL], counts[RESULT_TIMEOUT], counts[RESULT_ERROR]);
+        i = j;
+    }
+}
+
+
+int main(int argc, char** argv) {
+    const char* dir = argc > 1 ? argv[1] : "assets/roms";
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    double override = argc > 3 ? atof(argv[3]) : 0;
+    if (threads < 1) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+
+    discover(dir, override);
+    qsort(jobs, job_count, sizeof(Job), compare_jobs);
+    if (job_count == 0) {
+        fprintf(stderr, "no ROMs under %s\n", dir);
+        return 1;
+    }
+
+    // The calling thread works too
+    double start = now_seconds();
+    pthread_t pool[64];
+    if (threads > 64) threads = 64;
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&pool[started], NULL, worker, NULL) == 0) started++;
+    }
+    worker(NULL);
+    for (int i = 0; i < started; i++) pthread_join(pool[i], NULL);
+    threads = started + 1;
+    double elapsed = now_seconds() - start;
+
+    int counts[4] = { 0 };
+    for (int i = 0; i < job_count; i++) {
+        Job* job = &jobs[i];
+        char line[64];
+        counts[job->result]++;
+        printf("%-60s %-7s %6.1f s emu %6.2f s host  %s\n",
+                job->path + strlen(dir) + 1, result_names[job->result],
+                job->emulated, job->host, summary(job, line, sizeof(line)));
+    }
+
+    print_suites(stdout, dir);
+    printf("\n%d ROMs on %d threads in %.1f s: %d passed, %d failed, %d timed out, %d errors\n",
+            job_count, threads, elapsed,
+            counts[RESULT_PASS], counts[RESULT_FAIL], counts[RESULT_TIMEOUT], counts[RESULT_ERROR]);
+    return counts[RESULT_PASS] == job_count ? 0 : 1;
+}
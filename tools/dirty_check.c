@@ -0,0 +1,119 @@
+#include "common.h"
+#include "gameboy.h"
+#include <string.h>
+#include <unistd.h>
+
+// Usage: dirty_check [rom] [frames]
+// Runs the ROM with lines drawn in place, on the render thread and with
+// run-ahead, editing the tile map and scroll register between frames so that
+// some frames are unchanged, some change a band of rows and some change all
+// of them. Every frame's dirty mask is compared with the rows that really
+// differ from the previous frame: it must never miss one, and without
+// run-ahead it must match exactly (after the first frame, which reports every
+// row of the new framebuffer). Reports how much of the 92 KB upload the
+// dirty ranges would save.
+
+#define ROW_BYTES (SCREEN_WIDTH * 4)
+#define MAX_RANGES 8
+
+typedef enum { MODE_IN_PLACE, MODE_THREAD, MODE_RUN_AHEAD } Mode;
+
+static const char* mode_names[] = { "in place", "render thread", "run-ahead 2" };
+
+
+static void edit(GameBoy* gb, int f) {
+    if (f == 0) {
+        for (int i = 0; i < 16; i++) mmu_write8(&gb->mmu, 0x8010 + i, 0xFF); // tile 1: solid
+    }
+    if (f % 3 == 0) {
+        // A band of 8 rows: one map entry toggles between tiles 0 and 1
+        uint16_t entry = 0x9800 + ((f / 3) % 18) * 32 + (f / 54) % 20;
+        mmu_write8(&gb->mmu, entry, mmu_read8(&gb->mmu, entry) == 1 ? 0 : 1);
+    }
+    if (f % 50 == 49) mmu_write8(&gb->mmu, 0xFF42, (uint8_t) (f / 50)); // SCY: everything
+}
+
+
+static bool run(const uint8_t* rom, size_t size, int frames, Mode mode, FILE* out) {
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) size);
+    gb_audio_set_enabled(gb, false);
+    if (mode == MODE_THREAD && !gb_set_render_thread(gb, true)) {
+        fprintf(out, "cannot start the render thread\n");
+        return false;
+    }
+    if (mode == MODE_RUN_AHEAD) gb_set_run_ahead(gb, 2);
+
+    uint32_t (*prev)[SCREEN_WIDTH] = malloc(SCREEN_HEIGHT * ROW_BYTES);
+    memcpy(prev, gb_instance_framebuffer(gb), SCREEN_HEIGHT * ROW_BYTES);
+
+    int missed = 0, extra = 0, unchanged = 0, range_errors = 0;
+    uint64_t dirty_rows = 0, upload_bytes = 0;
+    for (int f = 0; f < frames; f++) {
+        edit(gb, f);
+        gb_instance_step_frame(gb);
+
+        uint32_t mask[PPU_DIRTY_WORDS];
+        bool changed = gb_frame_dirty_mask(gb, mask);
+        DirtyRange ranges[MAX_RANGES];
+        int count = gb_frame_dirty_ranges(gb, ranges, MAX_RANGES);
+
+        uint32_t (*now)[SCREEN_WIDTH] = (uint32_t (*)[SCREEN_WIDTH]) gb_instance_framebuffer(gb);
+        int rows = 0;
+        for (int y = 0; y < SCREEN_HEIGHT; y++) {
+            bool marked = mask[y / 32] >> (y % 32) & 1;
+            bool differs = memcmp(prev[y], now[y], ROW_BYTES) != 0;
+            missed += differs && !marked;
+            extra += marked && !differs && f > 0; // a fresh framebuffer starts all dirty
+            rows += marked;
+
+            // Every marked row falls in a range
+            bool covered = false;
+            for (int r = 0; r < count; r++) covered |= y >= ranges[r].first && y < ranges[r].first + ranges[r].count;
+            range_errors += marked && !covered;
+        }
+        range_errors += changed != (count > 0);
+
+        unchanged += !changed;
+        dirty_rows += rows;
+        for (int r = 0; r < count; r++) upload_bytes += (uint64_t) ranges[r].count * ROW_BYTES;
+        memcpy(prev, now, SCREEN_HEIGHT * ROW_BYTES);
+    }
+
+    bool ok = missed == 0 && range_errors == 0 && (mode == MODE_RUN_AHEAD || extra == 0);
+    fprintf(out, "%-14s %5.1f%% frames unchanged  %5.1f dirty rows/frame  upload %5.1f%% of full  "
+            "missed %d  extra %d  %s\n",
+            mode_names[mode], 100.0 * unchanged / frames, (double) dirty_rows / frames,
+            100.0 * upload_bytes / ((double) frames * SCREEN_HEIGHT * ROW_BYTES),
+            missed, extra, ok ? "ok" : "FAIL");
+
+    free(prev);
+    gb_destroy(gb);
+    return ok;
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    int frames = argc > 2 ? atoi(argv[2]) : 600;
+
+    size_t size;
+    uint8_t* rom = read_file(path, &size);
+    if (!rom || frames <= 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    // Отчёт идёт мимо stdout: загрузка ROM печатает заголовок
+    fflush(stdout);
+    FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) return 1;
+
+    fprintf(out, "%s: %d frames\n", path, frames);
+    int failures = 0;
+    for (Mode m = MODE_IN_PLACE; m <= MODE_RUN_AHEAD; m++) failures += !run(rom, size, frames, m, out);
+
+    fclose(out);
+    free(rom);
+    return failures ? 1 : 0;
+}
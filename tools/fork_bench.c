@@ -0,0 +1,147 @@
+#include "common.h"
+#include "gameboy.h"
+#include <string.h>
+
+// Usage: fork_bench [rom] [seconds]
+// Checks that forks are isolated and deterministic, then measures forks per
+// second, 1-frame rollouts per second and the memory a fork really owns,
+// against a full copy of the instance and its 56 KB of memory. The CPU core
+// does not implement many stores yet, so rollouts also poke RAM directly to
+// show what written pages cost.
+
+#define WARMUP_FRAMES   60
+#define ROLLOUT_FRAMES  1
+#define ROLLOUT_WRITES  16
+
+static volatile uint8_t sink;
+
+static uint8_t* state_a;
+static uint8_t* state_b;
+static size_t state_cap;
+
+
+static bool same_state(GameBoy* a, GameBoy* b) {
+    size_t na = gb_save_state(a, state_a, state_cap);
+    size_t nb = gb_save_state(b, state_b, state_cap);
+    return na == nb && memcmp(state_a, state_b, na) == 0;
+}
+
+
+static bool check_isolation(GameBoy* parent) {
+    uint8_t* before = malloc(state_cap);
+    size_t size = gb_save_state(parent, before, state_cap);
+
+    // Child diverges: parent must not see it
+    GameBoy* child = gb_fork(parent);
+    bool ok = same_state(parent, child);
+    gb_set_button(child, JOYPAD_START, true);
+    for (int i = 0; i < 30; i++) gb_instance_step_frame(child);
+    gb_save_state(parent, state_a, state_cap);
+    ok &= memcmp(before, state_a, size) == 0;
+    gb_destroy(child);
+
+    // Parent and child stepped alike stay identical
+    child = gb_fork(parent);
+    for (int i = 0; i < 30; i++) {
+        gb_instance_step_frame(parent);
+        gb_instance_step_frame(child);
+    }
+    ok &= same_state(parent, child);
+    ok &= memcmp(gb_instance_framebuffer(parent), gb_instance_framebuffer(child), 160 * 144 * 4) == 0;
+    gb_destroy(child);
+
+    free(before);
+    return ok;
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+
+    size_t rom_size;
+    uint8_t* rom = read_file(path, &rom_size);
+    if (!rom) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) rom_size);
+    gb_audio_set_enabled(gb, false);
+    for (int i = 0; i < WARMUP_FRAMES; i++) gb_instance_step_frame(gb);
+
+    state_cap = gb_state_size(gb);
+    state_a = malloc(state_cap);
+    state_b = malloc(state_cap);
+
+    bool ok = check_isolation(gb);
+    printf("isolation and determinism: %s\n", ok ? "ok" : "FAIL");
+
+    MemoryStats mem;
+    gb_memory_stats(gb, &mem);
+    size_t full = mem.instance_bytes + 0xE000;
+
+    // Full copy reference
+    uint64_t n = 0;
+    double start = now_seconds();
+    while (now_seconds() - start < seconds) {
+        for (int i = 0; i < 100; i++, n++) {
+            uint8_t* copy = malloc(full);
+            memcpy(copy, gb, mem.instance_bytes);
+            memset(copy + mem.instance_bytes, (int) n, 0xE000);
+            sink = copy[n % full];
+            free(copy);
+        }
+    }
+    double full_rate = n / (now_seconds() - start);
+
+    n = 0;
+    start = now_seconds();
+    while (now_seconds() - start < seconds) {
+        for (int i = 0; i < 100; i++, n++) gb_destroy(gb_fork(gb));
+    }
+    double fork_rate = n / (now_seconds() - start);
+
+    double rollout_rate[2], pages_per_rollout[2];
+    for (int writes = 0; writes < 2; writes++) {
+        n = 0;
+        uint64_t private_pages = 0;
+        start = now_seconds();
+        while (now_seconds() - start < seconds) {
+            GameBoy* child = gb_fork(gb);
+            gb_set_button(child, (JoypadButton) (n % 8), true);
+            for (int i = 0; i < ROLLOUT_FRAMES; i++) gb_instance_step_frame(child);
+            for (int i = 0; writes && i < ROLLOUT_WRITES; i++) {
+                mmu_write8(&child->mmu, 0xC000 + (uint16_t) ((n * 7919 + i * 131) & 0x1FFF), (uint8_t) i);
+            }
+
+            MemoryStats cm;
+            gb_memory_stats(child, &cm);
+            private_pages += cm.private_pages;
+            if (cm.out_of_memory) {
+                printf("page copy failed: out of memory\n");
+                ok = false;
+            }
+            gb_destroy(child);
+            n++;
+        }
+        rollout_rate[writes] = n / (now_seconds() - start);
+        pages_per_rollout[writes] = (double) private_pages / n;
+    }
+
+    printf("instance struct       %zu bytes (framebuffer, audio buffers, queues)\n", mem.instance_bytes);
+    printf("paged memory          %u pages of %zu bytes\n", mem.pages, mem.page_size);
+    printf("full copy             %10.0f /s  %zu bytes each\n", full_rate, full);
+    printf("fork + destroy        %10.0f /s\n", fork_rate);
+    printf("fork + %d frame        %10.0f /s  %5.1f pages copied (%.0f bytes + struct)\n",
+           ROLLOUT_FRAMES, rollout_rate[0], pages_per_rollout[0], pages_per_rollout[0] * mem.page_size);
+    printf("  + %d RAM writes      %10.0f /s  %5.1f pages copied (%.0f bytes + struct)\n",
+           ROLLOUT_WRITES, rollout_rate[1], pages_per_rollout[1], pages_per_rollout[1] * mem.page_size);
+
+    free(state_a);
+    free(state_b);
+    gb_destroy(gb);
+    free(rom);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+
+// Usage: guest_profile <rom> [frames] [interval] [symbols.sym|-] [out.folded]
+// Runs the ROM with and without the sampling profiler, prints the overhead
+// and the hottest symbols, and writes folded stacks for a flame graph.
+
+#define REPEATS 3
+
+
+static double run(const uint8_t* rom, size_t size, int frames, uint32_t interval, const char* sym,
+                  const char* folded, bool report) {
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) size);
+    gb_audio_set_enabled(gb, false);
+    gb_set_video_enabled(gb, false);
+
+    Profiler* profile = NULL;
+    if (interval) {
+        profile = gb_profile_start(gb, interval);
+        if (sym && !gb_profile_load_symbols(profile, sym))
+            fprintf(stderr, "cannot read %s, addresses only\n", sym);
+    }
+
+    double start = now_seconds();
+    for (int i = 0; i < frames; i++) gb_instance_step_frame(gb);
+    double elapsed = now_seconds() - start;
+
+    if (profile && report) {
+        printf("\n");
+        gb_profile_report(profile, stdout, 25);
+
+        FILE* out = fopen(folded, "w");
+        if (out) {
+            gb_profile_write_folded(profile, out);
+            fclose(out);
+            printf("\nfolded stacks -> %s\n", folded);
+        } else {
+            fprintf(stderr, "cannot write %s\n", folded);
+        }
+    }
+
+    gb_destroy(gb);
+    return elapsed;
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/cpu_instrs/cpu_instrs.gb";
+    int frames = argc > 2 ? atoi(argv[2]) : 600;
+    uint32_t interval = argc > 3 ? (uint32_t) atoi(argv[3]) : 1024;
+    const char* sym = argc > 4 && strcmp(argv[4], "-") != 0 ? argv[4] : NULL;
+    const char* folded = argc > 5 ? argv[5] : "build/profile.folded";
+    if (interval == 0) interval = 1024;
+
+    size_t size;
+    uint8_t* rom = read_file(path, &size);
+    if (!rom) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    // Лучшее из нескольких прогонов, чтобы шум не перекрыл разницу
+    double plain = 1e9, profiled = 1e9;
+    for (int i = 0; i < REPEATS; i++) {
+        double t = run(rom, size, frames, 0, NULL, NULL, false);
+        if (t < plain) plain = t;
+        t = run(rom, size, frames, interval, sym, folded, i == REPEATS - 1);
+        if (t < profiled) profiled = t;
+    }
+
+    printf("\n%s, %d frames: %.1f ms plain, %.1f ms profiled, overhead %+.1f%%\n",
+           path, frames, plain * 1e3, profiled * 1e3, (profiled / plain - 1) * 100);
+    free(rom);
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Usage: library_scan dir [count] [threads]
+// Fills `dir` with `count` synthetic ROMs (valid headers and checksums, sizes
+// 32 KB - 1 MB), then times a full scan, an unchanged rescan, a rescan after
+// touching a tenth of the files and after deleting a few, and opening the
+// index. Every entry is checked against what was generated; a link back up
+// the tree must not be followed.
+
+#define TOUCH_EVERY  10
+#define REMOVE_COUNT 3
+
+
+static void rom_path(char* out, size_t cap, const char* dir, int i) {
+    snprintf(out, cap, "%s/%s%02d/rom_%05d.%s", dir, i % 16 % 3 ? "set" : "SET", i % 16, i, i % 5 ? "gb" : "GBC");
+}
+
+
+static uint8_t* make_rom(int i, size_t* size) {
+    *size = (size_t) 0x8000 << (i % 6);
+    uint8_t* rom = malloc(*size);
+    uint64_t x = ROM_HASH_SEED + (uint64_t) i * 0x9E3779B97F4A7C15ull;
+    for (size_t j = 0; j < *size; j++) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        rom[j] = (uint8_t) x;
+    }
+
+    memset(rom + 0x134, 0, 0x1C);
+    snprintf((char*) rom + 0x134, 16, "GAME %05d", i);
+    rom[0x143] = i % 5 ? 0x00 : 0x80;
+    rom[0x146] = i % 7 == 0 ? 0x03 : 0x00;
+    rom[0x147] = (uint8_t) (i % 4);
+    rom[0x148] = (uint8_t) (i % 6);
+    rom[0x149] = (uint8_t) (i % 4);
+    rom[0x14C] = (uint8_t) (i % 3);
+
+    uint8_t x8 = 0;
+    for (int j = 0x134; j <= 0x14C; j++) x8 = (uint8_t) (x8 - rom[j] - 1);
+    rom[0x14D] = x8;
+
+    uint16_t sum = 0;
+    for (size_t j = 0; j < *size; j++) {
+        if (j != 0x14E && j != 0x14F) sum += rom[j];
+    }
+    rom[0x14E] = (uint8_t) (sum >> 8);
+    rom[0x14F] = (uint8_t) sum;
+    return rom;
+}
+
+
+static bool generate(const char* dir, int count, uint64_t* bytes) {
+    char path[512];
+    mkdir(dir, 0755);
+    for (int d = 0; d < 16; d++) {
+        snprintf(path, sizeof(path), "%s/%s%02d", dir, d % 3 ? "set" : "SET", d);
+        mkdir(path, 0755);
+    }
+    snprintf(path, sizeof(path), "%s/SET00/up", dir);
+    if (symlink("..", path) != 0 && errno != EEXIST) return false;
+
+    *bytes = 0;
+    for (int i = 0; i < count; i++) {
+        size_t size;
+        uint8_t* rom = make_rom(i, &size);
+        rom_path(path, sizeof(path), dir, i);
+        FILE* f = fopen(path, "wb");
+        bool ok = f && fwrite(rom, 1, size, f) == size;
+        if (f) fclose(f);
+        free(rom);
+        if (!ok) return false;
+        *bytes += size;
+    }
+    return true;
+}
+
+
+// Every entry parsed as generated; `removed` ROMs are expected to be gone
+static int verify(RomLibrary* lib, const char* dir, int count, int removed) {
+    int errors = 0;
+    if (gb_library_count(lib) != (size_t) (count - removed)) {
+        printf("  count %zu, expected %d\n", gb_library_count(lib), count - removed);
+        errors++;
+    }
+
+    char path[512];
+    for (size_t k = 0; k < gb_library_count(lib); k++) {
+        const RomInfo* info = gb_library_get(lib, k);
+        int i = atoi(strrchr(info->path, '_') + 1);
+        rom_path(path, sizeof(path), dir, i);
+
+        char title[17];
+        snprintf(title, sizeof(title), "GAME %05d", i);
+        bool ok = strcmp(info->path, path) == 0 && strcmp(info->header.title, title) == 0
+                && info->size == (uint64_t) 0x8000 << (i % 6) && info->header.rom_size == i % 6
+                && info->header.cart_type == i % 4 && info->header.cgb_flag == (i % 5 ? 0 : 0x80)
+                && info->header.header_ok && info->global_ok
+                && (k == 0 || strcmp(gb_library_get(lib, k - 1)->path, info->path) < 0);
+        if (!ok && errors++ < 5) printf("  mismatch %s\n", info->path);
+    }
+    return errors;
+}
+
+
+static void report(const char* label, const LibraryScanStats* s) {
+    printf("%-16s %6u files  %6u scanned  %6u reused  %4u removed  %3u failed  %3u dirs skipped  %8.1f MB hashed  %8.2f ms\n",
+           label, s->files, s->scanned, s->reused, s->removed, s->failed, s->skipped_dirs,
+           s->bytes_hashed / 1048576.0, s->seconds * 1e3);
+}
+
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: library_scan dir [count] [threads]\n");
+        return 2;
+    }
+    const char* dir = argv[1];
+    int count = argc > 2 ? atoi(argv[2]) : 2000;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+
+    char index[512];
+    snprintf(index, sizeof(index), "%s/library.idx", dir);
+    remove(index);
+
+    uint64_t bytes;
+    double start = now_seconds();
+    if (!generate(dir, count, &bytes)) {
+        fprintf(stderr, "cannot write ROMs to %s\n", dir);
+        return 1;
+    }
+    printf("generated %d ROMs, %.1f MB in %.2f s\n\n", count, bytes / 1048576.0, now_seconds() - start);
+
+    int errors = 0;
+    LibraryScanStats stats;
+    RomLibrary* lib = gb_library_open(index);
+    errors += !gb_library_scan(lib, dir, threads, &stats);
+    report("full scan", &stats);
+    errors += verify(lib, dir, count, 0) + (stats.scanned != (uint32_t) count);
+
+    errors += !gb_library_scan(lib, dir, threads, &stats);
+    report("unchanged", &stats);
+    errors += verify(lib, dir, count, 0) + (stats.scanned != 0);
+    gb_library_close(lib);
+
+    // A few ROMs deleted, new mtimes on every TOUCH_EVERY-th of the rest
+    char path[512];
+    int removed = 0;
+    for (int i = 1; i <= REMOVE_COUNT && i < count; i++, removed++) {
+        rom_path(path, sizeof(path), dir, count - i);
+        remove(path);
+    }
+    int touched = 0;
+    struct timespec times[2] = { { time(NULL) + 10, 0 }, { time(NULL) + 10, 0 } };
+    for (int i = 0; i < count - removed; i += TOUCH_EVERY, touched++) {
+        rom_path(path, sizeof(path), dir, i);
+        utimensat(AT_FDCWD, path, times, 0);
+    }
+
+    lib = gb_library_open(index);
+    errors += !gb_library_scan(lib, dir, threads, &stats);
+    report("touched/removed", &stats);
+    errors += verify(lib, dir, count, removed);
+    errors += stats.removed != (uint32_t) removed;
+    errors += stats.scanned != (uint32_t) touched;
+    gb_library_close(lib);
+
+    // Startup path: open only
+    int iters = 20;
+    start = now_seconds();
+    for (int i = 0; i < iters; i++) {
+        lib = gb_library_open(index);
+        errors += gb_library_count(lib) != (size_t) (count - removed);
+        gb_library_close(lib);
+    }
+    printf("%-16s %6d entries  %8.2f ms\n\n", "open index", count - removed, (now_seconds() - start) * 1e3 / iters);
+
+    lib = gb_library_open(index);
+    for (size_t k = 0; k < 4 && k < gb_library_count(lib); k++) {
+        const RomInfo* info = gb_library_get(lib, k);
+        printf("  %-40s %-16s cgb %02X type %02X rom %02X ram %02X  hash %016llx\n",
+               info->path, info->header.title, info->header.cgb_flag, info->header.cart_type,
+               info->header.rom_size, info->header.ram_size, (unsigned long long) info->hash);
+    }
+    gb_library_close(lib);
+
+    printf(errors ? "\n%d check(s) failed\n" : "\nIndex matches generated ROMs\n", errors);
+    return errors ? 1 : 0;
+}
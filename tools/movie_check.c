@@ -0,0 +1,137 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+
+// Usage: movie_check [rom] [frames] [out.gbm]
+//        movie_check play <rom> <movie.gbm>
+// Records a session with scripted input stamped at arbitrary cycles, writes
+// the movie, reads it back into a fresh instance and replays it unthrottled,
+// checking the final framebuffer. Then seeks to random frames and compares
+// each framebuffer against the one seen while recording.
+
+#define SEEKS 50
+
+static const size_t framebuffer_size = 160 * 144 * 4;
+
+
+static GameBoy* load(const char* path) {
+    size_t size;
+    uint8_t* rom = read_file(path, &size);
+    if (!rom) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return NULL;
+    }
+
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) size);
+    gb_audio_set_enabled(gb, false);
+    free(rom);
+    return gb;
+}
+
+
+static bool replay(Movie* movie, GameBoy* gb) {
+    if (!gb_movie_play(movie, gb)) {
+        printf("movie does not match this ROM\n");
+        return false;
+    }
+
+    uint32_t length = gb_movie_length(movie);
+    double start = now_seconds();
+    while (gb_movie_frame(movie) < length) {
+        gb_instance_step_frame(gb);
+    }
+    double elapsed = now_seconds() - start;
+
+    bool ok = gb_movie_verify(movie);
+    printf("replay  %u frames in %.2f s (%.0f fps), final framebuffer %s\n",
+           length, elapsed, length / elapsed, ok ? "matches" : "DIFFERS");
+    return ok;
+}
+
+
+static int play(const char* rom_path, const char* movie_path) {
+    size_t size;
+    uint8_t* data = read_file(movie_path, &size);
+    Movie* movie = data ? gb_movie_open(data, size) : NULL;
+    free(data);
+    if (!movie) {
+        fprintf(stderr, "cannot open movie %s\n", movie_path);
+        return 1;
+    }
+
+    GameBoy* gb = load(rom_path);
+    bool ok = gb && replay(movie, gb);
+    gb_movie_destroy(movie);
+    gb_destroy(gb);
+    return ok ? 0 : 1;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc > 3 && strcmp(argv[1], "play") == 0) return play(argv[2], argv[3]);
+
+    const char* rom = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    int frames = argc > 2 ? atoi(argv[2]) : 3600;
+    const char* out = argc > 3 ? argv[3] : "build/movie.gbm";
+
+    GameBoy* gb = load(rom);
+    if (!gb) return 1;
+
+    // Warm up before recording so the movie starts from a non-reset state
+    for (int i = 0; i < 30; i++) gb_instance_step_frame(gb);
+
+    uint64_t* hashes = malloc((frames + 1) * sizeof(uint64_t));
+    hashes[0] = rom_hash_seeded(gb_instance_framebuffer(gb), framebuffer_size, ROM_HASH_SEED);
+
+    Movie* movie = gb_movie_record(gb, 600);
+    srand(1);
+    for (int f = 0; f < frames; f++) {
+        if (rand() % 8 == 0) {
+            uint64_t at = gb_get_cycles(gb) + rand() % 70224;
+            gb_joypad_event(gb, rand() % 8, rand() % 2, at);
+        }
+        gb_instance_step_frame(gb);
+        hashes[f + 1] = rom_hash_seeded(gb_instance_framebuffer(gb), framebuffer_size, ROM_HASH_SEED);
+    }
+    gb_movie_stop(movie);
+
+    size_t size = gb_movie_size(movie);
+    uint8_t* data = malloc(size);
+    gb_movie_write(movie, data, size);
+    gb_movie_destroy(movie);
+    gb_destroy(gb);
+
+    FILE* f = fopen(out, "wb");
+    if (f) {
+        fwrite(data, 1, size, f);
+        fclose(f);
+    }
+    printf("record  %d frames, movie %zu bytes -> %s\n", frames, size, out);
+
+    movie = gb_movie_open(data, size);
+    free(data);
+    gb = load(rom);
+    bool ok = movie && replay(movie, gb);
+
+    int mismatches = 0;
+    double seek_seconds = 0;
+    for (int i = 0; ok && i < SEEKS; i++) {
+        uint32_t target = 1 + rand() % frames;
+        double start = now_seconds();
+        gb_movie_seek(movie, target);
+        seek_seconds += now_seconds() - start;
+
+        uint64_t hash = rom_hash_seeded(gb_instance_framebuffer(gb), framebuffer_size, ROM_HASH_SEED);
+        if (hash != hashes[target]) mismatches++;
+    }
+    if (ok) {
+        printf("seek    %d random frames, %.2f ms average, %d mismatching\n",
+               SEEKS, seek_seconds * 1e3 / SEEKS, mismatches);
+    }
+
+    gb_movie_destroy(movie);
+    gb_destroy(gb);
+    free(hashes);
+    return ok && mismatches == 0 ? 0 : 1;
+}
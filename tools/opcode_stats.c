@@ -0,0 +1,46 @@
+#include "common.h"
+#include "_gb.h"
+
+// Usage: opcode_stats [rom] [frames] [top]
+// Needs the instrumentation build (make opcode_stats builds with -DGB_STATS).
+// Runs the ROM and prints opcodes sorted by host time spent in them, with a
+// histogram of host ticks per execution, and memory accesses per region.
+
+#ifdef GB_STATS
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/cpu_instrs/cpu_instrs.gb";
+    int frames = argc > 2 ? atoi(argv[2]) : 600;
+    int top = argc > 3 ? atoi(argv[3]) : 40;
+
+    size_t size;
+    uint8_t* rom = read_file(path, &size);
+    if (!rom) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) size);
+    gb_audio_set_enabled(gb, false);
+    gb_stats_reset(gb); // без записи ROM в память
+
+    for (int i = 0; i < frames; i++) gb_instance_step_frame(gb);
+
+    printf("\n%s, %d frames, %llu instructions\n\n", path, frames,
+           (unsigned long long) gb_get_instructions(gb));
+    gb_stats_report(gb, stdout, top);
+
+    gb_destroy(gb);
+    free(rom);
+    return 0;
+}
+
+#else
+
+int main() {
+    fprintf(stderr, "opcode_stats needs the instrumentation build: make opcode_stats\n");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include "common.h"
+#include "recorder.h"
+#include <string.h>
+
+// Usage: rec2png <in.gbrec> <dir> [first] [count]
+// Writes frames of a gb_recorder_start recording as <dir>/frame_000000.png...
+// PNGs are RGBA with stored (uncompressed) deflate blocks, so the tool needs
+// no zlib; recompress with any PNG optimizer if size matters.
+
+#define ROW_BYTES (1 + SCREEN_WIDTH * 4)
+#define IMAGE_BYTES (ROW_BYTES * SCREEN_HEIGHT)
+#define STORED_MAX 65535
+
+static uint32_t crc_table[256];
+
+
+static void crc_init() {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+
+static uint32_t crc32(uint32_t crc, const uint8_t* p, size_t n) {
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
+static uint32_t adler32(const uint8_t* p, size_t n) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < n; i++) {
+        a = (a + p[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return b << 16 | a;
+}
+
+
+static uint8_t* put32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+    return p + 4;
+}
+
+
+static void chunk(FILE* f, const char* type, const uint8_t* data, uint32_t size) {
+    uint8_t head[8];
+    put32(head, size);
+    memcpy(head + 4, type, 4);
+    uint32_t crc = crc32(crc32(0, head + 4, 4), data, size);
+
+    uint8_t tail[4];
+    put32(tail, crc);
+    fwrite(head, 1, 8, f);
+    fwrite(data, 1, size, f);
+    fwrite(tail, 1, 4, f);
+}
+
+
+static bool write_png(const char* path, const uint32_t* rgba) {
+    // Filter byte 0 per row, then R G B A from the 0xRRGGBBAA words
+    static uint8_t raw[IMAGE_BYTES];
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint8_t* row = raw + y * ROW_BYTES;
+        *row++ = 0;
+        for (int x = 0; x < SCREEN_WIDTH; x++) row = put32(row, rgba[y * SCREEN_WIDTH + x]);
+    }
+
+    // zlib stream of stored blocks
+    static uint8_t z[2 + IMAGE_BYTES + 5 * (IMAGE_BYTES / STORED_MAX + 1) + 4];
+    uint8_t* p = z;
+    *p++ = 0x78;
+    *p++ = 0x01;
+    for (size_t pos = 0; pos < IMAGE_BYTES;) {
+        size_t n = IMAGE_BYTES - pos < STORED_MAX ? IMAGE_BYTES - pos : STORED_MAX;
+        *p++ = pos + n == IMAGE_BYTES;
+        *p++ = n & 0xFF;
+        *p++ = n >> 8;
+        *p++ = ~n & 0xFF;
+        *p++ = (~n >> 8) & 0xFF;
+        memcpy(p, raw + pos, n);
+        p += n;
+        pos += n;
+    }
+    p = put32(p, adler32(raw, IMAGE_BYTES));
+
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t ihdr[13];
+    put32(ihdr, SCREEN_WIDTH);
+    put32(ihdr + 4, SCREEN_HEIGHT);
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 6;  // RGBA
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    fwrite(signature, 1, sizeof(signature), f);
+    chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    chunk(f, "IDAT", z, (uint32_t) (p - z));
+    chunk(f, "IEND", NULL, 0);
+    return fclose(f) == 0;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: rec2png <in.gbrec> <dir> [first] [count]\n");
+        return 2;
+    }
+    long first = argc > 3 ? atol(argv[3]) : 0;
+    long count = argc > 4 ? atol(argv[4]) : -1;
+
+    RecReader reader;
+    if (!rec_open(&reader, argv[1])) {
+        fprintf(stderr, "%s: not a recording\n", argv[1]);
+        return 1;
+    }
+    crc_init();
+
+    static uint32_t pixels[REC_PIXELS];
+    char path[4096];
+    long written = 0;
+    long index = 0;
+    double start = now_seconds();
+    for (; count < 0 || written < count; index++) {
+        // Delta frames need every frame before them decoded
+        if (!rec_next(&reader, pixels)) break;
+        if (index < first) continue;
+
+        snprintf(path, sizeof(path), "%s/frame_%06ld.png", argv[2], index);
+        if (!write_png(path, pixels)) {
+            fprintf(stderr, "cannot write %s\n", path);
+            rec_close(&reader);
+            return 1;
+        }
+        written++;
+    }
+    double elapsed = now_seconds() - start;
+
+    // Stopped before the end: the rest of the file is not read
+    bool damaged = !feof(reader.file) && (count < 0 || written < count);
+    rec_close(&reader);
+
+    printf("%ld frames decoded, %ld PNGs written to %s in %.2f s\n", index, written, argv[2], elapsed);
+    if (damaged) fprintf(stderr, "%s: damaged after frame %ld\n", argv[1], index);
+    return damaged ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+#include "common.h"
+#include "_gb.h"
+#include "recorder.h"
+#include <string.h>
+
+// Usage: record_bench [rom] [frames] [out.gbrec]
+// Runs the ROM once bare and once while recording every frame, reports the
+// cost on the emulation thread, encoder time and file size per minute, then
+// decodes the recording and checks every frame against the live framebuffer.
+
+#define FRAME_BYTES (160 * 144 * 4)
+
+
+static void press(GameBoy* gb, int f) {
+    // Some input so the picture keeps changing
+    gb_set_button(gb, JOYPAD_START, (f / 30) % 4 == 0);
+    gb_set_button(gb, JOYPAD_A, (f / 7) % 3 == 0);
+}
+
+
+static GameBoy* boot(const uint8_t* rom, size_t rom_size) {
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) rom_size);
+    gb_audio_set_enabled(gb, false);
+    return gb;
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    int frames = argc > 2 ? atoi(argv[2]) : 3600;
+    const char* out = argc > 3 ? argv[3] : "build/session.gbrec";
+
+    size_t rom_size;
+    uint8_t* rom = read_file(path, &rom_size);
+    if (!rom || frames <= 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    GameBoy* gb = boot(rom, rom_size);
+    double start = now_seconds();
+    for (int f = 0; f < frames; f++) {
+        press(gb, f);
+        gb_instance_step_frame(gb);
+    }
+    double bare = now_seconds() - start;
+    gb_destroy(gb);
+
+    gb = boot(rom, rom_size);
+    Recorder* rec = gb_recorder_start(gb, out, 0);
+    if (rec == NULL) {
+        fprintf(stderr, "cannot create %s\n", out);
+        return 1;
+    }
+
+    uint64_t* hashes = malloc(frames * sizeof(uint64_t));
+    double hashing = 0;
+    start = now_seconds();
+    for (int f = 0; f < frames; f++) {
+        press(gb, f);
+        gb_instance_step_frame(gb);
+
+        double t = now_seconds();
+        hashes[f] = rom_hash_seeded(gb_instance_framebuffer(gb), FRAME_BYTES, ROM_HASH_SEED);
+        hashing += now_seconds() - t;
+    }
+    double recording = now_seconds() - start - hashing;
+
+    RecorderStats stats;
+    bool ok = gb_recorder_stop(rec, &stats);
+    double total = now_seconds() - start - hashing;
+    gb_destroy(gb);
+
+    printf("%s: %d frames -> %s\n", path, frames, out);
+    printf("emulation         %.3f s bare, %.3f s recording (%+.1f%%), %.3f s to drain\n",
+           bare, recording, (recording / bare - 1) * 100, total - recording);
+    printf("encoder           %.1f us/frame (%.0f frames/s), %u stalls\n",
+           stats.encode_us_per_frame, stats.encode_us_per_frame > 0 ? 1e6 / stats.encode_us_per_frame : 0,
+           stats.stalls);
+    printf("file              %llu bytes, %.1f bytes/frame, %.3f MB per minute (raw %.1f MB)\n",
+           (unsigned long long) stats.bytes, (double) stats.bytes / frames,
+           stats.bytes_per_minute / (1 << 20), FRAME_BYTES * 3600.0 / (1 << 20));
+
+    RecReader reader;
+    uint32_t* pixels = malloc(FRAME_BYTES);
+    int decoded = 0;
+    int mismatches = 0;
+    if (ok && rec_open(&reader, out)) {
+        while (decoded < frames && rec_next(&reader, pixels)) {
+            mismatches += rom_hash_seeded(pixels, FRAME_BYTES, ROM_HASH_SEED) != hashes[decoded];
+            decoded++;
+        }
+        rec_close(&reader);
+    }
+
+    bool pass = ok && decoded == frames && mismatches == 0 && stats.frames == (uint64_t) frames;
+    printf("decode            %d/%d frames, %d mismatched: %s\n",
+           decoded, frames, mismatches, pass ? "ok" : "FAIL");
+
+    free(pixels);
+    free(hashes);
+    free(rom);
+    return pass ? 0 : 1;
+}
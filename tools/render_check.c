@@ -0,0 +1,180 @@
+#include "common.h"
+#include "gameboy.h"
+#include <string.h>
+#include <unistd.h>
+
+// Usage: render_check [frames] [rom...]
+// Runs every ROM with lines drawn in place and again on the render thread,
+// hashing each frame, and reports the first frame that differs. A synthetic
+// run that rewrites VRAM and scroll registers between every pair of lines
+// (the CPU mostly leaves them alone) checks that logged writes land in order.
+// A run whose CPU turns the LCD back on at a varying point of a frame, with
+// the screen swapped between white and black every frame, checks that no
+// frame is torn.
+
+#define STRESS_WRITES 64  // VRAM bytes per line
+
+static const char* default_roms[] = {
+        "assets/roms/cpu_instrs/cpu_instrs.gb",
+        "assets/roms/instr_timing/instr_timing.gb",
+        "assets/roms/mem_timing/mem_timing.gb",
+        "assets/roms/interrupt_time/interrupt_time.gb",
+        "assets/roms/oam_bug/oam_bug.gb",
+        "assets/roms/dmg_sound/dmg_sound.gb",
+        "assets/roms/Tetris.gb",
+};
+
+static const size_t framebuffer_size = 160 * 144 * 4;
+
+
+
+static void stress_frame(GameBoy* gb, uint32_t* seed) {
+    for (int line = 0; line < PPU_LINES; line++) {
+        for (int i = 0; i < STRESS_WRITES; i++) {
+            *seed = *seed * 1103515245 + 12345;
+            mmu_write8(&gb->mmu, 0x8000 + (*seed >> 8) % PPU_VRAM_SIZE, (uint8_t) (*seed >> 20));
+        }
+        mmu_write8(&gb->mmu, 0xFF42, (uint8_t) (*seed >> 3));
+        mmu_write8(&gb->mmu, 0xFF43, (uint8_t) (*seed >> 11));
+        gb_tick(gb, PPU_LINE_DOTS);
+    }
+    ppu_finish_frame(&gb->ppu);
+}
+
+
+// Hashes of every frame; NULL `rom` runs the stress pattern
+static double run(const uint8_t* rom, size_t size, int frames, bool threaded, uint64_t* hashes) {
+    GameBoy* gb = gb_create();
+    if (rom) gb_instance_load_rom(gb, rom, (int) size);
+    gb_audio_set_enabled(gb, false);
+    if (threaded && !gb_set_render_thread(gb, true)) {
+        fprintf(stderr, "cannot start the render thread\n");
+        exit(1);
+    }
+
+    uint32_t seed = 1;
+    double start = now_seconds();
+    for (int f = 0; f < frames; f++) {
+        if (rom)
+            gb_instance_step_frame(gb);
+        else
+            stress_frame(gb, &seed);
+        hashes[f] = rom_hash_seeded(gb_instance_framebuffer(gb), framebuffer_size, ROM_HASH_SEED);
+    }
+    double elapsed = now_seconds() - start;
+
+    gb_destroy(gb);
+    return elapsed;
+}
+
+
+static bool check(FILE* out, const char* name, const uint8_t* rom, size_t size, int frames) {
+    uint64_t* a = malloc(frames * sizeof(uint64_t));
+    uint64_t* b = malloc(frames * sizeof(uint64_t));
+
+    double in_place = run(rom, size, frames, false, a);
+    double threaded = run(rom, size, frames, true, b);
+
+    int bad = -1;
+    for (int f = 0; f < frames && bad < 0; f++) {
+        if (a[f] != b[f]) bad = f;
+    }
+
+    if (bad < 0)
+        fprintf(out, "%-48s ok    %8.1f fps in place  %8.1f fps threaded\n", name,
+               frames / in_place, frames / threaded);
+    else
+        fprintf(out, "%-48s FAIL  first difference at frame %d\n", name, bad);
+
+    free(a);
+    free(b);
+    return bad < 0;
+}
+
+
+#define SLED_START 0x150
+#define SLED_NOPS  17000 // 4 cycles each, most of a frame
+
+
+static void fill_tile0(GameBoy* gb, uint8_t value) {
+    for (int i = 0; i < 16; i++) mmu_write8(&gb->mmu, 0x8000 + i, value);
+}
+
+
+// Every frame must be a single colour, and both colours must have been shown
+static bool check_lcd_toggle(FILE* out, int frames) {
+    // NOPs, then set 7, (hl) / jp self
+    uint8_t rom[0x8000] = { 0 };
+    uint16_t end = SLED_START + SLED_NOPS;
+    memcpy(rom + end, (const uint8_t[]) { 0xCB, 0xFE, 0xC3, (end + 2) & 0xFF, (end + 2) >> 8 }, 5);
+
+    bool ok = true;
+    for (int threaded = 0; threaded < 2; threaded++) {
+        GameBoy* gb = gb_create();
+        gb_instance_load_rom(gb, rom, sizeof(rom));
+        gb_audio_set_enabled(gb, false);
+        if (threaded && !gb_set_render_thread(gb, true)) {
+            fprintf(stderr, "cannot start the render thread\n");
+            exit(1);
+        }
+
+        int torn = -1;
+        bool seen[2] = { false, false };
+        for (int f = 0; f < frames && torn < 0; f++) {
+            // The CPU turns the LCD back on after 0 to SLED_NOPS NOPs
+            if (f % 16 == 0) {
+                mmu_write8(&gb->mmu, 0xFF40, 0x11);
+                gb->cpu.hl = 0xFF40;
+                gb->cpu.pc = (uint16_t) (end - (f * 7919) % SLED_NOPS);
+            }
+            fill_tile0(gb, f & 1 ? 0xFF : 0x00);
+            gb_instance_step_frame(gb);
+
+            const uint32_t* fb = gb_instance_framebuffer(gb);
+            for (int i = 1; i < 160 * 144 && torn < 0; i++) {
+                if (fb[i] != fb[0]) torn = f;
+            }
+            seen[fb[0] == 0x000000FF] = true;
+        }
+        gb_destroy(gb);
+
+        const char* mode = threaded ? "threaded" : "in place";
+        if (torn >= 0)
+            fprintf(out, "%-48s FAIL  frame %d is torn (%s)\n", "(LCD toggles)", torn, mode);
+        else if (!seen[0] || !seen[1])
+            fprintf(out, "%-48s FAIL  screen never changed (%s)\n", "(LCD toggles)", mode);
+        ok &= torn < 0 && seen[0] && seen[1];
+    }
+
+    if (ok) fprintf(out, "%-48s ok    no torn frames\n", "(LCD toggles)");
+    return ok;
+}
+
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 600;
+    int count = argc > 2 ? argc - 2 : (int) (sizeof(default_roms) / sizeof(default_roms[0]));
+    const char** roms = argc > 2 ? (const char**) argv + 2 : default_roms;
+    int failures = 0;
+
+    // Загрузка ROM печатает заголовок в stdout; отчёт идёт в копию дескриптора
+    fflush(stdout);
+    FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) return 1;
+
+    for (int i = 0; i < count; i++) {
+        size_t size;
+        uint8_t* rom = read_file(roms[i], &size);
+        if (!rom) {
+            fprintf(out, "%-48s missing\n", roms[i]);
+            continue;
+        }
+        failures += !check(out, roms[i], rom, size, frames);
+        free(rom);
+    }
+    failures += !check(out, "(stress: VRAM and scroll writes every line)", NULL, 0, frames);
+    failures += !check_lcd_toggle(out, frames);
+
+    fprintf(out, failures ? "\n%d run(s) differ\n" : "\nAll frames bit-identical\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+
+// Usage: rewind_bench [rom] [minutes] [budget_mb]
+// Runs the ROM pushing a rewind snapshot every frame and reports memory per
+// minute of rewind and compression time. Then rewinds through the most recent
+// frames and checks each restored state against a raw copy taken while running.
+
+#define CHECK_FRAMES 300
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    int minutes = argc > 2 ? atoi(argv[2]) : 5;
+    size_t budget = (size_t) (argc > 3 ? atoi(argv[3]) : 64) << 20;
+
+    size_t rom_size;
+    uint8_t* rom = read_file(path, &rom_size);
+    if (!rom) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) rom_size);
+    gb_audio_set_enabled(gb, false);
+
+    size_t state_size = gb_state_size(gb);
+    Rewind* rw = gb_rewind_create(gb, budget, 60);
+
+    int frames = minutes * 3600;
+    uint8_t* raw = malloc(state_size * CHECK_FRAMES);
+
+    uint64_t stored = 0;
+    double push_seconds = 0;
+    double start = now_seconds();
+    for (int f = 0; f < frames; f++) {
+        // Some input so the state keeps changing
+        gb_set_button(gb, JOYPAD_START, (f / 30) % 4 == 0);
+        gb_set_button(gb, JOYPAD_A, (f / 7) % 3 == 0);
+        gb_instance_step_frame(gb);
+
+        double t = now_seconds();
+        bool pushed = gb_rewind_push(rw);
+        push_seconds += now_seconds() - t;
+
+        // Unthrottled the emulator can outrun the worker; only pushed frames are kept
+        if (pushed) {
+            gb_save_state(gb, raw + (stored % CHECK_FRAMES) * state_size, state_size);
+            stored++;
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    RewindStats stats;
+    gb_rewind_stats(rw, &stats);
+    printf("%s: %d frames in %.2f s\n", path, frames, elapsed);
+    printf("raw snapshot      %zu bytes (%.1f MB per minute uncompressed)\n",
+           state_size, state_size * 3600.0 / (1 << 20));
+    printf("stored            %u frames (%.1f s) in %.2f MB, dropped %u\n",
+           stats.frames, stats.seconds, stats.bytes / (double) (1 << 20), stats.dropped);
+    printf("memory per minute %.2f MB\n", stats.bytes_per_minute / (1 << 20));
+    printf("compression       %.1f us/frame on the worker\n", stats.compress_us_per_frame);
+    printf("push              %.2f us/frame on the emulation thread\n", push_seconds * 1e6 / frames);
+
+    int failures = 0;
+    uint8_t* now = malloc(state_size);
+    // The newest frame is the current one; each step restores the one before
+    int checks = stored < CHECK_FRAMES ? (int) stored : CHECK_FRAMES;
+    if (checks > (int) stats.frames) checks = (int) stats.frames;
+    if (checks > 0) checks--;
+    for (int i = 0; i < checks; i++) {
+        if (gb_rewind_step(rw, 1) != 1) {
+            failures++;
+            break;
+        }
+        gb_save_state(gb, now, state_size);
+        uint64_t slot = (stored - 2 - i) % CHECK_FRAMES;
+        if (memcmp(now, raw + slot * state_size, state_size) != 0) failures++;
+    }
+
+    printf(failures ? "rewind            %d mismatching frames\n" : "rewind            %d frames restored exactly\n",
+           failures ? failures : checks);
+
+    free(now);
+    free(raw);
+    gb_rewind_destroy(rw);
+    gb_destroy(gb);
+    free(rom);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+#include "common.h"
+#include "gameboy.h"
+#include <string.h>
+#include <unistd.h>
+
+// Usage: rom_share_bench [rom] [instances]
+// Creates the instances with gb_create + gb_instance_load_rom and runs one
+// frame on each, twice: all loading the same ROM, whose pages are then
+// shared through the registry, and each loading a copy with one byte
+// changed, so no two are alike, as when every instance kept its own ROM.
+// Reports resident memory per instance for both runs.
+
+
+static double resident_kb() {
+    long pages = 0, resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024.0);
+}
+
+
+static double run(const char* label, const uint8_t* rom, size_t size, int count, bool unique) {
+    GameBoy** gbs = calloc(count, sizeof(GameBoy*));
+    uint8_t* copy = malloc(size);
+    memcpy(copy, rom, size);
+
+    double before = resident_kb();
+    for (int i = 0; i < count; i++) {
+        if (unique) {
+            copy[size - 1] = rom[size - 1] ^ (uint8_t) i;
+            copy[size - 2] = rom[size - 2] ^ (uint8_t) (i >> 8);
+        }
+        gbs[i] = gb_create();
+        gb_instance_load_rom(gbs[i], copy, (int) size);
+        gb_audio_set_enabled(gbs[i], false);
+        gb_instance_step_frame(gbs[i]);
+    }
+    double used = resident_kb() - before;
+
+    RomCacheStats stats;
+    gb_rom_cache_stats(&stats);
+    fprintf(stderr, "%-8s %5d instances  %8.0f KB resident  %6.1f KB per instance  "
+            "(%u ROM image(s), %zu KB of ROM pages, %u users)\n",
+            label, count, used, used / count, stats.images, stats.bytes / 1024, stats.users);
+
+    for (int i = 0; i < count; i++) gb_destroy(gbs[i]);
+    free(gbs);
+    free(copy);
+    return used;
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    int count = argc > 2 ? atoi(argv[2]) : 1000;
+
+    size_t size;
+    uint8_t* rom = read_file(path, &size);
+    if (!rom || size < 0x150 || count <= 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    // Только отчёт: загрузка ROM печатает заголовок в stdout
+    fflush(stdout);
+    if (!freopen("/dev/null", "w", stdout)) return 1;
+
+    fprintf(stderr, "%s: %zu bytes, GameBoy struct %zu bytes\n", path, size, sizeof(GameBoy));
+    // Shared first: the unique run's freed pages would be reused by the heap
+    double shared = run("shared", rom, size, count, false);
+    double unique = run("unique", rom, size, count, true);
+
+    RomCacheStats stats;
+    gb_rom_cache_stats(&stats);
+    fprintf(stderr, "saved    %.0f KB (%.1f KB per instance); registry empty afterwards: %s\n",
+            unique - shared, (unique - shared) / count, stats.images == 0 ? "yes" : "NO");
+
+    free(rom);
+    return stats.images == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+
+// Usage: run_ahead_bench [rom] [frames] [max_ahead]
+// Runs the ROM with run-ahead 0..max_ahead under the same scripted input and
+// reports the cost per frame. Checks that presented frame k matches frame
+// k + ahead of the plain run (wherever the input did not change in between),
+// which is the latency actually removed, and that the audio stream is
+// unchanged by the hidden frames.
+
+#define AUDIO_FRAMES (1 << 20)
+
+static const size_t framebuffer_size = 160 * 144 * 4;
+
+typedef struct {
+    uint64_t* hashes;
+    int16_t* audio;
+    size_t audio_len;
+} Run;
+
+
+static bool input_at(int frame) {
+    return frame % 40 < 10;
+}
+
+
+static Run run(const uint8_t* rom, size_t rom_size, int frames, int ahead, RunAheadStats* stats) {
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) rom_size);
+    gb_set_run_ahead(gb, ahead);
+
+    Run r = { malloc(frames * sizeof(uint64_t)), malloc(AUDIO_FRAMES * 2 * sizeof(int16_t)), 0 };
+    for (int f = 0; f < frames; f++) {
+        if (f == 0 || input_at(f) != input_at(f - 1)) gb_set_button(gb, JOYPAD_START, input_at(f));
+        gb_instance_step_frame(gb);
+
+        r.hashes[f] = rom_hash_seeded(gb_instance_framebuffer(gb), framebuffer_size, ROM_HASH_SEED);
+        size_t room = AUDIO_FRAMES - r.audio_len;
+        r.audio_len += gb_audio_read(gb, r.audio + r.audio_len * 2, room);
+    }
+
+    gb_run_ahead_stats(gb, stats);
+    gb_destroy(gb);
+    return r;
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    int frames = argc > 2 ? atoi(argv[2]) : 1200;
+    int max_ahead = argc > 3 ? atoi(argv[3]) : 3;
+
+    size_t rom_size;
+    uint8_t* rom = read_file(path, &rom_size);
+    if (!rom) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    RunAheadStats stats;
+    double start = now_seconds();
+    Run base = run(rom, rom_size, frames, 0, &stats);
+    double base_us = (now_seconds() - start) * 1e6 / frames;
+    printf("%s: %d frames, plain run %.1f us/frame\n\n", path, frames, base_us);
+    printf("ahead  frame us  extra us  cost   latency saved  frames matching  audio\n");
+
+    int failures = 0;
+    for (int ahead = 1; ahead <= max_ahead; ahead++) {
+        Run r = run(rom, rom_size, frames, ahead, &stats);
+
+        int checked = 0, matching = 0;
+        for (int k = 0; k + ahead < frames; k++) {
+            bool held = true;
+            for (int j = k + 1; j <= k + ahead; j++) held &= input_at(j) == input_at(k);
+            if (!held) continue;
+            checked++;
+            matching += r.hashes[k] == base.hashes[k + ahead];
+        }
+
+        bool audio_same = r.audio_len == base.audio_len
+                          && memcmp(r.audio, base.audio, r.audio_len * 2 * sizeof(int16_t)) == 0;
+        printf("%5d  %8.1f  %8.1f  %4.2fx  %10.1f ms  %7d / %-7d  %s\n",
+               ahead, stats.frame_us, stats.extra_us,
+               (stats.frame_us + stats.extra_us) / base_us, stats.latency_saved_ms,
+               matching, checked, audio_same ? "identical" : "DIFFERS");
+
+        failures += matching != checked || !audio_same;
+        free(r.hashes);
+        free(r.audio);
+    }
+
+    free(base.hashes);
+    free(base.audio);
+    free(rom);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+
+// Usage: scale_bench [rom] [seconds]
+// Checks every output stage against a plain per-pixel version on a ROM frame
+// and on random 4-colour images of awkward sizes, then reports frames/s and
+// output Mpixels/s per stage on 160x144 frames.
+
+#define W 160
+#define H 144
+#define MAX_OUT (W * 6 * H * 6)
+
+static const uint32_t shades[4] = { 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF, 0x000000FF };
+
+
+static uint32_t at(const uint32_t* src, int w, int h, int x, int y) {
+    x = x < 0 ? 0 : x >= w ? w - 1 : x;
+    y = y < 0 ? 0 : y >= h ? h - 1 : y;
+    return src[y * w + x];
+}
+
+
+static void ref_nearest(const uint32_t* src, int w, int h, int f, uint32_t* dst) {
+    for (int y = 0; y < h * f; y++)
+        for (int x = 0; x < w * f; x++) dst[y * w * f + x] = src[(y / f) * w + x / f];
+}
+
+
+static void ref_scale2x(const uint32_t* src, int w, int h, uint32_t* dst) {
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint32_t b = at(src, w, h, x, y - 1), d = at(src, w, h, x - 1, y), e = at(src, w, h, x, y);
+            uint32_t f = at(src, w, h, x + 1, y), hh = at(src, w, h, x, y + 1);
+            uint32_t e0 = e, e1 = e, e2 = e, e3 = e;
+            if (b != hh && d != f) {
+                e0 = d == b ? d : e;
+                e1 = b == f ? f : e;
+                e2 = d == hh ? d : e;
+                e3 = hh == f ? f : e;
+            }
+            uint32_t* o = dst + (2 * y) * 2 * w + 2 * x;
+            o[0] = e0; o[1] = e1; o[2 * w] = e2; o[2 * w + 1] = e3;
+        }
+    }
+}
+
+
+static void ref_scale3x(const uint32_t* src, int w, int h, uint32_t* dst) {
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint32_t a = at(src, w, h, x - 1, y - 1), b = at(src, w, h, x, y - 1), c = at(src, w, h, x + 1, y - 1);
+            uint32_t d = at(src, w, h, x - 1, y), e = at(src, w, h, x, y), f = at(src, w, h, x + 1, y);
+            uint32_t g = at(src, w, h, x - 1, y + 1), hh = at(src, w, h, x, y + 1), i = at(src, w, h, x + 1, y + 1);
+            uint32_t o[9] = { e, e, e, e, e, e, e, e, e };
+            if (b != hh && d != f) {
+                o[0] = d == b ? d : e;
+                o[1] = (d == b && e != c) || (b == f && e != a) ? b : e;
+                o[2] = b == f ? f : e;
+                o[3] = (d == b && e != g) || (d == hh && e != a) ? d : e;
+                o[5] = (b == f && e != i) || (hh == f && e != c) ? f : e;
+                o[6] = d == hh ? d : e;
+                o[7] = (d == hh && e != i) || (hh == f && e != g) ? hh : e;
+                o[8] = hh == f ? f : e;
+            }
+            for (int r = 0; r < 3; r++)
+                for (int k = 0; k < 3; k++) dst[(3 * y + r) * 3 * w + 3 * x + k] = o[r * 3 + k];
+        }
+    }
+}
+
+
+static uint32_t mix(uint32_t a, uint32_t b, int weight) {
+    uint32_t out = 0;
+    for (int s = 0; s < 32; s += 8) {
+        uint32_t ca = (a >> s) & 0xFF, cb = (b >> s) & 0xFF;
+        out |= ((ca * (256 - weight) + cb * weight) >> 8) << s;
+    }
+    return out;
+}
+
+
+static void ref_lcd(const uint32_t* src, uint32_t* history, int w, int h, int f, int ghost, int grid, uint32_t* dst) {
+    for (int i = 0; i < w * h; i++) history[i] = mix(src[i], history[i], ghost);
+    for (int y = 0; y < h * f; y++) {
+        for (int x = 0; x < w * f; x++) {
+            uint32_t p = history[(y / f) * w + x / f];
+            bool gap = f > 1 && (x % f == f - 1 || y % f == f - 1);
+            dst[y * w * f + x] = gap ? mix(p, 0xFF, grid) | 0xFF : p;
+        }
+    }
+}
+
+
+static int check(const char* what, const uint32_t* src, int w, int h) {
+    static uint32_t got[MAX_OUT], want[MAX_OUT];
+    static uint32_t hist_a[W * H], hist_b[W * H];
+    int failures = 0;
+
+    for (int f = 1; f <= 6; f++) {
+        gb_scale_nearest(src, w, h, f, got);
+        ref_nearest(src, w, h, f, want);
+        if (memcmp(got, want, (size_t) w * h * f * f * 4) != 0) {
+            printf("%s: nearest %dx differs\n", what, f);
+            failures++;
+        }
+    }
+
+    gb_scale2x(src, w, h, got);
+    ref_scale2x(src, w, h, want);
+    if (memcmp(got, want, (size_t) w * h * 16) != 0) {
+        printf("%s: scale2x differs\n", what);
+        failures++;
+    }
+
+    gb_scale3x(src, w, h, got);
+    ref_scale3x(src, w, h, want);
+    if (memcmp(got, want, (size_t) w * h * 36) != 0) {
+        printf("%s: scale3x differs\n", what);
+        failures++;
+    }
+
+    for (int f = 1; f <= 6; f++) {
+        for (int i = 0; i < w * h; i++) hist_a[i] = hist_b[i] = shades[i % 4];
+        gb_lcd_filter(src, hist_a, w, h, f, 96, 64, got);
+        ref_lcd(src, hist_b, w, h, f, 96, 64, want);
+        if (memcmp(got, want, (size_t) w * h * f * f * 4) != 0 || memcmp(hist_a, hist_b, (size_t) w * h * 4) != 0) {
+            printf("%s: lcd %dx differs\n", what, f);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+
+typedef enum { STAGE_NEAREST, STAGE_SCALE2X, STAGE_SCALE3X, STAGE_LCD } Stage;
+
+
+static void bench(const char* name, Stage stage, int factor, const uint32_t* src, double seconds) {
+    static uint32_t out[MAX_OUT];
+    static uint32_t history[W * H];
+    memcpy(history, src, sizeof(history));
+
+    uint64_t frames = 0;
+    double start = now_seconds();
+    double elapsed;
+    do {
+        for (int i = 0; i < 64; i++) {
+            switch (stage) {
+                case STAGE_NEAREST: gb_scale_nearest(src, W, H, factor, out); break;
+                case STAGE_SCALE2X: gb_scale2x(src, W, H, out); break;
+                case STAGE_SCALE3X: gb_scale3x(src, W, H, out); break;
+                case STAGE_LCD:     gb_lcd_filter(src, history, W, H, factor, 96, 64, out); break;
+            }
+        }
+        frames += 64;
+        elapsed = now_seconds() - start;
+    } while (elapsed < seconds);
+
+    double pixels = (double) W * H * factor * factor;
+    printf("%-12s %8.0f frames/s  %7.1f Mpixel/s out  %6.1f us/frame\n",
+           name, frames / elapsed, frames * pixels / elapsed / 1e6, elapsed * 1e6 / frames);
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    double seconds = argc > 2 ? atof(argv[2]) : 0.3;
+
+    static uint32_t frame[W * H];
+    size_t size;
+    uint8_t* rom = read_file(path, &size);
+    if (rom) {
+        GameBoy* gb = gb_create();
+        gb_instance_load_rom(gb, rom, (int) size);
+        gb_audio_set_enabled(gb, false);
+        for (int i = 0; i < 120; i++) gb_instance_step_frame(gb);
+        memcpy(frame, gb_instance_framebuffer(gb), sizeof(frame));
+        gb_destroy(gb);
+        free(rom);
+    }
+
+    int failures = check("rom frame", frame, W, H);
+
+    // Random shades: plenty of the equal neighbours the scalers look for
+    static uint32_t noise[W * H];
+    uint32_t seed = 7;
+    for (int i = 0; i < W * H; i++) {
+        seed = seed * 1103515245 + 12345;
+        noise[i] = shades[(seed >> 16) & 3];
+    }
+    static const int sizes[][2] = { { W, H }, { 157, 31 }, { 3, 5 }, { 1, 1 }, { 9, 2 } };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        char what[32];
+        snprintf(what, sizeof(what), "noise %dx%d", sizes[i][0], sizes[i][1]);
+        failures += check(what, noise, sizes[i][0], sizes[i][1]);
+    }
+    printf("reference check: %s\n\n", failures ? "FAIL" : "ok");
+
+    char name[16];
+    for (int f = 2; f <= 6; f++) {
+        snprintf(name, sizeof(name), "nearest %dx", f);
+        bench(name, STAGE_NEAREST, f, noise, seconds);
+    }
+    bench("scale2x", STAGE_SCALE2X, 2, noise, seconds);
+    bench("scale3x", STAGE_SCALE3X, 3, noise, seconds);
+    bench("lcd 3x", STAGE_LCD, 3, noise, seconds);
+    bench("lcd 6x", STAGE_LCD, 6, noise, seconds);
+    return failures ? 1 : 0;
+}
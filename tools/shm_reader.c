@@ -0,0 +1,128 @@
+#define _GNU_SOURCE // syscall()
+
+#include "common.h"
+#include "shm_export.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// Usage: shm_reader [name] [frames]
+// Example consumer of gb_shm_export, meant to run in another process. Maps the
+// segment read-only, waits for frames on the futex, hashes each newest frame
+// in place (no copy) and checks the seqlock afterwards, and follows the audio
+// ring. Prints what it saw once `frames` frames were read or the writer closed.
+
+#define AUDIO_CHUNK 1024
+
+
+static ShmLayout* open_segment(const char* name) {
+    // Писатель может ещё не успеть создать сегмент
+    for (int tries = 0; tries < 500; tries++) {
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd >= 0) {
+            ShmLayout* shm = mmap(NULL, sizeof(ShmLayout), PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (shm != MAP_FAILED && shm->magic == SHM_MAGIC) return shm;
+            if (shm != MAP_FAILED) munmap(shm, sizeof(ShmLayout));
+        }
+        usleep(10000);
+    }
+    return NULL;
+}
+
+
+static void wait_frame(ShmLayout* shm, uint32_t seen) {
+#ifdef __linux__
+    struct timespec timeout = { 0, 100 * 1000000 };
+    syscall(SYS_futex, &shm->futex, FUTEX_WAIT, seen, &timeout, NULL, 0);
+#else
+    usleep(1000);
+#endif
+}
+
+
+int main(int argc, char** argv) {
+    const char* name = argc > 1 ? argv[1] : "/gameboy";
+    uint64_t want = argc > 2 ? strtoull(argv[2], NULL, 10) : 600;
+
+    ShmLayout* shm = open_segment(name);
+    if (shm == NULL || shm->version != SHM_VERSION || shm->size != sizeof(ShmLayout)) {
+        fprintf(stderr, "no version %d segment at %s\n", SHM_VERSION, name);
+        return 1;
+    }
+
+    uint64_t read = 0, missed = 0, torn = 0, last = 0, hash = ROM_HASH_SEED;
+    uint64_t audio_pos = atomic_load(&shm->audio_head), audio_frames = 0, audio_lost = 0;
+    double peak = 0, start = now_seconds();
+
+    while (read < want) {
+        uint32_t seen = atomic_load_explicit(&shm->futex, memory_order_acquire);
+        uint64_t n = atomic_load_explicit(&shm->frames, memory_order_acquire);
+
+        if (n != last && n > 0) {
+            const ShmSlot* slot = &shm->slots[(n - 1) % SHM_SLOTS];
+            uint32_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+            uint64_t h = rom_hash_seeded(slot->pixels, sizeof(slot->pixels), ROM_HASH_SEED);
+            uint64_t frame = slot->frame;
+            atomic_thread_fence(memory_order_acquire);
+            uint32_t after = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+            if ((before & 1) || before != after || frame != n) {
+                torn++;
+            } else {
+                if (last && n > last + 1) missed += n - last - 1;
+                hash = rom_hash_seeded(&h, sizeof(h), hash);
+                read++;
+            }
+            last = n;
+        }
+
+        // Аудио: всё новое с прошлого раза, если его ещё не перезаписали
+        uint64_t head = atomic_load_explicit(&shm->audio_head, memory_order_acquire);
+        if (head - audio_pos > SHM_AUDIO_FRAMES) {
+            audio_lost += head - SHM_AUDIO_FRAMES - audio_pos;
+            audio_pos = head - SHM_AUDIO_FRAMES;
+        }
+        while (audio_pos < head) {
+            int16_t chunk[AUDIO_CHUNK * 2];
+            uint64_t n_frames = head - audio_pos < AUDIO_CHUNK ? head - audio_pos : AUDIO_CHUNK;
+            for (uint64_t i = 0; i < n_frames; i++) {
+                uint32_t slot = (uint32_t) ((audio_pos + i) & (SHM_AUDIO_FRAMES - 1));
+                chunk[i * 2] = shm->audio[slot * 2];
+                chunk[i * 2 + 1] = shm->audio[slot * 2 + 1];
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&shm->audio_write, memory_order_relaxed) - audio_pos > SHM_AUDIO_FRAMES) {
+                audio_lost += n_frames; // перезаписано во время копирования
+            } else {
+                for (uint64_t i = 0; i < n_frames * 2; i++) {
+                    double v = chunk[i] < 0 ? -chunk[i] : chunk[i];
+                    if (v > peak) peak = v;
+                }
+                audio_frames += n_frames;
+            }
+            audio_pos += n_frames;
+        }
+
+        if (atomic_load(&shm->closed)) break;
+        if (atomic_load_explicit(&shm->frames, memory_order_acquire) == last) wait_frame(shm, seen);
+    }
+
+    double elapsed = now_seconds() - start;
+    printf("%s: %llu frames read (%.1f fps), %llu skipped, %llu torn, hash of frame hashes %016llx\n",
+           name, (unsigned long long) read, read / elapsed, (unsigned long long) missed,
+           (unsigned long long) torn, (unsigned long long) hash);
+    printf("audio: %llu frames at %u Hz (%.1f s), %llu lost, peak %.0f\n",
+           (unsigned long long) audio_frames, shm->sample_rate,
+           shm->sample_rate ? (double) audio_frames / shm->sample_rate : 0,
+           (unsigned long long) audio_lost, peak);
+
+    munmap(shm, sizeof(ShmLayout));
+    return 0;
+}
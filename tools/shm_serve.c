@@ -0,0 +1,64 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+
+// Usage: shm_serve [rom] [frames] [name] [fps]
+// Runs the ROM and publishes it through gb_shm_export for shm_reader (or any
+// other reader) to pick up. fps 0 runs unthrottled. Reports the publishing
+// cost per frame against a run without the export.
+
+
+static void sleep_until(double t) {
+    double left = t - now_seconds();
+    if (left <= 0) return;
+    struct timespec ts = { (time_t) left, (long) ((left - (time_t) left) * 1e9) };
+    nanosleep(&ts, NULL);
+}
+
+
+static double run(const uint8_t* rom, size_t size, int frames, const char* name, double fps) {
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) size);
+
+    ShmExport* ex = NULL;
+    if (name && (ex = gb_shm_export(gb, name)) == NULL) {
+        fprintf(stderr, "cannot create shared memory %s\n", name);
+        exit(1);
+    }
+
+    int16_t audio[4096 * 2];
+    double busy = 0, start = now_seconds();
+    for (int f = 0; f < frames; f++) {
+        double t = now_seconds();
+        gb_instance_step_frame(gb);
+        busy += now_seconds() - t;
+        while (gb_audio_read(gb, audio, 4096) > 0) {} // как обычный хост
+        if (fps > 0) sleep_until(start + (f + 1) / fps);
+    }
+
+    gb_shm_close(ex);
+    gb_destroy(gb);
+    return busy;
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    int frames = argc > 2 ? atoi(argv[2]) : 600;
+    const char* name = argc > 3 ? argv[3] : "/gameboy";
+    double fps = argc > 4 ? atof(argv[4]) : 60;
+
+    size_t size;
+    uint8_t* rom = read_file(path, &size);
+    if (!rom) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    double plain = run(rom, size, frames, NULL, 0);
+    double exported = run(rom, size, frames, name, fps);
+    printf("\n%d frames to %s: %.1f us/frame emulating, %.1f us/frame with the export (%+.1f us)\n",
+           frames, name, plain * 1e6 / frames, exported * 1e6 / frames, (exported - plain) * 1e6 / frames);
+    free(rom);
+    return 0;
+}
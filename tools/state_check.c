@@ -0,0 +1,102 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+
+// Usage: state_check [rom...]
+// For every ROM: run a while, save, run on and hash; load the save, run the
+// same stretch again and compare. Also times save and load.
+
+#define WARMUP_FRAMES 30
+#define CHECK_FRAMES  120
+#define TIMING_ITERS  10000
+
+static const char* default_roms[] = {
+        "assets/roms/cpu_instrs/cpu_instrs.gb",
+        "assets/roms/instr_timing/instr_timing.gb",
+        "assets/roms/mem_timing/mem_timing.gb",
+        "assets/roms/mem_timing-2/mem_timing.gb",
+        "assets/roms/interrupt_time/interrupt_time.gb",
+        "assets/roms/oam_bug/oam_bug.gb",
+        "assets/roms/dmg_sound/dmg_sound.gb",
+        "assets/roms/cgb_sound/cgb_sound.gb",
+        "assets/roms/Tetris.gb",
+};
+
+
+static uint64_t run_and_hash(GameBoy* gb, uint8_t* scratch, size_t cap) {
+    for (int i = 0; i < CHECK_FRAMES; i++) {
+        gb_instance_step_frame(gb);
+    }
+
+    size_t size = gb_save_state(gb, scratch, cap);
+    uint64_t hash = rom_hash_seeded(scratch, size, ROM_HASH_SEED);
+    return rom_hash_seeded(gb_instance_framebuffer(gb), 160 * 144 * 4, hash);
+}
+
+
+static bool check_rom(const char* path) {
+    size_t rom_size;
+    uint8_t* rom = read_file(path, &rom_size);
+    if (!rom) {
+        printf("%-48s missing\n", path);
+        return true;
+    }
+
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) rom_size);
+    gb_audio_set_enabled(gb, false);
+
+    for (int i = 0; i < WARMUP_FRAMES; i++) {
+        gb_instance_step_frame(gb);
+    }
+
+    size_t cap = gb_state_size(gb);
+    uint8_t* saved = malloc(cap);
+    uint8_t* again = malloc(cap);
+    uint8_t* scratch = malloc(cap);
+    size_t size = gb_save_state(gb, saved, cap);
+
+    uint64_t first = run_and_hash(gb, scratch, cap);
+
+    bool loaded = gb_load_state(gb, saved, size);
+    bool identical = gb_save_state(gb, again, cap) == size && memcmp(saved, again, size) == 0;
+    uint64_t second = run_and_hash(gb, scratch, cap);
+
+    double start = now_seconds();
+    for (int i = 0; i < TIMING_ITERS; i++) {
+        gb_save_state(gb, scratch, cap);
+    }
+    double save_us = (now_seconds() - start) * 1e6 / TIMING_ITERS;
+
+    start = now_seconds();
+    for (int i = 0; i < TIMING_ITERS; i++) {
+        gb_load_state(gb, saved, size);
+    }
+    double load_us = (now_seconds() - start) * 1e6 / TIMING_ITERS;
+
+    bool ok = loaded && identical && first == second;
+    printf("%-48s %s  %zu bytes  save %.2f us  load %.2f us\n",
+           path, ok ? "ok  " : "FAIL", size, save_us, load_us);
+
+    free(saved);
+    free(again);
+    free(scratch);
+    gb_destroy(gb);
+    free(rom);
+    return ok;
+}
+
+
+int main(int argc, char** argv) {
+    int failures = 0;
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) failures += !check_rom(argv[i]);
+    } else {
+        int count = sizeof(default_roms) / sizeof(default_roms[0]);
+        for (int i = 0; i < count; i++) failures += !check_rom(default_roms[i]);
+    }
+
+    printf(failures ? "\n%d ROM(s) not deterministic across save/load\n" : "\nAll round trips deterministic\n", failures);
+    return failures ? 1 : 0;
+}
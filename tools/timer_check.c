@@ -0,0 +1,160 @@
+#include "common.h"
+#include "gameboy.h"
+#include <string.h>
+
+// Usage: timer_check [steps] [seed]
+// Drives the lazy timer and a per-cycle reference model with the same random
+// DIV/TIMA/TMA/TAC writes, one M-cycle at a time, and compares DIV, TIMA and
+// the timer interrupt. Writes favour TIMA values near overflow so the reload
+// window, its cancellation and TMA writes during it come up often.
+
+#define WRITE_ONE_IN 6
+#define READ_ONE_IN  5
+
+// Hardware as documented: a 16-bit counter ticking every cycle, TIMA ticking
+// on falling edges of the selected bit ANDed with the enable bit, and 4
+// cycles at 00 after an overflow before TMA is loaded
+typedef struct {
+    uint16_t counter;
+    uint8_t tima, tma, tac;
+    int reload_in;          // cycles until the reload, 0: none pending
+    uint64_t reload_end;    // TMA writes reach TIMA until here
+    uint64_t now;
+    bool irq;
+} RefTimer;
+
+
+static bool ref_signal(const RefTimer* t) {
+    static const int bits[4] = { 9, 3, 5, 7 };
+    return (t->tac & 0x04) && (t->counter >> bits[t->tac & 3] & 1);
+}
+
+
+static void ref_tick(RefTimer* t) {
+    if (t->reload_in) return;
+    if (++t->tima == 0) t->reload_in = 4;
+}
+
+
+static void ref_cycle(RefTimer* t) {
+    bool before = ref_signal(t);
+    t->counter++;
+    t->now++;
+
+    if (t->reload_in && --t->reload_in == 0) {
+        t->tima = t->tma;
+        t->irq = true;
+        t->reload_end = t->now + 4;
+    }
+    if (before && !ref_signal(t)) ref_tick(t);
+}
+
+
+static void ref_write(RefTimer* t, uint16_t addr, uint8_t val) {
+    bool before = ref_signal(t);
+    switch (addr) {
+        case 0xFF04:
+            t->counter = 0;
+            if (before && !ref_signal(t)) ref_tick(t);
+            break;
+        case 0xFF05:
+            if (t->now < t->reload_end) break;
+            t->reload_in = 0;
+            t->tima = val;
+            break;
+        case 0xFF06:
+            t->tma = val;
+            if (t->now < t->reload_end) t->tima = val;
+            break;
+        default:
+            t->tac = val | 0xF8;
+            if (before && !ref_signal(t)) ref_tick(t);
+            break;
+    }
+}
+
+
+static uint32_t next_random(uint32_t* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+
+static uint8_t random_value(uint16_t addr, uint32_t* seed) {
+    uint32_t r = next_random(seed);
+    switch (addr) {
+        case 0xFF05:
+        case 0xFF06: return r % 3 ? (uint8_t) (0xFD + r % 3) : (uint8_t) (r >> 4);
+        case 0xFF07: return (uint8_t) ((r % 5 ? 0x04 : 0) | (r >> 4 & 3));
+        default:     return (uint8_t) r;
+    }
+}
+
+
+int main(int argc, char** argv) {
+    long steps = argc > 1 ? atol(argv[1]) : 2000000;
+    uint32_t seed = argc > 2 ? (uint32_t) atoi(argv[2]) : 1;
+
+    GameBoy* gb = gb_create();
+    gb_set_video_enabled(gb, false);
+    Timer* timer = &gb->timer;
+
+    RefTimer ref = { 0 };
+    ref.counter = (uint16_t) (gb->sched.now - timer->div_base);
+    ref.tima = timer->tima;
+    ref.tma = timer->tma;
+    ref.tac = timer->tac;
+    ref.now = gb->sched.now;
+
+    static const char* names[4] = { "DIV", "TIMA", "TMA", "TAC" };
+    uint64_t writes[4] = { 0 };
+    uint64_t interrupts = 0;
+    long bad = -1;
+    const char* what = "";
+
+    for (long i = 0; i < steps && bad < 0; i++) {
+        if (next_random(&seed) % WRITE_ONE_IN == 0) {
+            uint16_t addr = (uint16_t) (0xFF04 + next_random(&seed) % 4);
+            uint8_t val = random_value(addr, &seed);
+            timer_write(timer, addr, val);
+            ref_write(&ref, addr, val);
+            writes[addr - 0xFF04]++;
+        }
+
+        gb_tick(gb, 4);
+        for (int c = 0; c < 4; c++) ref_cycle(&ref);
+
+        bool irq = gb->mmu.io[0x0F] & (1 << INT_TIMER);
+        gb->mmu.io[0x0F] &= ~(1 << INT_TIMER);
+        if (irq != ref.irq) {
+            bad = i;
+            what = "interrupt";
+        }
+        interrupts += ref.irq;
+        ref.irq = false;
+
+        // Не каждый шаг: чтение синхронизирует TIMA и скрыло бы ошибки подсчёта фронтов
+        if (bad < 0 && next_random(&seed) % READ_ONE_IN == 0) {
+            if (timer_read(timer, 0xFF05) != ref.tima) {
+                bad = i;
+                what = "TIMA";
+            } else if (timer_read(timer, 0xFF04) != ref.counter >> 8) {
+                bad = i;
+                what = "DIV";
+            }
+        }
+    }
+
+    printf("%ld M-cycles, %llu timer interrupts, writes:", steps, (unsigned long long) interrupts);
+    for (int i = 0; i < 4; i++) printf(" %s %llu", names[i], (unsigned long long) writes[i]);
+    printf("\n");
+
+    if (bad >= 0) {
+        printf("FAIL  %s differs at M-cycle %ld: TIMA %02X / %02X, TMA %02X, TAC %02X\n", what, bad,
+               timer_read(timer, 0xFF05), ref.tima, ref.tma, ref.tac);
+    } else {
+        printf("Timer matches the per-cycle reference model\n");
+    }
+    gb_destroy(gb);
+    return bad >= 0 ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+#include "common.h"
+#include "_gb.h"
+#include "trace.h"
+#include <string.h>
+
+// Usage: trace_log record <rom> <frames> <out.bin>
+//        trace_log decode <in.bin> [--cycles]
+// record runs the ROM three times (untraced, ring, file) and prints what the
+// trace costs; decode prints a trace file as a Gameboy Doctor log, one line
+// per instruction, optionally prefixed with the cycle it started at.
+
+#define RING_RECORDS 65536
+#define DECODE_BATCH 4096
+
+
+static double run(const uint8_t* rom, size_t size, int frames, const char* path, uint32_t ring,
+                  uint64_t* instructions, bool* ok) {
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) size);
+    gb_audio_set_enabled(gb, false);
+    gb_set_video_enabled(gb, false);
+
+    Trace* trace = ring || path ? gb_trace_start(gb, path, ring) : NULL;
+    if ((ring || path) && trace == NULL) {
+        *ok = false;
+        gb_destroy(gb);
+        return 0;
+    }
+
+    double start = now_seconds();
+    for (int i = 0; i < frames; i++) gb_instance_step_frame(gb);
+    if (trace) *ok = gb_trace_stop(trace) && *ok;
+    double elapsed = now_seconds() - start;
+
+    *instructions = gb_get_instructions(gb);
+    gb_destroy(gb);
+    return elapsed;
+}
+
+
+static int record(const char* rom_path, int frames, const char* out) {
+    size_t size;
+    uint8_t* rom = read_file(rom_path, &size);
+    if (!rom) {
+        fprintf(stderr, "cannot read %s\n", rom_path);
+        return 1;
+    }
+
+    bool ok = true;
+    uint64_t n;
+    double plain = run(rom, size, frames, NULL, 0, &n, &ok);
+    double ring = run(rom, size, frames, NULL, RING_RECORDS, &n, &ok);
+    double file = run(rom, size, frames, out, 0, &n, &ok);
+    free(rom);
+
+    if (!ok) {
+        fprintf(stderr, "cannot write %s\n", out);
+        return 1;
+    }
+
+    printf("\n%s, %d frames, %llu instructions, %zu bytes per record\n", rom_path, frames,
+           (unsigned long long) n, sizeof(TraceRecord));
+    printf("  untraced  %8.1f ms\n", plain * 1e3);
+    printf("  ring      %8.1f ms  %.2fx\n", ring * 1e3, ring / plain);
+    printf("  file      %8.1f ms  %.2fx  -> %s (%.1f MB)\n", file * 1e3, file / plain, out,
+           (double) (n * sizeof(TraceRecord) + sizeof(TraceHeader)) / (1 << 20));
+    return 0;
+}
+
+
+static int decode(const char* path, bool cycles) {
+    FILE* in = fopen(path, "rb");
+    if (!in) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != TRACE_MAGIC
+            || header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s: not a version %d trace\n", path, TRACE_VERSION);
+        fclose(in);
+        return 1;
+    }
+
+    static TraceRecord batch[DECODE_BATCH];
+    size_t n;
+    while ((n = fread(batch, sizeof(TraceRecord), DECODE_BATCH, in)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            TraceRecord* r = &batch[i];
+            if (cycles) printf("%llu ", (unsigned long long) r->cycle);
+            printf("A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X "
+                   "PCMEM:%02X,%02X,%02X,%02X\n",
+                   r->af >> 8, r->af & 0xFF, r->bc >> 8, r->bc & 0xFF,
+                   r->de >> 8, r->de & 0xFF, r->hl >> 8, r->hl & 0xFF,
+                   r->sp, r->pc, r->mem[0], r->mem[1], r->mem[2], r->mem[3]);
+        }
+    }
+
+    fclose(in);
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc >= 5 && strcmp(argv[1], "record") == 0)
+        return record(argv[2], atoi(argv[3]), argv[4]);
+    if (argc >= 3 && strcmp(argv[1], "decode") == 0)
+        return decode(argv[2], argc > 3 && strcmp(argv[3], "--cycles") == 0);
+
+    fprintf(stderr, "usage: trace_log record <rom> <frames> <out.bin>\n"
+                    "       trace_log decode <in.bin> [--cycles]\n");
+    return 2;
+}
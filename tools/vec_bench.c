@@ -0,0 +1,117 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+#include <unistd.h>
+
+// Usage: vec_bench [rom] [count] [seconds]
+// Steps `count` instances in lockstep with random joypad masks through
+// gb_vec_step and reports steps per second for 1, 2, 4... threads up to the
+// CPUs online. First checks that the multi-threaded observations match a
+// single-threaded run step for step.
+
+#define CHECK_STEPS 120
+
+static const uint16_t ram_addrs[] = { 0xFF44, 0xFF41, 0xFF00, 0xC000, 0xC001, 0xFF80 };
+
+
+static uint32_t next_random(uint32_t* s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+
+static VecEnv* create(const uint8_t* rom, size_t size, int count, int threads) {
+    VecEnvConfig config = {
+            .count = count,
+            .threads = threads,
+            .frame_skip = 4,
+            .obs_scale = 2,
+            .ram_addrs = ram_addrs,
+            .ram_count = sizeof(ram_addrs) / sizeof(ram_addrs[0]),
+            .warmup_frames = 30,
+            .max_steps = 500,
+    };
+    return gb_vec_create(rom, (int) size, &config);
+}
+
+
+// Observations, RAM and done flags of CHECK_STEPS steps, hashed
+static uint64_t rollout_hash(VecEnv* env, int count, uint8_t* obs, uint8_t* ram, uint8_t* done, uint8_t* actions) {
+    int w, h;
+    gb_vec_shape(env, &w, &h);
+    size_t ram_count = sizeof(ram_addrs) / sizeof(ram_addrs[0]);
+
+    uint32_t seed = 12345;
+    uint64_t hash = ROM_HASH_SEED;
+    gb_vec_reset(env, obs, ram);
+    for (int s = 0; s < CHECK_STEPS; s++) {
+        for (int i = 0; i < count; i++) actions[i] = (uint8_t) next_random(&seed);
+        gb_vec_step(env, actions, obs, ram, done);
+        hash = rom_hash_seeded(obs, (size_t) count * w * h, hash);
+        hash = rom_hash_seeded(ram, count * ram_count, hash);
+        hash = rom_hash_seeded(done, count, hash);
+    }
+    return hash;
+}
+
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "assets/roms/Tetris.gb";
+    int count = argc > 2 ? atoi(argv[2]) : 256;
+    double seconds = argc > 3 ? atof(argv[3]) : 2.0;
+    int cpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    size_t rom_size;
+    uint8_t* rom = read_file(path, &rom_size);
+    if (!rom || count <= 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    uint8_t* obs = malloc((size_t) count * 160 * 144);
+    uint8_t* ram = malloc((size_t) count * 64);
+    uint8_t* done = malloc(count);
+    uint8_t* actions = malloc(count);
+
+    VecEnv* env = create(rom, rom_size, count, 1);
+    uint64_t single = rollout_hash(env, count, obs, ram, done, actions);
+    gb_vec_destroy(env);
+
+    int threads = cpus > 1 ? cpus : 2;
+    env = create(rom, rom_size, count, threads);
+    uint64_t multi = rollout_hash(env, count, obs, ram, done, actions);
+    gb_vec_destroy(env);
+
+    bool ok = single == multi;
+    printf("%s: %d instances, frame skip 4, %d CPUs\n", path, count, cpus);
+    printf("determinism       1 vs %d threads over %d steps: %s\n", threads, CHECK_STEPS, ok ? "ok" : "FAIL");
+
+    for (int t = 1; t <= cpus; t *= 2) {
+        env = create(rom, rom_size, count, t);
+        gb_vec_reset(env, obs, ram);
+
+        uint32_t seed = 1;
+        uint64_t steps = 0;
+        double start = now_seconds();
+        double elapsed;
+        do {
+            for (int i = 0; i < count; i++) actions[i] = (uint8_t) next_random(&seed);
+            gb_vec_step(env, actions, obs, ram, done);
+            steps += count;
+            elapsed = now_seconds() - start;
+        } while (elapsed < seconds);
+
+        printf("%3d thread(s)      %10.0f steps/s  %10.0f frames/s\n", t, steps / elapsed, steps * 4 / elapsed);
+        gb_vec_destroy(env);
+        if (t < cpus && t * 2 > cpus) t = cpus / 2; // last round uses every CPU
+    }
+
+    free(obs);
+    free(ram);
+    free(done);
+    free(actions);
+    free(rom);
+    return ok ? 0 : 1;
+}
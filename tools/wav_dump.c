@@ -0,0 +1,91 @@
+#include "common.h"
+#include "_gb.h"
+#include <string.h>
+
+// Usage: wav_dump <rom> <out.wav> [frames] [sample_rate]
+// Runs a ROM headless and writes everything the APU produced to a WAV file.
+
+
+static void put16(FILE* f, uint16_t v) {
+    uint8_t b[2] = { v & 0xFF, v >> 8 };
+    fwrite(b, 1, 2, f);
+}
+
+
+static void put32(FILE* f, uint32_t v) {
+    uint8_t b[4] = { v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, v >> 24 };
+    fwrite(b, 1, 4, f);
+}
+
+
+static void write_header(FILE* f, int rate, uint32_t frames) {
+    uint32_t data_size = frames * 4;
+
+    fwrite("RIFF", 1, 4, f);
+    put32(f, 36 + data_size);
+    fwrite("WAVEfmt ", 1, 8, f);
+    put32(f, 16);
+    put16(f, 1);        // PCM
+    put16(f, 2);        // stereo
+    put32(f, rate);
+    put32(f, rate * 4);
+    put16(f, 4);
+    put16(f, 16);
+    fwrite("data", 1, 4, f);
+    put32(f, data_size);
+}
+
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("Usage: %s <rom> <out.wav> [frames] [sample_rate]\n", argv[0]);
+        return 1;
+    }
+
+    int frames = argc > 3 ? atoi(argv[3]) : 600;
+    int rate = argc > 4 ? atoi(argv[4]) : 48000;
+
+    size_t rom_size;
+    uint8_t* rom = read_file(argv[1], &rom_size);
+    if (!rom) {
+        printf("ROM not found: %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        printf("Cannot open %s\n", argv[2]);
+        return 1;
+    }
+
+    GameBoy* gb = gb_create();
+    gb_instance_load_rom(gb, rom, (int) rom_size);
+    gb_audio_set_sample_rate(gb, rate);
+
+    write_header(out, rate, 0);
+
+    int16_t samples[4096 * 2];
+    uint32_t total = 0;
+
+    for (int i = 0; i < frames; i++) {
+        gb_instance_step_frame(gb);
+
+        size_t n;
+        while ((n = gb_audio_read(gb, samples, 4096)) > 0) {
+            for (size_t k = 0; k < n * 2; k++) {
+                put16(out, (uint16_t) samples[k]);
+            }
+            total += n;
+        }
+    }
+
+    fseek(out, 0, SEEK_SET);
+    write_header(out, rate, total);
+    fclose(out);
+
+    printf("Wrote %u frames (%.2f s) to %s\n", total, (double) total / rate, argv[2]);
+
+    gb_destroy(gb);
+    free(rom);
+    return 0;
+}